@@ -28,7 +28,7 @@ RAYGEN(main) {
   uint32_t path_len = max(1u, global.options.path_per_iteration);
 
   for (uint32_t i = 0; (i < path_len); ++i) {
-    bool continue_iteration = run_path_iteration(global.scene, global.options, rt, payload);
+    bool continue_iteration = run_path_iteration(global.scene, global.options, PTLightReservoirs{}, rt, payload);
     if (continue_iteration == false) {
       float3 xyz = (payload.accumulated / spectrum::sample_pdf()).to_xyz();
 
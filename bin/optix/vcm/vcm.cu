@@ -95,7 +95,7 @@ ETX_GPU_CALLABLE void vcm_camera_merge(VCMGlobal* global_ptr) {
   const auto& grid = global.spatial_grid;
   auto& iteration = *global.iteration;
 
-  if ((options.merge_vertices() == false) || (grid.indices.count == 0) || (state.total_path_depth + 1 > options.max_depth)) {
+  if ((options.merge_vertices() == false) || (grid.vertices.count == 0) || (state.total_path_depth + 1 > options.max_depth)) {
     return;
   }
 
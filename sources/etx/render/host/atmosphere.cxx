@@ -0,0 +1,338 @@
+#include <etx/core/core.hxx>
+#include <etx/render/host/atmosphere.hxx>
+
+namespace etx {
+
+namespace atmosphere {
+
+constexpr float kHorizon = 1242352.6f;  // sqrt(kAtmosphereTop^2 - kPlanetRadius^2)
+
+/*
+ * Transmittance table stores optical length (integrated rayleigh / mie / ozone density) to the top of the atmosphere
+ * it does not depend on the scattering coefficients, so it is built only once
+ * parametrization follows Bruneton: distance to the top boundary and distance to the horizon
+ */
+constexpr uint2 kTransmittanceTableSize = {256u, 64u};
+
+/*
+ * Multiple scattering table (Hillaire 2020) stores isotropic multiple scattering contribution
+ * for the unit sun illuminance as a function of height and cosine of the sun zenith angle
+ */
+constexpr uint32_t kMultipleScatteringTableSize = 32u;
+constexpr uint32_t kMultipleScatteringDirections = 64u;
+constexpr uint32_t kMultipleScatteringSteps = 20u;
+
+inline float scattering_rayleigh(float l) {
+  l /= 100.0f;
+  float l2 = l * l;
+  return 1.169939f / (l2 * l2 * 100.0f);
+}
+
+inline float scattering_mie(float l) {
+  constexpr float scale = 0.3954608f * (kPi * kPi * kPi);
+  return scale / (l * l);
+}
+
+inline float ozone_absorbtion(float l) {
+  const float na = 6.022140857f /* e+23f cancelled with base */;
+  const float concentration = 41.58f * 0.000001f;
+  float x = l;
+  float x2 = x * x;
+  float x3 = x2 * x;
+  float x4 = x2 * x2;
+  float x5 = x4 * x;
+  float x6 = x4 * x2;
+  float base = max(0.0f, -1.109902e-15f * x6 + 3.950001e-12f * x5 - 5.784719e-09f * x4 + 4.460262e-06f * x3 - 1.909367e-03f * x2 + 4.303677e-01f * x - 3.992226e+01f);
+  return base * na * concentration;
+}
+
+struct TableLookup {
+  uint32_t index[4] = {};
+  float weight[4] = {};
+};
+
+inline TableLookup table_lookup(const float2& uv, const uint2& dim) {
+  float x = saturate(uv.x) * float(dim.x - 1u);
+  float y = saturate(uv.y) * float(dim.y - 1u);
+  uint32_t x0 = min(uint32_t(x), dim.x - 2u);
+  uint32_t y0 = min(uint32_t(y), dim.y - 2u);
+  float dx = x - float(x0);
+  float dy = y - float(y0);
+
+  TableLookup result;
+  result.index[0] = x0 + y0 * dim.x;
+  result.index[1] = result.index[0] + 1u;
+  result.index[2] = result.index[0] + dim.x;
+  result.index[3] = result.index[2] + 1u;
+  result.weight[0] = (1.0f - dx) * (1.0f - dy);
+  result.weight[1] = dx * (1.0f - dy);
+  result.weight[2] = (1.0f - dx) * dy;
+  result.weight[3] = dx * dy;
+  return result;
+}
+
+inline float2 transmittance_table_uv(float r, float mu) {
+  float rho = sqrtf(max(0.0f, r * r - kPlanetRadius * kPlanetRadius));
+  float d = max(0.0f, -r * mu + sqrtf(max(0.0f, r * r * (mu * mu - 1.0f) + kAtmosphereTop * kAtmosphereTop)));
+  float d_min = kAtmosphereTop - r;
+  float d_max = rho + kHorizon;
+  return {(d - d_min) / max(d_max - d_min, kEpsilon), rho / kHorizon};
+}
+
+inline float2 transmittance_table_r_mu(const float2& uv) {
+  float rho = kHorizon * uv.y;
+  float r = sqrtf(rho * rho + kPlanetRadius * kPlanetRadius);
+  float d_min = kAtmosphereTop - r;
+  float d_max = rho + kHorizon;
+  float d = d_min + uv.x * (d_max - d_min);
+  float mu = (d <= 0.0f) ? 1.0f : (kHorizon * kHorizon - rho * rho - d * d) / (2.0f * r * d);
+  return {r, clamp(mu, -1.0f, 1.0f)};
+}
+
+inline bool ray_hits_planet(float r, float mu) {
+  return (mu < 0.0f) && (r * r * (mu * mu - 1.0f) + kPlanetRadius * kPlanetRadius >= 0.0f);
+}
+
+}  // namespace atmosphere
+
+void Atmosphere::build(TaskScheduler& scheduler, const Parameters& parameters, const Pointer<Spectrums> spectrums) {
+  _parameters = parameters;
+  init_spectrums(spectrums);
+  build_transmittance_table(scheduler);
+  if (_parameters.multiple_scattering) {
+    build_multiple_scattering_table(scheduler);
+  }
+}
+
+void Atmosphere::init_spectrums(const Pointer<Spectrums> spectrums) {
+  if (_rayleigh.count > 0) {
+    return;
+  }
+
+  std::vector<float2> rayleigh(spectrum::WavelengthCount);
+  std::vector<float2> mie(spectrum::WavelengthCount);
+  std::vector<float2> ozone(spectrum::WavelengthCount);
+  for (uint32_t w = spectrum::ShortestWavelength; w <= spectrum::LongestWavelength; ++w) {
+    uint32_t i = w - spectrum::ShortestWavelength;
+    rayleigh[i] = {float(w), atmosphere::scattering_rayleigh(float(w))};
+    mie[i] = {float(w), atmosphere::scattering_mie(float(w))};
+    ozone[i] = {float(w), atmosphere::ozone_absorbtion(float(w))};
+  }
+
+  _rayleigh = SpectralDistribution::from_samples(rayleigh.data(), spectrum::WavelengthCount, SpectralDistribution::Reflectance, spectrums);
+  _mie = SpectralDistribution::from_samples(mie.data(), spectrum::WavelengthCount, SpectralDistribution::Reflectance, spectrums);
+  _ozone = SpectralDistribution::from_samples(ozone.data(), spectrum::WavelengthCount, SpectralDistribution::Reflectance, spectrums);
+}
+
+void Atmosphere::build_transmittance_table(TaskScheduler& scheduler) {
+  using namespace atmosphere;
+
+  if (_transmittance_table.empty() == false) {
+    return;
+  }
+
+  _transmittance_table.resize(kTransmittanceTableSize.x * kTransmittanceTableSize.y);
+  scheduler.execute(uint32_t(_transmittance_table.size()), [this](uint32_t begin, uint32_t end, uint32_t) {
+    Sampler smp = {};
+    for (uint32_t i = begin; i < end; ++i) {
+      float2 uv = {
+        float(i % kTransmittanceTableSize.x) / float(kTransmittanceTableSize.x - 1u),
+        float(i / kTransmittanceTableSize.x) / float(kTransmittanceTableSize.y - 1u),
+      };
+      float2 r_mu = transmittance_table_r_mu(uv);
+      float3 p = {0.0f, r_mu.x, 0.0f};
+      float3 w = {sqrtf(max(0.0f, 1.0f - r_mu.y * r_mu.y)), r_mu.y, 0.0f};
+      float to_space = distance_to_sphere(p, w, {}, kAtmosphereTop);
+      _transmittance_table[i] = optical_length(p, p + to_space * w, smp, 0.0f);
+    }
+  });
+}
+
+void Atmosphere::build_multiple_scattering_table(TaskScheduler& scheduler) {
+  using namespace atmosphere;
+
+  float3 parameters = {_parameters.rayleigh, _parameters.mie, _parameters.ozone};
+  if ((_multiple_scattering_table.empty() == false) && (parameters == _multiple_scattering_parameters)) {
+    return;
+  }
+
+  _multiple_scattering_parameters = parameters;
+  _multiple_scattering_table.resize(kMultipleScatteringTableSize * kMultipleScatteringTableSize * kEntryCount);
+  scheduler.execute(kMultipleScatteringTableSize * kMultipleScatteringTableSize, [this](uint32_t begin, uint32_t end, uint32_t) {
+    constexpr float kGoldenAngle = 2.39996323f;
+    constexpr float kIsotropicPhase = 1.0f / (4.0f * kPi);
+
+    for (uint32_t i = begin; i < end; ++i) {
+      float r = kPlanetRadius + kAtmosphereRadius * float(i / kMultipleScatteringTableSize) / float(kMultipleScatteringTableSize - 1u);
+      float mu_s = 2.0f * float(i % kMultipleScatteringTableSize) / float(kMultipleScatteringTableSize - 1u) - 1.0f;
+      float3 p = {0.0f, r, 0.0f};
+      float3 l = {sqrtf(max(0.0f, 1.0f - mu_s * mu_s)), mu_s, 0.0f};
+
+      float second_order[kEntryCount] = {};
+      float transfer[kEntryCount] = {};
+
+      for (uint32_t k = 0; k < kMultipleScatteringDirections; ++k) {
+        float z = 1.0f - 2.0f * (float(k) + 0.5f) / float(kMultipleScatteringDirections);
+        float s = sqrtf(max(0.0f, 1.0f - z * z));
+        float3 w = {s * cosf(kGoldenAngle * float(k)), z, s * sinf(kGoldenAngle * float(k))};
+
+        float t_max = distance_to_sphere(p, w, {}, kAtmosphereTop);
+        float to_planet = distance_to_sphere(p, w, {}, kPlanetRadius);
+        if (to_planet > 0.0f) {
+          t_max = to_planet;
+        }
+
+        float dt = t_max / float(kMultipleScatteringSteps);
+        float3 view_optical_path = {};
+        for (uint32_t j = 0; j < kMultipleScatteringSteps; ++j) {
+          float3 pos = p + w * ((float(j) + 0.5f) * dt);
+          float3 d = density(length(pos) - kPlanetRadius);
+          float3 optical_path = view_optical_path + d * (0.5f * dt);
+          view_optical_path += d * dt;
+
+          float3 sun_optical_path = {};
+          bool sun_visible = optical_length_to_space(pos, l, sun_optical_path);
+
+          for (uint32_t e = 0; e < kEntryCount; ++e) {
+            float value = transmittance(optical_path, e) * scattering(d, e) * dt;
+            transfer[e] += value;
+            if (sun_visible) {
+              second_order[e] += value * transmittance(sun_optical_path, e) * kIsotropicPhase;
+            }
+          }
+        }
+      }
+
+      float* output = _multiple_scattering_table.data() + i * kEntryCount;
+      for (uint32_t e = 0; e < kEntryCount; ++e) {
+        float f_ms = transfer[e] / float(kMultipleScatteringDirections);
+        float l_2 = second_order[e] / float(kMultipleScatteringDirections);
+        output[e] = l_2 / max(1.0f - f_ms, kEpsilon);
+      }
+    }
+  });
+}
+
+bool Atmosphere::optical_length_to_space(const float3& p, const float3& w, float3& result) const {
+  using namespace atmosphere;
+
+  float p_len = length(p);
+  float r = clamp(p_len, kPlanetRadius, kAtmosphereTop);
+  float mu = dot(p, w) / p_len;
+  if (ray_hits_planet(r, mu)) {
+    return false;
+  }
+
+  const auto& table = _transmittance_table;
+  auto lookup = table_lookup(transmittance_table_uv(r, mu), kTransmittanceTableSize);
+  result = table[lookup.index[0]] * lookup.weight[0] + table[lookup.index[1]] * lookup.weight[1] +  //
+           table[lookup.index[2]] * lookup.weight[2] + table[lookup.index[3]] * lookup.weight[3];
+  return true;
+}
+
+void Atmosphere::multiple_scattering(const float3& p, const float3& l, float output[]) const {
+  using namespace atmosphere;
+
+  float p_len = length(p);
+  float2 uv = {0.5f * dot(p, l) / p_len + 0.5f, (p_len - kPlanetRadius) / kAtmosphereRadius};
+  auto lookup = table_lookup(uv, {kMultipleScatteringTableSize, kMultipleScatteringTableSize});
+  for (uint32_t e = 0; e < kEntryCount; ++e) {
+    const float* table = _multiple_scattering_table.data() + e;
+    output[e] = table[lookup.index[0] * kEntryCount] * lookup.weight[0] + table[lookup.index[1] * kEntryCount] * lookup.weight[1] +  //
+                table[lookup.index[2] * kEntryCount] * lookup.weight[2] + table[lookup.index[3] * kEntryCount] * lookup.weight[3];
+  }
+}
+
+float3 Atmosphere::in_scattering(const float3& origin, const float3& w, const float3& l, float step_scale, Sampler& smp, float output[]) const {
+  using namespace atmosphere;
+
+  float to_space = distance_to_sphere(origin, w, {}, kAtmosphereTop);
+  float to_planet = distance_to_sphere(origin, w, {}, kPlanetRadius);
+  if (to_planet > 0.0f) {
+    to_space = to_planet;
+  }
+
+  auto cos_t = dot(l, w);
+  auto phase_r = phase_rayleigh(cos_t);
+  auto phase_m = phase_mie(cos_t, _parameters.anisotropy);
+
+  constexpr auto d_k = density_k();
+  const float delta_density = 0.025f;
+
+  float3 position = origin;
+  float3 total_optical_path = {};
+  float t = 0.0f;
+
+  for (uint32_t e = 0; e < kEntryCount; ++e) {
+    output[e] = 0.0f;
+  }
+
+  while (t < to_space) {
+    float3 current_density = density(length(position) - kPlanetRadius);
+    float r_step = -logf(delta_density / current_density.x + 1.0f) / d_k.x;
+    float m_step = -logf(delta_density / current_density.y + 1.0f) / d_k.y;
+    float dt = min(to_space - t, min(r_step, m_step) * (1.0f + step_scale * smp.next()));
+    position += w * dt;
+    t += dt;
+
+    float3 d = dt * density(length(position) - kPlanetRadius);
+
+    float3 optical_path = {};
+    bool sun_visible = optical_length_to_space(position, l, optical_path);
+
+    float ms[kEntryCount] = {};
+    if (_parameters.multiple_scattering) {
+      multiple_scattering(position, l, ms);
+    }
+
+    if (sun_visible || _parameters.multiple_scattering) {
+      float3 current_optical_path = total_optical_path + optical_path;
+      for (uint32_t e = 0; e < kEntryCount; ++e) {
+        float value = 0.0f;
+        if (sun_visible) {
+          value += transmittance(current_optical_path, e) * (d.x * phase_r * rayleigh(e) + d.y * phase_m * mie(e));
+        }
+        if (_parameters.multiple_scattering) {
+          value += transmittance(total_optical_path, e) * scattering(d, e) * ms[e];
+        }
+        ETX_VALIDATE(value);
+        output[e] += value;
+      }
+    }
+
+    total_optical_path += d;
+  }
+
+  return total_optical_path;
+}
+
+void Atmosphere::bake(TaskScheduler& scheduler, const float3& origin, const float3& sun_direction, const SpectralDistribution& sun_emission, const uint2& dimensions,
+  float4* output) const {
+  scheduler.execute(dimensions.x * dimensions.y, [&](uint32_t begin, uint32_t end, uint32_t) {
+    Sampler smp = {};
+    float values[kEntryCount] = {};
+    for (uint32_t i = begin; i < end; ++i) {
+      float2 uv = {
+        (float(i % dimensions.x) + 0.5f) / float(dimensions.x),
+        (float(i / dimensions.x) + 0.5f) / float(dimensions.y),
+      };
+      in_scattering(origin, uv_to_direction(uv), sun_direction, 0.0f, smp, values);
+
+      float3 rgb = {};
+      if constexpr (spectrum::kSpectralRendering) {
+        SpectralDistribution result = {{}, kEntryCount};
+        for (uint32_t e = 0; e < kEntryCount; ++e) {
+          float wavelength = spectrum::table_wavelength(e);
+          result.power[e] = values[e] * sun_emission.query({wavelength}).components.x;
+        }
+        rgb = max(float3{}, spectrum::xyz_to_rgb(result.integrate_to_xyz()));
+      } else {
+        auto e = sun_emission.query({-1.0f});
+        rgb = {values[0] * e.components.x, values[1] * e.components.y, values[2] * e.components.z};
+      }
+      output[i] = {rgb.x, rgb.y, rgb.z, 1.0f};
+    }
+  });
+}
+
+}  // namespace etx
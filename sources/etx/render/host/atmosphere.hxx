@@ -0,0 +1,153 @@
+#pragma once
+
+#include <etx/render/shared/base.hxx>
+#include <etx/render/shared/sampler.hxx>
+#include <etx/render/shared/spectrum.hxx>
+#include <etx/render/host/tasks.hxx>
+
+#include <vector>
+
+namespace etx {
+
+constexpr float kAtmosphereTop = kPlanetRadius + kAtmosphereRadius;
+
+namespace atmosphere {
+
+inline float ozone_vertical_profile(float h) {
+  float x = h / 1000.0f;
+  float x2 = x * x;
+  float x3 = x2 * x;
+  float x4 = x2 * x2;
+  float x5 = x4 * x;
+  float x6 = x3 * x3;
+  float f = 3.759384E-08f * x6 - 1.067250E-05f * x5 + 1.080311E-03f * x4 - 4.851181E-02f * x3 + 9.185432E-01f * x2 - 4.886021E+00f * x + 7.900478E+00f;
+  const float n = 30.8491249f;
+  return max(0.0f, f / n);
+}
+
+inline float3 density(float height_above_ground) {
+  constexpr float density_h_r = 7994.0f;
+  constexpr float density_h_m = 1200.0f;
+  height_above_ground = max(0.0f, height_above_ground);
+  return {expf(-height_above_ground / density_h_r), expf(-height_above_ground / density_h_m), ozone_vertical_profile(height_above_ground)};
+}
+
+inline constexpr float3 density_k() {
+  constexpr float density_h_r = 7994.0f;
+  constexpr float density_h_m = 1200.0f;
+  return {-1.0f / density_h_r, -1.0f / density_h_m, 0.0f};
+}
+
+inline float3 optical_length(float3 p, const float3& target, Sampler& smp, float opt_step_scale) {
+  constexpr auto d_k = density_k();
+  const float delta_density = 0.025f;
+
+  float3 result = {};
+
+  float3 dp = (target - p);
+  float total_distance = length(dp);
+  dp /= total_distance;
+  float t = 0.0f;
+  while (t < total_distance) {
+    float3 current_density = density(length(p) - kPlanetRadius);
+    float r_step = -logf(delta_density / current_density.x + 1.0f) / d_k.x;
+    float m_step = -logf(delta_density / current_density.y + 1.0f) / d_k.y;
+    float dt = min(total_distance - t, min(r_step, m_step) * (1.0f + opt_step_scale * smp.next()));
+
+    p += dp * dt;
+    t += dt;
+
+    result += dt * density(length(p) - kPlanetRadius);
+  }
+  return result;
+}
+
+inline float phase_rayleigh(float l_dot_v) {
+  return (3.0f / 4.0f) * (1.0f + l_dot_v * l_dot_v) * (1.0f / (4.0f * kPi));
+}
+
+inline float phase_mie(float l_dot_v, float g) {
+  return (3.0f / 2.0f) * ((1.0f - g * g) * (1.0f + l_dot_v * l_dot_v)) / ((2.0f + g * g) * powf(1.0f + g * g - 2.0f * g * l_dot_v, 1.5f)) * (1.0f / (4.0f * kPi));
+}
+
+}  // namespace atmosphere
+
+struct Atmosphere {
+  static constexpr uint32_t kEntryCount = SpectralDistribution::kEntryCount;
+
+  struct Parameters {
+    float rayleigh = 1.0f;
+    float mie = 1.0f;
+    float ozone = 1.0f;
+    float anisotropy = 0.75f;
+    bool multiple_scattering = true;
+  };
+
+  Atmosphere() = default;
+  ~Atmosphere() = default;
+
+  /*
+   * builds lookup tables if they are missing or scattering parameters were changed
+   */
+  void build(TaskScheduler& scheduler, const Parameters& parameters, const Pointer<Spectrums> spectrums);
+
+  /*
+   * evaluates radiance scattered towards `origin` along `-w` from the unit sun in the direction `l`
+   * returns optical length of the view ray
+   */
+  float3 in_scattering(const float3& origin, const float3& w, const float3& l, float step_scale, Sampler& smp, float output[]) const;
+
+  /*
+   * evaluates sky into lat-long RGB image as seen from the `origin`, sun disk is not included
+   */
+  void bake(TaskScheduler& scheduler, const float3& origin, const float3& sun_direction, const SpectralDistribution& sun_emission, const uint2& dimensions,
+    float4* output) const;
+
+  bool optical_length_to_space(const float3& p, const float3& w, float3& result) const;
+  void multiple_scattering(const float3& p, const float3& l, float output[]) const;
+
+  float transmittance(const float3& optical_path, uint32_t entry) const {
+    return expf(-optical_path.x * rayleigh(entry) - optical_path.y * mie(entry) - optical_path.z * ozone(entry));
+  }
+
+  float scattering(const float3& d, uint32_t entry) const {
+    return d.x * rayleigh(entry) + d.y * mie(entry);
+  }
+
+  float rayleigh(uint32_t entry) const {
+    return _rayleigh.power[entry] * _parameters.rayleigh;
+  }
+
+  float mie(uint32_t entry) const {
+    return _mie.power[entry] * _parameters.mie;
+  }
+
+  float ozone(uint32_t entry) const {
+    return _ozone.power[entry] * _parameters.ozone;
+  }
+
+  const Parameters& parameters() const {
+    return _parameters;
+  }
+
+ private:
+  Atmosphere(const Atmosphere&) = delete;
+  Atmosphere& operator=(const Atmosphere&) = delete;
+  Atmosphere(Atmosphere&&) = delete;
+  Atmosphere& operator=(Atmosphere&&) = delete;
+
+  void init_spectrums(const Pointer<Spectrums> spectrums);
+  void build_transmittance_table(TaskScheduler& scheduler);
+  void build_multiple_scattering_table(TaskScheduler& scheduler);
+
+ private:
+  Parameters _parameters = {};
+  SpectralDistribution _rayleigh = {};
+  SpectralDistribution _mie = {};
+  SpectralDistribution _ozone = {};
+  std::vector<float3> _transmittance_table = {};
+  std::vector<float> _multiple_scattering_table = {};
+  float3 _multiple_scattering_parameters = {-1.0f, -1.0f, -1.0f};
+};
+
+}  // namespace etx
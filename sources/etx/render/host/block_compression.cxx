@@ -0,0 +1,264 @@
+#include <etx/render/host/block_compression.hxx>
+#include <etx/render/shared/block_compression.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace etx {
+
+namespace bcn {
+
+namespace {
+
+constexpr uint32_t kTexelCount = kBlockSize * kBlockSize;
+
+/*
+ * endpoints of the bounding box diagonal, orientation of each channel follows its covariance
+ * with the channel of the largest range, so anti-correlated channels are handled too
+ */
+template <uint32_t kChannels>
+void bounding_endpoints(const float values[][kChannels], float e0[], float e1[]) {
+  float mean[kChannels] = {};
+  for (uint32_t c = 0; c < kChannels; ++c) {
+    e0[c] = values[0][c];
+    e1[c] = values[0][c];
+  }
+
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    for (uint32_t c = 0; c < kChannels; ++c) {
+      e0[c] = std::min(e0[c], values[i][c]);
+      e1[c] = std::max(e1[c], values[i][c]);
+      mean[c] += values[i][c] / float(kTexelCount);
+    }
+  }
+
+  uint32_t major = 0;
+  for (uint32_t c = 1; c < kChannels; ++c) {
+    major = (e1[c] - e0[c] > e1[major] - e0[major]) ? c : major;
+  }
+
+  for (uint32_t c = 0; c < kChannels; ++c) {
+    float covariance = 0.0f;
+    for (uint32_t i = 0; i < kTexelCount; ++i) {
+      covariance += (values[i][c] - mean[c]) * (values[i][major] - mean[major]);
+    }
+    if (covariance < 0.0f) {
+      std::swap(e0[c], e1[c]);
+    }
+  }
+}
+
+uint32_t to_565(const float v[]) {
+  auto r = static_cast<uint32_t>(std::lround(saturate(v[0]) * 31.0f));
+  auto g = static_cast<uint32_t>(std::lround(saturate(v[1]) * 63.0f));
+  auto b = static_cast<uint32_t>(std::lround(saturate(v[2]) * 31.0f));
+  return (r << 11u) | (g << 5u) | b;
+}
+
+uint32_t float_to_half(float v) {
+  v = std::min(std::max(v, 0.0f), kMaxBC6HValue);
+  if (v < 6.103515625e-5f) {
+    return static_cast<uint32_t>(std::lround(v * 16777216.0f));
+  }
+
+  int32_t exponent = 0;
+  float fraction = std::frexp(v, &exponent);
+  auto mantissa = static_cast<uint32_t>(std::lround((2.0f * fraction - 1.0f) * 1024.0f));
+  auto result = (static_cast<uint32_t>(exponent + 14) << 10u) + mantissa;
+  return std::min(result, 0x7bffu);
+}
+
+void write_bits(uint64_t block[], uint32_t offset, uint32_t count, uint32_t value) {
+  for (uint32_t i = 0; i < count; ++i, ++offset) {
+    block[offset / 64u] |= uint64_t((value >> i) & 1u) << (offset % 64u);
+  }
+}
+
+}  // namespace
+
+uint64_t encode_bc1(const float4 texels[]) {
+  float values[kTexelCount][3] = {};
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    values[i][0] = saturate(texels[i].x);
+    values[i][1] = saturate(texels[i].y);
+    values[i][2] = saturate(texels[i].z);
+  }
+
+  float e0[3] = {};
+  float e1[3] = {};
+  bounding_endpoints<3>(values, e0, e1);
+
+  uint32_t c0 = to_565(e0);
+  uint32_t c1 = to_565(e1);
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+
+  uint64_t block = uint64_t(c0) | (uint64_t(c1) << 16u);
+  if (c0 == c1) {
+    return block;
+  }
+
+  float3 palette[4] = {decode_565(c0), decode_565(c1)};
+  palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+  palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    float3 value = {values[i][0], values[i][1], values[i][2]};
+    uint32_t best_index = 0;
+    float best_error = kMaxFloat;
+    for (uint32_t j = 0; j < 4u; ++j) {
+      float error = dot(value - palette[j], value - palette[j]);
+      if (error < best_error) {
+        best_error = error;
+        best_index = j;
+      }
+    }
+    block |= uint64_t(best_index) << (32u + 2u * i);
+  }
+  return block;
+}
+
+uint64_t encode_bc4(const float values[]) {
+  float min_value = saturate(values[0]);
+  float max_value = saturate(values[0]);
+  for (uint32_t i = 1; i < kTexelCount; ++i) {
+    min_value = std::min(min_value, saturate(values[i]));
+    max_value = std::max(max_value, saturate(values[i]));
+  }
+
+  auto r0 = static_cast<uint32_t>(std::lround(max_value * 255.0f));
+  auto r1 = static_cast<uint32_t>(std::lround(min_value * 255.0f));
+  const uint64_t endpoints = uint64_t(r0) | (uint64_t(r1) << 8u);
+  uint64_t block = endpoints;
+  if (r0 == r1) {
+    return block;
+  }
+
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    uint32_t best_index = 0;
+    float best_error = kMaxFloat;
+    for (uint32_t j = 0; j < 8u; ++j) {
+      uint64_t candidate = endpoints | (uint64_t(j) << 16u);
+      float error = fabsf(decode_bc4(&candidate, 0u) - saturate(values[i]));
+      if (error < best_error) {
+        best_error = error;
+        best_index = j;
+      }
+    }
+    block |= uint64_t(best_index) << (16u + 3u * i);
+  }
+  return block;
+}
+
+void encode_bc5(const float4 texels[], uint64_t block[]) {
+  float x[kTexelCount] = {};
+  float y[kTexelCount] = {};
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    x[i] = texels[i].x;
+    y[i] = texels[i].y;
+  }
+  block[0] = encode_bc4(x);
+  block[1] = encode_bc4(y);
+}
+
+void encode_bc6h(const float4 texels[], uint64_t block[]) {
+  // endpoints are fitted to the values before the final scale by 31/64 applied by the decoder
+  uint32_t target[kTexelCount][3] = {};
+  float values[kTexelCount][3] = {};
+  for (uint32_t i = 0; i < kTexelCount; ++i) {
+    target[i][0] = float_to_half(texels[i].x);
+    target[i][1] = float_to_half(texels[i].y);
+    target[i][2] = float_to_half(texels[i].z);
+    for (uint32_t c = 0; c < 3u; ++c) {
+      values[i][c] = float((target[i][c] * 64u + 30u) / 31u);
+    }
+  }
+
+  float e0[3] = {};
+  float e1[3] = {};
+  bounding_endpoints<3>(values, e0, e1);
+
+  uint32_t q0[3] = {};
+  uint32_t q1[3] = {};
+  uint32_t indices[kTexelCount] = {};
+
+  // decoder interpolates linearly in this space, so endpoints are refined by least squares for the selected indices
+  constexpr uint32_t kRefinementSteps = 3u;
+  for (uint32_t step = 0; step < kRefinementSteps; ++step) {
+    for (uint32_t c = 0; c < 3u; ++c) {
+      q0[c] = static_cast<uint32_t>(std::clamp(std::lround((e0[c] - 32.0f) / 64.0f), 0l, 1023l));
+      q1[c] = static_cast<uint32_t>(std::clamp(std::lround((e1[c] - 32.0f) / 64.0f), 0l, 1023l));
+    }
+
+    for (uint32_t i = 0; i < kTexelCount; ++i) {
+      float best_error = kMaxFloat;
+      for (uint32_t j = 0; j < 16u; ++j) {
+        float error = 0.0f;
+        for (uint32_t c = 0; c < 3u; ++c) {
+          // half-float bits are close to logarithm of the value, so the error is relative
+          float d = float(bc6h_interpolate(q0[c], q1[c], bc6h_weight(j))) - float(target[i][c]);
+          error += d * d;
+        }
+        if (error < best_error) {
+          best_error = error;
+          indices[i] = j;
+        }
+      }
+    }
+
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    for (uint32_t i = 0; i < kTexelCount; ++i) {
+      float b = float(bc6h_weight(indices[i])) / 64.0f;
+      aa += (1.0f - b) * (1.0f - b);
+      ab += (1.0f - b) * b;
+      bb += b * b;
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < kEpsilon) {
+      break;
+    }
+
+    for (uint32_t c = 0; c < 3u; ++c) {
+      float au = 0.0f;
+      float bu = 0.0f;
+      for (uint32_t i = 0; i < kTexelCount; ++i) {
+        float b = float(bc6h_weight(indices[i])) / 64.0f;
+        au += (1.0f - b) * values[i][c];
+        bu += b * values[i][c];
+      }
+      e0[c] = std::clamp((bb * au - ab * bu) / det, 0.0f, 65535.0f);
+      e1[c] = std::clamp((aa * bu - ab * au) / det, 0.0f, 65535.0f);
+    }
+  }
+
+  // the most significant bit of the first index is not stored, it should be zero
+  if (indices[0] >= 8u) {
+    for (uint32_t c = 0; c < 3u; ++c) {
+      std::swap(q0[c], q1[c]);
+    }
+    for (uint32_t i = 0; i < kTexelCount; ++i) {
+      indices[i] = 15u - indices[i];
+    }
+  }
+
+  block[0] = 0;
+  block[1] = 0;
+  write_bits(block, 0u, 5u, kBC6HMode11);
+  for (uint32_t c = 0; c < 3u; ++c) {
+    write_bits(block, 5u + 10u * c, 10u, q0[c]);
+    write_bits(block, 35u + 10u * c, 10u, q1[c]);
+  }
+  write_bits(block, 65u, 3u, indices[0]);
+  for (uint32_t i = 1; i < kTexelCount; ++i) {
+    write_bits(block, 64u + 4u * i, 4u, indices[i]);
+  }
+}
+
+}  // namespace bcn
+
+}  // namespace etx
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <etx/render/shared/base.hxx>
+
+namespace etx {
+
+/*
+ * encoders of 4x4 BCn blocks, 16 input texels are numbered row by row,
+ * output layout matches the decoders in etx/render/shared/block_compression.hxx
+ */
+namespace bcn {
+
+uint64_t encode_bc1(const float4 texels[]);
+uint64_t encode_bc4(const float values[]);
+void encode_bc5(const float4 texels[], uint64_t block[]);
+
+/*
+ * largest value representable in BC6H (half float), larger values are clamped by the encoder
+ */
+constexpr float kMaxBC6HValue = 65504.0f;
+
+/*
+ * unsigned BC6H in mode 11, negative values are clamped to zero
+ */
+void encode_bc6h(const float4 texels[], uint64_t block[]);
+
+}  // namespace bcn
+
+}  // namespace etx
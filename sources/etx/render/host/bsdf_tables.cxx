@@ -0,0 +1,180 @@
+#include <etx/core/core.hxx>
+
+#include <etx/render/shared/scene.hxx>
+#include <etx/render/host/bsdf_tables.hxx>
+
+namespace etx {
+
+void build_microfacet_energy_table(TaskScheduler& scheduler, std::vector<float4>& table) {
+  constexpr uint32_t kSize = kMicrofacetEnergyTableSize;
+  constexpr uint32_t kSampleCount = 4096u;
+  constexpr float kGridStep = 1.0f / float(kSize - 1u);
+
+  table.resize(1llu * kSize * kSize);
+
+  scheduler.execute(kSize, [&table](uint32_t begin, uint32_t end, uint32_t) {
+    const LocalFrame frame = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, LocalFrame::EnteringMaterial};
+
+    for (uint32_t a = begin; a < end; ++a) {
+      float alpha = float(a) * kGridStep;
+      auto ggx = NormalDistribution(frame, {alpha, alpha});
+
+      float average = 0.0f;
+      for (uint32_t c = 0; c < kSize; ++c) {
+        float cos_theta = max(float(c) * kGridStep, 1.0f / 1024.0f);
+        float3 w_i = {-sqrtf(1.0f - cos_theta * cos_theta), 0.0f, -cos_theta};
+
+        // visible normals are sampled, so the estimator reduces to G1 of the outgoing direction
+        Sampler smp(a, c);
+        float albedo = 0.0f;
+        for (uint32_t i = 0; i < kSampleCount; ++i) {
+          float3 m = ggx.sample(smp, w_i);
+          float3 w_o = reflect(w_i, m);
+          if (w_o.z <= kEpsilon)
+            continue;
+
+          auto eval = ggx.evaluate(m, w_i, w_o);
+          albedo += (eval.g1_in > 0.0f) ? eval.visibility / eval.g1_in : 0.0f;
+        }
+        albedo = saturate(albedo / float(kSampleCount));
+        table[c + a * kSize] = {albedo, 0.0f, 0.0f, 1.0f};
+
+        float weight = ((c == 0) || (c + 1u == kSize)) ? 0.5f : 1.0f;
+        average += 2.0f * weight * albedo * float(c) * kGridStep * kGridStep;
+      }
+
+      for (uint32_t c = 0; c < kSize; ++c) {
+        table[c + a * kSize].y = saturate(average);
+      }
+    }
+  });
+}
+
+namespace {
+
+struct ThinfilmTableIOR {
+  float wavelength = 0.0f;
+  complex ext_ior = {};
+  complex film_ior = {};
+  complex int_ior = {};
+};
+
+/*
+ * indices of refraction at each tabulated wavelength in spectral mode, or for each of RGB channels otherwise
+ */
+void thinfilm_table_iors(const Material& material, std::vector<ThinfilmTableIOR>& iors) {
+  if constexpr (spectrum::kSpectralRendering) {
+    iors.resize(Thinfilm::kTableWavelengthCount);
+    for (uint32_t w = 0; w < Thinfilm::kTableWavelengthCount; ++w) {
+      SpectralQuery spect = {spectrum::kShortestWavelength + float(w * Thinfilm::kTableWavelengthStep)};
+      iors[w] = {
+        spect.wavelength,
+        material.ext_ior(spect).as_complex_x(),
+        material.thinfilm.ior(spect).as_complex_x(),
+        material.int_ior(spect).as_complex_x(),
+      };
+    }
+  } else {
+    constexpr float kWavelengths[3] = {690.0f, 550.0f, 430.0f};
+    SpectralQuery spect = {spectrum::kUndefinedWavelength};
+    auto ext_ior = material.ext_ior(spect);
+    auto int_ior = material.int_ior(spect);
+    auto film_ior = material.thinfilm.ior(spect);
+    iors.resize(3u);
+    if (material.cls == Material::Class::Conductor) {
+      iors[0] = {kWavelengths[0], ext_ior.as_complex_x(), film_ior.as_complex_x(), int_ior.as_complex_x()};
+      iors[1] = {kWavelengths[1], ext_ior.as_complex_y(), film_ior.as_complex_y(), int_ior.as_complex_y()};
+      iors[2] = {kWavelengths[2], ext_ior.as_complex_z(), film_ior.as_complex_z(), int_ior.as_complex_z()};
+    } else {
+      for (uint32_t j = 0; j < 3u; ++j) {
+        iors[j] = {kWavelengths[j], ext_ior.as_monochromatic_complex(), film_ior.as_monochromatic_complex(), int_ior.as_monochromatic_complex()};
+      }
+    }
+  }
+}
+
+}  // namespace
+
+uint2 thinfilm_table_dimensions() {
+  return {Thinfilm::kTableCosineSize, 2u * Thinfilm::kTableBlockCount * Thinfilm::kTableThicknessSize};
+}
+
+void thinfilm_table_key(const Material& material, std::vector<float>& key) {
+  std::vector<ThinfilmTableIOR> iors;
+  thinfilm_table_iors(material, iors);
+
+  key.clear();
+  key.reserve(2u + 6u * iors.size());
+  key.emplace_back(material.thinfilm.min_thickness);
+  key.emplace_back(material.thinfilm.max_thickness);
+  for (const auto& ior : iors) {
+    key.insert(key.end(), {ior.ext_ior.real(), ior.ext_ior.imag(), ior.film_ior.real(), ior.film_ior.imag(), ior.int_ior.real(), ior.int_ior.imag()});
+  }
+}
+
+void build_thinfilm_table(TaskScheduler& scheduler, const Material& material, std::vector<float4>& table) {
+  constexpr uint32_t kCosineSize = Thinfilm::kTableCosineSize;
+  constexpr uint32_t kThicknessSize = Thinfilm::kTableThicknessSize;
+  constexpr uint32_t kBlockSize = spectrum::kSpectralRendering ? 4u : 3u;
+
+  const uint2 dimensions = thinfilm_table_dimensions();
+  table.resize(1llu * dimensions.x * dimensions.y);
+
+  std::vector<ThinfilmTableIOR> iors;
+  thinfilm_table_iors(material, iors);
+
+  /*
+   * light coming from the internal medium sees the same film with the media swapped,
+   * so the second half of the table is built with external and internal indices of refraction exchanged
+   */
+  auto reflectance = [](const ThinfilmTableIOR& ior, float cos_theta, float thickness, bool reversed) {
+    float value = reversed ? fresnel::fresnel_thinfilm(ior.wavelength, cos_theta, ior.int_ior, ior.film_ior, ior.ext_ior, thickness)
+                           : fresnel::fresnel_thinfilm(ior.wavelength, cos_theta, ior.ext_ior, ior.film_ior, ior.int_ior, thickness);
+    return isfinite(value) ? saturate(value) : 1.0f;
+  };
+
+  scheduler.execute(dimensions.y, [&](uint32_t begin, uint32_t end, uint32_t) {
+    for (uint32_t row = begin; row < end; ++row) {
+      uint32_t r = row % kThicknessSize;
+      uint32_t block = (row / kThicknessSize) % Thinfilm::kTableBlockCount;
+      bool reversed = row >= dimensions.y / 2u;
+      float thickness = lerp(material.thinfilm.min_thickness, material.thinfilm.max_thickness, float(r) / float(kThicknessSize - 1u));
+
+      for (uint32_t c = 0; c < kCosineSize; ++c) {
+        float cos_theta = max(float(c) / float(kCosineSize - 1u), 1.0f / 1024.0f);
+        float4& value = table[c + 1llu * row * dimensions.x];
+        value = {0.0f, 0.0f, 0.0f, 1.0f};
+
+        for (uint32_t j = 0; (j < kBlockSize) && (kBlockSize * block + j < iors.size()); ++j) {
+          (&value.x)[j] = reflectance(iors[kBlockSize * block + j], cos_theta, thickness, reversed);
+        }
+      }
+    }
+  });
+}
+
+void build_subsurface_profile_table(std::vector<float4>& table) {
+  constexpr uint32_t kSize = subsurface::kProfileTableSize;
+
+  table.resize(2llu * kSize);
+
+  auto cdf = [](double r) {
+    return 1.0 - 0.25 * std::exp(-r) - 0.75 * std::exp(-r / 3.0);
+  };
+
+  for (uint32_t i = 0; i < kSize; ++i) {
+    double u = double(i) / double(kSize - 1u);
+    double r_min = 0.0;
+    double r_max = subsurface::kMaxRadius;
+    for (uint32_t k = 0; (i + 1u < kSize) && (k < 64u); ++k) {
+      double r = 0.5 * (r_min + r_max);
+      (cdf(r) < u ? r_min : r_max) = r;
+    }
+    table[i] = {float(0.5 * (r_min + r_max)), 0.0f, 0.0f, 1.0f};
+
+    double r = subsurface::kMaxRadius * double(i) / double(kSize - 1u);
+    table[kSize + i] = {float(std::exp(-r) + std::exp(-r / 3.0)), 0.0f, 0.0f, 1.0f};
+  }
+}
+
+}  // namespace etx
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <etx/render/shared/base.hxx>
+#include <etx/render/shared/material.hxx>
+#include <etx/render/host/tasks.hxx>
+
+#include <vector>
+
+namespace etx {
+
+/*
+ * builds kMicrofacetEnergyTableSize x kMicrofacetEnergyTableSize table of the single scattering GGX lobe with unit Fresnel:
+ * columns are indexed by cosine of the incoming direction, rows by roughness, both in [0..1]
+ * x - directional albedo E(cos_theta, alpha), y - average albedo E_avg(alpha)
+ */
+void build_microfacet_energy_table(TaskScheduler& scheduler, std::vector<float4>& table);
+
+/*
+ * builds reflectance table of the material's thin film with the layout described in Thinfilm,
+ * conductors use per-channel indices of refraction in RGB mode, other materials use monochromatic ones (as in fresnel::conductor and fresnel::dielectric)
+ */
+void build_thinfilm_table(TaskScheduler& scheduler, const Material& material, std::vector<float4>& table);
+uint2 thinfilm_table_dimensions();
+
+/*
+ * values the thin film table depends on (thickness range and indices of refraction used for each tabulated wavelength),
+ * materials with equal keys could share one table
+ */
+void thinfilm_table_key(const Material& material, std::vector<float>& key);
+
+/*
+ * builds subsurface::kProfileTableSize x 2 table of the normalized Christensen-Burley profile (see bssrdf_subsurface.hxx)
+ */
+void build_subsurface_profile_table(std::vector<float4>& table);
+
+}  // namespace etx
@@ -1,15 +1,19 @@
 #include <etx/core/core.hxx>
 
 #include <etx/render/host/image_pool.hxx>
+#include <etx/render/host/block_compression.hxx>
 #include <etx/render/host/distribution_builder.hxx>
 #include <etx/render/host/pool.hxx>
+#include <etx/render/host/texture_cache.hxx>
 
 #include <tinyexr.hxx>
 #include <stb_image.hxx>
 
 #include <vector>
 #include <unordered_map>
+#include <filesystem>
 #include <functional>
+#include <mutex>
 
 namespace etx {
 
@@ -22,64 +26,237 @@ struct ImagePoolImpl {
 
   void init(uint32_t capacity) {
     image_pool.init(capacity);
+    paths.resize(capacity);
+    keys.resize(capacity);
   }
 
   void cleanup() {
     ETX_ASSERT(image_pool.alive_objects_count() == 0);
+    wait_for_background_loading();
     image_pool.cleanup();
+    paths.clear();
+    keys.clear();
+  }
+
+  /*
+   * the same file could be requested as color (emission) and as reflectance converted to spectral coefficients,
+   * these are different images, so the options are a part of the key
+   */
+  static uint32_t supported_options(uint32_t image_options) {
+    if constexpr (spectrum::kSpectralRendering == false) {
+      image_options &= ~Image::SpectralCoefficients;
+    }
+    return image_options;
+  }
+
+  static std::string mapping_key(const std::string& path, uint32_t image_options) {
+    return (image_options & Image::SpectralCoefficients) ? path + "#coefficients" : path;
   }
 
   uint32_t add_from_file(const std::string& path, uint32_t image_options) {
-    auto i = mapping.find(path);
+    image_options = supported_options(image_options);
+    auto key = mapping_key(path, image_options);
+    auto i = mapping.find(key);
     if (i != mapping.end()) {
       return i->second;
     }
 
     auto handle = image_pool.alloc();
-    mapping[path] = handle;
+    mapping[key] = handle;
+    paths[handle] = path;
+    keys[handle] = key;
 
     auto& image = image_pool.get(handle);
     image.options = image_options;
     if ((image.options & Image::DelayLoad) == 0) {
-      perform_loading(handle, image);
+      perform_loading(handle, image, false);
     }
 
     return handle;
   }
 
-  uint32_t add_from_data(const float4 data[], const uint2& dimensions) {
+  uint32_t add_from_data(const float4 data[], const uint2& dimensions, uint32_t image_options) {
     uint64_t data_size = sizeof(float4) * dimensions.x * dimensions.y;
     uint32_t hash = fnv1a32(reinterpret_cast<const uint8_t*>(data), data_size);
     char buffer[32] = {};
     snprintf(buffer, sizeof(buffer), "#%u", hash);
-    auto i = mapping.find(buffer);
+    image_options = supported_options(image_options);
+    auto key = mapping_key(buffer, image_options);
+    auto i = mapping.find(key);
     if (i != mapping.end()) {
       return i->second;
     }
 
     auto handle = image_pool.alloc();
-    mapping[buffer] = handle;
+    mapping[key] = handle;
+    paths[handle] = buffer;
+    keys[handle] = key;
     auto& image = image_pool.get(handle);
     image.format = Image::Format::RGBA32F;
     image.pixels.f32 = make_array_view<float4>(calloc(1llu * dimensions.x * dimensions.y, sizeof(float4)), dimensions.x * dimensions.y);
     memcpy(image.pixels.f32.a, data, data_size);
     image.isize = dimensions;
     image.fsize = {float(dimensions.x), float(dimensions.y)};
+    image.options = image_options & ~Image::DelayLoad;
+    if (image.options & (Image::MipMapped | Image::BlockCompressed | Image::SpectralCoefficients)) {
+      build_levels(image, buffer, false);
+    }
+    if (image.options & Image::BuildSamplingTable) {
+      build_sampling_table(image);
+    }
     return handle;
   }
 
-  void perform_loading(uint32_t handle, Image& image) {
-    for (auto& cache : mapping) {
-      if (cache.second != handle)
-        continue;
-
-      load_image(image, cache.first.c_str());
-      if (image.options & Image::BuildSamplingTable) {
-        build_sampling_table(image);
-      }
+  void perform_loading(uint32_t handle, Image& image, bool background) {
+    const auto& path = paths[handle];
+    bool streamed = texture_cache.enabled() && ((image.options & Image::BuildSamplingTable) == 0);
+    if (streamed && open_cache_file(image, path)) {
       image.options &= ~Image::DelayLoad;
-      break;
+      return;
+    }
+
+    uint32_t requested_options = image.options & ~Image::DelayLoad;
+    load_image(image, path.c_str(), background);
+    if (image.options & (Image::MipMapped | Image::BlockCompressed | Image::SpectralCoefficients)) {
+      build_levels(image, path.c_str(), background);
     }
+    if (image.options & Image::BuildSamplingTable) {
+      build_sampling_table(image);
+    }
+    image.options &= ~Image::DelayLoad;
+
+    if (streamed && (image.storage_size() > TextureCache::kPageSize)) {
+      write_cache_file(image, path, requested_options);
+    }
+  }
+
+  /*
+   * streamed images are converted once to a cache file with the final storage (levels, tiles or blocks),
+   * the file is reused while the source file keeps its size and modification time
+   */
+  struct CacheFileHeader {
+    static constexpr uint32_t kMagic = 0x54585445u;
+    static constexpr uint32_t kVersion = 1u;
+    static constexpr uint64_t kDataOffset = 2048u;
+
+    uint32_t magic = kMagic;
+    uint32_t version = kVersion;
+    int64_t source_time = 0;
+    uint64_t source_size = 0;
+    uint64_t element_count = 0;
+    uint32_t requested_options = 0;
+    uint32_t options = 0;
+    Image::Format format = Image::Format::Undefined;
+    uint2 isize = {};
+    uint32_t level_count = 0;
+    uint32_t level_offset[Image::kMaxLevels] = {};
+    char source[1024] = {};
+  };
+  static_assert(sizeof(CacheFileHeader) <= CacheFileHeader::kDataOffset);
+
+  static std::filesystem::path cache_file_path(const std::string& path, uint32_t requested_options) {
+    char buffer[64] = {};
+    snprintf(buffer, sizeof(buffer), "%08x-%08x.etxtex", fnv1a32(path.c_str()), requested_options);
+    return std::filesystem::temp_directory_path() / "etx-texture-cache" / buffer;
+  }
+
+  static bool fill_source_info(const std::string& path, CacheFileHeader& header) {
+    std::error_code ec = {};
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+      return false;
+    }
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec || (path.size() >= sizeof(header.source))) {
+      return false;
+    }
+    header.source_time = static_cast<int64_t>(time.time_since_epoch().count());
+    header.source_size = static_cast<uint64_t>(size);
+    memcpy(header.source, path.c_str(), path.size());
+    return true;
+  }
+
+  bool open_cache_file(Image& image, const std::string& path) {
+    CacheFileHeader expected = {};
+    expected.requested_options = image.options & ~Image::DelayLoad;
+    if (fill_source_info(path, expected) == false) {
+      return false;
+    }
+
+    auto file_name = cache_file_path(path, expected.requested_options);
+    FILE* in_file = fopen(file_name.string().c_str(), "rb");
+    if (in_file == nullptr) {
+      return false;
+    }
+
+    CacheFileHeader header = {};
+    bool valid = fread(&header, sizeof(header), 1, in_file) == 1;
+    fclose(in_file);
+
+    valid = valid && (header.magic == expected.magic) && (header.version == expected.version);
+    valid = valid && (header.source_time == expected.source_time) && (header.source_size == expected.source_size);
+    valid = valid && (header.requested_options == expected.requested_options) && (strncmp(header.source, expected.source, sizeof(header.source)) == 0);
+    if (valid == false) {
+      return false;
+    }
+
+    image.format = header.format;
+    image.isize = header.isize;
+    image.fsize = {float(header.isize.x), float(header.isize.y)};
+    image.options = header.options;
+    image.level_count = header.level_count;
+    memcpy(image.level_offset, header.level_offset, sizeof(image.level_offset));
+    image.pixels.f32 = {};
+    image.pixels.f32.count = header.element_count;
+    attach_to_cache(image, file_name);
+    return true;
+  }
+
+  void write_cache_file(Image& image, const std::string& path, uint32_t requested_options) {
+    CacheFileHeader header = {};
+    header.requested_options = requested_options;
+    if (fill_source_info(path, header) == false) {
+      return;
+    }
+
+    header.element_count = image.pixels.f32.count;
+    header.options = image.options;
+    header.format = image.format;
+    header.isize = image.isize;
+    header.level_count = image.level_count;
+    memcpy(header.level_offset, image.level_offset, sizeof(header.level_offset));
+
+    auto file_name = cache_file_path(path, requested_options);
+    std::error_code ec = {};
+    std::filesystem::create_directories(file_name.parent_path(), ec);
+
+    FILE* out_file = fopen(file_name.string().c_str(), "wb");
+    if (out_file == nullptr) {
+      log::warning("Failed to write texture cache file %s, image stays resident", file_name.string().c_str());
+      return;
+    }
+
+    // header is written last, so an interrupted conversion leaves an invalid file
+    uint8_t zero[CacheFileHeader::kDataOffset] = {};
+    bool written = fwrite(zero, sizeof(zero), 1, out_file) == 1;
+    written = written && (fwrite(image.pixels.f32.a, image.storage_size(), 1, out_file) == 1);
+    written = written && (fseek(out_file, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, out_file) == 1);
+    fclose(out_file);
+
+    if (written == false) {
+      log::warning("Failed to write texture cache file %s, image stays resident", file_name.string().c_str());
+      return;
+    }
+
+    free(image.pixels.f32.a);
+    image.pixels.f32.a = nullptr;
+    attach_to_cache(image, file_name);
+  }
+
+  void attach_to_cache(Image& image, const std::filesystem::path& file_name) {
+    image.options |= Image::Streamed;
+    image.cache = &texture_cache;
+    image.cache_source = texture_cache.add_source(file_name.string().c_str(), CacheFileHeader::kDataOffset, image.storage_size());
   }
 
   void delay_load() {
@@ -88,12 +265,128 @@ struct ImagePoolImpl {
     scheduler.execute(object_count, [this, objects](uint32_t begin, uint32_t end, uint32_t) {
       for (uint32_t i = begin; i < end; ++i) {
         if (image_pool.alive(i) && (objects[i].options & Image::DelayLoad)) {
-          perform_loading(i, objects[i]);
+          perform_loading(i, objects[i], false);
         }
       }
     });
   }
 
+  void delay_load(uint32_t handle) {
+    auto& image = image_pool.get(handle);
+    if (image.options & Image::DelayLoad) {
+      perform_loading(handle, image, false);
+    }
+  }
+
+  /*
+   * images with sampling tables are used by emitters and camera right after loading, so they are decoded immediately;
+   * the rest get a single-pixel placeholder and are decoded by the task scheduler, until publish_loaded_images swaps them in
+   */
+  void delay_load_in_background() {
+    wait_for_background_loading();
+
+    std::vector<uint32_t> synchronous;
+    for (uint32_t i = 0, e = image_pool.latest_alive_index() + 1u; (image_pool.alive_objects_count() > 0) && (i < e); ++i) {
+      if ((image_pool.alive(i) == false) || ((image_pool.get(i).options & Image::DelayLoad) == 0)) {
+        continue;
+      }
+
+      auto& image = image_pool.get(i);
+      if (image.options & Image::BuildSamplingTable) {
+        synchronous.emplace_back(i);
+      } else {
+        background_requests.push_back({i, image.options});
+        make_placeholder(image);
+      }
+    }
+
+    scheduler.execute(static_cast<uint32_t>(synchronous.size()), [this, &synchronous](uint32_t begin, uint32_t end, uint32_t) {
+      for (uint32_t i = begin; i < end; ++i) {
+        perform_loading(synchronous[i], image_pool.get(synchronous[i]), false);
+      }
+    });
+
+    if (background_requests.empty()) {
+      return;
+    }
+
+    background_task = scheduler.schedule(static_cast<uint32_t>(background_requests.size()), [this](uint32_t begin, uint32_t end, uint32_t) {
+      for (uint32_t i = begin; i < end; ++i) {
+        const auto& request = background_requests[i];
+        Image image = {};
+        image.options = request.options;
+        perform_loading(request.handle, image, true);
+
+        std::scoped_lock lock(loaded_images_lock);
+        loaded_images.push_back({request.handle, image});
+      }
+    });
+  }
+
+  void make_placeholder(Image& image) {
+    constexpr uint32_t kDroppedOptions = Image::DelayLoad | Image::MipMapped | Image::BlockCompressed | Image::SpectralCoefficients;
+    image.options = (image.options & ~kDroppedOptions) | Image::Linear | Image::RepeatU | Image::RepeatV;
+    image.format = Image::Format::RGBA32F;
+    image.isize = {1u, 1u};
+    image.fsize = {1.0f, 1.0f};
+    image.pixels.f32 = make_array_view<float4>(calloc(1u, sizeof(float4)), 1u);
+    image.pixels.f32[0] = (image.options & Image::NormalMap) ? float4{0.5f, 0.5f, 1.0f, 1.0f} : float4{1.0f, 1.0f, 1.0f, 1.0f};
+  }
+
+  bool has_loaded_images() {
+    std::scoped_lock lock(loaded_images_lock);
+    return loaded_images.empty() == false;
+  }
+
+  /*
+   * should be called while nothing reads the images, replaced placeholders are released immediately
+   */
+  bool publish_loaded_images() {
+    std::vector<LoadedImage> ready;
+    {
+      std::scoped_lock lock(loaded_images_lock);
+      std::swap(ready, loaded_images);
+    }
+
+    for (auto& loaded : ready) {
+      auto& image = image_pool.get(loaded.handle);
+      free_image(image);
+      image = loaded.image;
+    }
+
+    if ((background_task.data != Task::InvalidHandle) && scheduler.completed(background_task) && (has_loaded_images() == false)) {
+      scheduler.wait(background_task);
+      background_task = {};
+      background_requests.clear();
+    }
+
+    return ready.empty() == false;
+  }
+
+  bool background_loading_in_progress() const {
+    return background_task.data != Task::InvalidHandle;
+  }
+
+  bool loading_in_background(uint32_t handle) const {
+    for (const auto& request : background_requests) {
+      if (request.handle == handle) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void wait_for_background_loading() {
+    if (background_task.data == Task::InvalidHandle) {
+      return;
+    }
+
+    scheduler.wait(background_task);
+    background_task = {};
+    background_requests.clear();
+    publish_loaded_images();
+  }
+
   const Image& get(uint32_t handle) const {
     return image_pool.get(handle);
   }
@@ -103,23 +396,41 @@ struct ImagePoolImpl {
       return;
     }
 
+    if (loading_in_background(handle)) {
+      wait_for_background_loading();
+    }
+
     free_image(image_pool.get(handle));
     image_pool.free(handle);
-
-    for (auto i = mapping.begin(), e = mapping.end(); i != e; ++i) {
-      if (i->second == handle) {
-        mapping.erase(i);
-        break;
-      }
-    }
+    mapping.erase(keys[handle]);
+    paths[handle].clear();
+    keys[handle].clear();
   }
 
   void remove_all() {
+    wait_for_background_loading();
     image_pool.free_all(std::bind(&ImagePoolImpl::free_image, this, std::placeholders::_1));
     mapping.clear();
+    for (auto& path : paths) {
+      path.clear();
+    }
+    for (auto& key : keys) {
+      key.clear();
+    }
   }
 
-  void load_image(Image& img, const char* file_name) {
+  /*
+   * tasks are scheduled from the main thread only, so images decoded in background are processed serially by their worker
+   */
+  void execute(bool background, uint32_t range, std::function<void(uint32_t, uint32_t, uint32_t)> func) {
+    if (background) {
+      scheduler.execute_linear(range, func);
+    } else {
+      scheduler.execute(range, func);
+    }
+  }
+
+  void load_image(Image& img, const char* file_name, bool background) {
     ETX_ASSERT(img.pixels.f32.a == nullptr);
     ETX_ASSERT(img.pixels.f32.count == 0);
     ETX_ASSERT(img.x_distributions.a == nullptr);
@@ -127,7 +438,7 @@ struct ImagePoolImpl {
     ETX_ASSERT(img.y_distribution.values.a == nullptr);
 
     std::vector<uint8_t> source_data = {};
-    img.format = load_data(file_name, source_data, img.isize);
+    img.format = load_data(file_name, source_data, img.isize, background);
 
     if ((img.format == Image::Format::Undefined) || (img.isize.x * img.isize.y == 0)) {
       source_data.resize(sizeof(float4));
@@ -179,6 +490,231 @@ struct ImagePoolImpl {
     }
   }
 
+  /*
+   * single-channel images go to BC4, normal maps to BC5, HDR images to BC6H and the rest to BC1,
+   * images with alpha channel are not compressed, since alpha testing needs it,
+   * HDR images with values beyond the half float range (e.g. the sun in environment maps) are not compressed either
+   */
+  Image::Format select_block_format(const Image& img, const char* name) {
+    if (img.options & Image::HasAlphaChannel) {
+      return Image::Format::Undefined;
+    }
+
+    if (img.options & Image::NormalMap) {
+      return Image::Format::BC5;
+    }
+
+    if (img.format == Image::Format::RGBA32F) {
+      float max_value = 0.0f;
+      for (uint32_t i = 0, e = img.isize.x * img.isize.y; i < e; ++i) {
+        float4 p = img.pixel(i);
+        max_value = max(max_value, max(p.x, max(p.y, p.z)));
+      }
+      if (max_value > bcn::kMaxBC6HValue) {
+        log::warning("Image %s has values up to %g, beyond the BC6H range, it is stored uncompressed", name, max_value);
+        return Image::Format::Undefined;
+      }
+      return Image::Format::BC6H;
+    }
+
+    for (uint32_t i = 0, e = img.isize.x * img.isize.y; i < e; ++i) {
+      float4 p = img.pixel(i);
+      if ((p.x != p.y) || (p.y != p.z)) {
+        return Image::Format::BC1;
+      }
+    }
+    return Image::Format::BC4;
+  }
+
+  /*
+   * replaces row-major pixels with box-filtered mip levels (if requested) stored either in tiles (see Image::tiled_index)
+   * or in compressed blocks (see Image::block_index);
+   * levels of reflectance images are converted to spectral coefficients after filtering, these are not compressed
+   */
+  void build_levels(Image& img, const char* name, bool background) {
+    ETX_ASSERT(img.level_count == 0);
+
+    if ((img.options & Image::SpectralCoefficients) && (is_reflectance(img) == false)) {
+      img.options &= ~Image::SpectralCoefficients;
+    }
+
+    const bool coefficients = (img.options & Image::SpectralCoefficients) == Image::SpectralCoefficients;
+    auto block_format = ((img.options & Image::BlockCompressed) && (coefficients == false)) ? select_block_format(img, name) : Image::Format::Undefined;
+    if (((img.options & Image::MipMapped) == 0) && (block_format == Image::Format::Undefined) && (coefficients == false)) {
+      return;
+    }
+
+    std::vector<std::vector<float4>> levels(1);
+    levels[0].resize(1llu * img.isize.x * img.isize.y);
+    for (uint32_t i = 0, e = img.isize.x * img.isize.y; i < e; ++i) {
+      levels[0][i] = img.pixel(i);
+    }
+
+    uint2 size = img.isize;
+    while ((img.options & Image::MipMapped) && ((size.x > 1u) || (size.y > 1u)) && (levels.size() < Image::kMaxLevels)) {
+      uint2 next_size = {max(1u, size.x / 2u), max(1u, size.y / 2u)};
+      const auto& source = levels.back();
+      std::vector<float4> target(1llu * next_size.x * next_size.y);
+      execute(background, next_size.y, [&source, &target, size, next_size](uint32_t begin, uint32_t end, uint32_t) {
+        for (uint32_t y = begin; y < end; ++y) {
+          uint32_t y0 = min(2u * y, size.y - 1u);
+          uint32_t y1 = min(2u * y + 1u, size.y - 1u);
+          for (uint32_t x = 0; x < next_size.x; ++x) {
+            uint32_t x0 = min(2u * x, size.x - 1u);
+            uint32_t x1 = min(2u * x + 1u, size.x - 1u);
+            target[x + 1llu * y * next_size.x] = 0.25f * (source[x0 + 1llu * y0 * size.x] + source[x1 + 1llu * y0 * size.x] +  //
+                                                           source[x0 + 1llu * y1 * size.x] + source[x1 + 1llu * y1 * size.x]);
+          }
+        }
+      });
+      levels.emplace_back(std::move(target));
+      size = next_size;
+    }
+
+    if (coefficients) {
+      convert_to_coefficients(levels, background);
+      img.format = Image::Format::RGBA32F;
+    }
+
+    if (block_format != Image::Format::Undefined) {
+      store_blocks(img, levels, block_format, background);
+    } else if (img.options & Image::MipMapped) {
+      store_tiles(img, levels);
+    } else {
+      free(img.pixels.f32.a);
+      img.pixels.f32 = make_array_view<float4>(calloc(levels[0].size(), sizeof(float4)), levels[0].size());
+      memcpy(img.pixels.f32.a, levels[0].data(), levels[0].size() * sizeof(float4));
+    }
+  }
+
+  static bool is_reflectance(const Image& img) {
+    for (uint32_t i = 0, e = img.isize.x * img.isize.y; i < e; ++i) {
+      float4 p = img.pixel(i);
+      if ((p.x > 1.0f) || (p.y > 1.0f) || (p.z > 1.0f)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static const float3* coefficient_table() {
+    static std::vector<float3> table = []() {
+      Spectrums spectrums = {};
+      rgb::init_spectrums(spectrums);
+      std::vector<float3> result(1llu * rgb::kCoefficientTableSize * rgb::kCoefficientTableSize * rgb::kCoefficientTableSize);
+      rgb::build_coefficient_table(spectrums.rgb_reflection, result.data());
+      return result;
+    }();
+    return table.data();
+  }
+
+  void convert_to_coefficients(std::vector<std::vector<float4>>& levels, bool background) {
+    const float3* table = coefficient_table();
+    for (auto& level : levels) {
+      execute(background, static_cast<uint32_t>(level.size()), [&level, table](uint32_t begin, uint32_t end, uint32_t) {
+        for (uint32_t i = begin; i < end; ++i) {
+          float3 c = rgb::lookup_coefficients(table, {level[i].x, level[i].y, level[i].z});
+          level[i] = {c.x, c.y, c.z, level[i].w};
+        }
+      });
+    }
+  }
+
+  void store_tiles(Image& img, const std::vector<std::vector<float4>>& levels) {
+    uint32_t total_pixel_count = 0;
+    img.level_count = static_cast<uint32_t>(levels.size());
+    for (uint32_t l = 0; l < img.level_count; ++l) {
+      img.level_offset[l] = total_pixel_count;
+      total_pixel_count += Image::tiled_level_pixel_count(img.level_size(l));
+    }
+
+    uint64_t pixel_size = (img.format == Image::Format::RGBA8) ? sizeof(ubyte4) : sizeof(float4);
+    void* tiled_pixels = calloc(total_pixel_count, pixel_size);
+    for (uint32_t l = 0; l < img.level_count; ++l) {
+      uint2 level_size = img.level_size(l);
+      for (uint32_t y = 0; y < level_size.y; ++y) {
+        for (uint32_t x = 0; x < level_size.x; ++x) {
+          uint32_t i = img.tiled_index(x, y, l);
+          const float4& value = levels[l][x + 1llu * y * level_size.x];
+          if (img.format == Image::Format::RGBA8) {
+            constexpr float kRounding = 0.5f / 255.0f;
+            reinterpret_cast<ubyte4*>(tiled_pixels)[i] = to_ubyte4(value + float4{kRounding, kRounding, kRounding, kRounding});
+          } else {
+            reinterpret_cast<float4*>(tiled_pixels)[i] = value;
+          }
+        }
+      }
+    }
+
+    free(img.pixels.f32.a);
+    if (img.format == Image::Format::RGBA8) {
+      img.pixels.u8 = make_array_view<ubyte4>(tiled_pixels, total_pixel_count);
+    } else {
+      img.pixels.f32 = make_array_view<float4>(tiled_pixels, total_pixel_count);
+    }
+  }
+
+  void store_blocks(Image& img, const std::vector<std::vector<float4>>& levels, Image::Format block_format, bool background) {
+    uint32_t total_word_count = 0;
+    img.level_count = static_cast<uint32_t>(levels.size());
+    for (uint32_t l = 0; l < img.level_count; ++l) {
+      img.level_offset[l] = total_word_count;
+      total_word_count += Image::block_level_word_count(img.level_size(l), block_format);
+    }
+
+    const uint32_t word_count = Image::block_word_count(block_format);
+    auto blocks = reinterpret_cast<uint64_t*>(calloc(total_word_count, sizeof(uint64_t)));
+    for (uint32_t l = 0; l < img.level_count; ++l) {
+      const uint2 level_size = img.level_size(l);
+      const uint32_t blocks_x = (level_size.x + bcn::kBlockSize - 1u) / bcn::kBlockSize;
+      const uint32_t blocks_y = (level_size.y + bcn::kBlockSize - 1u) / bcn::kBlockSize;
+      const auto& source = levels[l];
+      uint64_t* target = blocks + img.level_offset[l];
+      execute(background, blocks_x * blocks_y, [&source, target, level_size, blocks_x, word_count, block_format](uint32_t begin, uint32_t end, uint32_t) {
+        for (uint32_t b = begin; b < end; ++b) {
+          uint32_t bx = (b % blocks_x) * bcn::kBlockSize;
+          uint32_t by = (b / blocks_x) * bcn::kBlockSize;
+
+          float4 texels[bcn::kBlockSize * bcn::kBlockSize] = {};
+          for (uint32_t y = 0; y < bcn::kBlockSize; ++y) {
+            for (uint32_t x = 0; x < bcn::kBlockSize; ++x) {
+              uint32_t sx = min(bx + x, level_size.x - 1u);
+              uint32_t sy = min(by + y, level_size.y - 1u);
+              texels[x + y * bcn::kBlockSize] = source[sx + 1llu * sy * level_size.x];
+            }
+          }
+
+          uint64_t* block = target + 1llu * b * word_count;
+          switch (block_format) {
+            case Image::Format::BC1:
+              block[0] = bcn::encode_bc1(texels);
+              break;
+            case Image::Format::BC4: {
+              float values[bcn::kBlockSize * bcn::kBlockSize] = {};
+              for (uint32_t i = 0; i < bcn::kBlockSize * bcn::kBlockSize; ++i) {
+                values[i] = texels[i].x;
+              }
+              block[0] = bcn::encode_bc4(values);
+              break;
+            }
+            case Image::Format::BC5:
+              bcn::encode_bc5(texels, block);
+              break;
+            case Image::Format::BC6H:
+              bcn::encode_bc6h(texels, block);
+              break;
+            default:
+              break;
+          }
+        }
+      });
+    }
+
+    free(img.pixels.f32.a);
+    img.format = block_format;
+    img.pixels.blocks = make_array_view<uint64_t>(blocks, total_word_count);
+  }
+
   void build_sampling_table(Image& img) {
     bool uniform_sampling = (img.options & Image::UniformSamplingTable) == Image::UniformSamplingTable;
     DistributionBuilder y_dist(img.y_distribution, img.isize.y);
@@ -212,9 +748,62 @@ struct ImagePoolImpl {
     y_dist.finalize();
 
     img.normalization = total_weight / (img.fsize.x * img.fsize.y);
+
+#if (ETX_DEBUG || ETX_FORCE_VALIDATION)
+    validate_sampling_table(img);
+#endif
+  }
+
+  /*
+   * every pixel is split into four sub-pixels of equal sampling probability, a sample taken from the middle
+   * of each quarter should land in the middle of the matching quarter of the pixel with density `sampling_pdf`;
+   * large images are checked on a strided subset of rows and columns, the last ones are always included
+   */
+  void validate_sampling_table(const Image& img) {
+    constexpr float kMinValidatedMass = 1.0e-5f;
+    constexpr float kOffsets[2] = {0.25f, 0.75f};
+    constexpr uint32_t kMaxValidatedLines = 64u;
+
+    uint2 step = {max(1u, img.isize.x / kMaxValidatedLines), max(1u, img.isize.y / kMaxValidatedLines)};
+    auto next = [](uint32_t i, uint32_t step, uint32_t count) {
+      return (i + 1u < count) ? min(i + step, count - 1u) : count;
+    };
+
+    uint64_t mismatches = 0;
+    for (uint32_t y = 0; y < img.isize.y; y = next(y, step.y, img.isize.y)) {
+      const auto& y_entry = img.y_distribution.values[y];
+      if (y_entry.pdf < kMinValidatedMass)
+        continue;
+
+      const auto& x_distribution = img.x_distributions[y];
+      for (uint32_t x = 0; x < img.isize.x; x = next(x, step.x, img.isize.x)) {
+        const auto& x_entry = x_distribution.values[x];
+        if (x_entry.pdf < kMinValidatedMass)
+          continue;
+
+        float expected_pdf = y_entry.pdf * x_entry.pdf * (img.fsize.x * img.fsize.y);
+        for (float oy : kOffsets) {
+          for (float ox : kOffsets) {
+            uint2 location = {};
+            float2 uv = img.sample({x_entry.cdf + ox * x_entry.pdf, y_entry.cdf + oy * y_entry.pdf}, location);
+            float2 offset = uv * img.fsize - float2{float(x), float(y)};
+            bool matches = (location.x == x) && (location.y == y) && (fabsf(offset.x - ox) < 0.125f) && (fabsf(offset.y - oy) < 0.125f) &&
+                           (fabsf(img.sampling_pdf(uv) - expected_pdf) <= 1.0e-3f * expected_pdf);
+            mismatches += matches ? 0u : 1u;
+          }
+        }
+      }
+    }
+
+    if (mismatches > 0) {
+      log::warning("Sampling table of %u x %u image does not match its pdf in %llu samples", img.isize.x, img.isize.y, mismatches);
+    }
   }
 
   void free_image(Image& img) {
+    if (img.options & Image::Streamed) {
+      texture_cache.remove_source(img.cache_source);
+    }
     free(img.pixels.f32.a);
     for (uint64_t i = 0; (img.x_distributions.a != nullptr) && (i < img.y_distribution.values.count); ++i) {
       free(img.x_distributions[i].values.a);
@@ -224,7 +813,7 @@ struct ImagePoolImpl {
     img = {};
   }
 
-  Image::Format load_data(const char* source, std::vector<uint8_t>& data, uint2& dimensions) {
+  Image::Format load_data(const char* source, std::vector<uint8_t>& data, uint2& dimensions, bool background) {
     if (source == nullptr)
       return Image::Format::Undefined;
 
@@ -247,7 +836,7 @@ struct ImagePoolImpl {
         return Image::Format::Undefined;
       }
 
-      scheduler.execute(4 * w * h, [&rgba_data](uint32_t begin, uint32_t end, uint32_t) {
+      execute(background, 4 * w * h, [&rgba_data](uint32_t begin, uint32_t end, uint32_t) {
         for (uint32_t i = begin; i < end; ++i) {
           if (std::isinf(rgba_data[i])) {
             rgba_data[i] = 65504.0f;  // max value in half-float
@@ -340,9 +929,26 @@ struct ImagePoolImpl {
     return Image::Format::RGBA8;
   }
 
+  struct BackgroundRequest {
+    uint32_t handle = kInvalidIndex;
+    uint32_t options = 0;
+  };
+
+  struct LoadedImage {
+    uint32_t handle = kInvalidIndex;
+    Image image = {};
+  };
+
   TaskScheduler& scheduler;
+  TextureCache texture_cache;
   ObjectIndexPool<Image> image_pool;
   std::unordered_map<std::string, uint32_t> mapping;
+  std::vector<std::string> paths;
+  std::vector<std::string> keys;
+  std::vector<BackgroundRequest> background_requests;
+  std::vector<LoadedImage> loaded_images;
+  std::mutex loaded_images_lock;
+  Task::Handle background_task = {};
   Image empty;
 };
 
@@ -368,8 +974,8 @@ uint32_t ImagePool::add_from_file(const std::string& path, uint32_t image_option
   return _private->add_from_file(path, image_options);
 }
 
-uint32_t ImagePool::add_from_data(const float4* data, const uint2& dimensions) {
-  return _private->add_from_data(data, dimensions);
+uint32_t ImagePool::add_from_data(const float4* data, const uint2& dimensions, uint32_t image_options) {
+  return _private->add_from_data(data, dimensions, image_options);
 }
 
 const Image& ImagePool::get(uint32_t handle) {
@@ -388,6 +994,10 @@ Image* ImagePool::as_array() {
   return _private->image_pool.alive_objects_count() > 0 ? _private->image_pool.data() : nullptr;
 }
 
+uint32_t ImagePool::free_slot_count() const {
+  return _private->image_pool.capacity() - _private->image_pool.alive_objects_count();
+}
+
 uint64_t ImagePool::array_size() {
   return _private->image_pool.alive_objects_count() > 0 ? 1llu + _private->image_pool.latest_alive_index() : 0;
 }
@@ -477,4 +1087,29 @@ void ImagePool::load_images() {
   _private->delay_load();
 }
 
+void ImagePool::set_texture_cache_budget(uint64_t budget) {
+  ETX_ASSERT(_private->image_pool.alive_objects_count() == 0);
+  _private->texture_cache.init(budget);
+}
+
+void ImagePool::load_image(uint32_t handle) {
+  _private->delay_load(handle);
+}
+
+void ImagePool::load_images_in_background() {
+  _private->delay_load_in_background();
+}
+
+bool ImagePool::has_loaded_images() {
+  return _private->has_loaded_images();
+}
+
+bool ImagePool::publish_loaded_images() {
+  return _private->publish_loaded_images();
+}
+
+bool ImagePool::background_loading_in_progress() const {
+  return _private->background_loading_in_progress();
+}
+
 }  // namespace etx
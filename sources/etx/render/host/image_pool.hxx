@@ -16,19 +16,39 @@ struct ImagePool {
   void init(uint32_t capacity);
   void cleanup();
 
+  /*
+   * with non-zero budget (in bytes) images without sampling tables are converted to cache files after loading
+   * and their pixels are read through the texture cache, should be set while the pool is empty
+   */
+  void set_texture_cache_budget(uint64_t budget);
+
   uint32_t add_from_file(const std::string& path, uint32_t image_options);
-  uint32_t add_from_data(const float4* data, const uint2& dimensions);
+  uint32_t add_from_data(const float4* data, const uint2& dimensions, uint32_t image_options);
   void remove(uint32_t handle);
   void remove_all();
 
   void load_images();
+  void load_image(uint32_t handle);
+
+  /*
+   * images without sampling tables are replaced with constant placeholders and decoded by the scheduler,
+   * has_loaded_images reports decoded images, publish_loaded_images swaps them in and should be called
+   * while no integrator reads the images
+   */
+  void load_images_in_background();
+  bool has_loaded_images();
+  bool publish_loaded_images();
+  bool background_loading_in_progress() const;
 
   const Image& get(uint32_t);
 
+  // number of images which could be added before the pool is exhausted
+  uint32_t free_slot_count() const;
+
   Image* as_array();
   uint64_t array_size();
 
-  ETX_DECLARE_PIMPL(ImagePool, 256);
+  ETX_DECLARE_PIMPL(ImagePool, 1024);
 };
 
 }  // namespace etx
@@ -11,6 +11,15 @@
 namespace etx {
 
 struct MediumPoolImpl {
+  // volumes larger than this are stored as sparse bricks
+  static constexpr uint64_t kDenseVoxelLimit = 256llu * 256llu * 256llu;
+
+  struct DensityGrid {
+    std::vector<float> density;
+    std::vector<uint32_t> bricks;
+    uint3 dimensions = {};
+  };
+
   void init(uint32_t capacity) {
     medium_pool.init(capacity);
   }
@@ -38,17 +47,25 @@ struct MediumPoolImpl {
 
     if (strlen(volume_file) > 0) {
       float max_density = 0.0f;
-      auto density = load_density_grid(volume_file, medium.dimensions);
-      for (auto f : density) {
+      DensityGrid grid = {};
+      load_density_grid(volume_file, grid);
+      medium.dimensions = grid.dimensions;
+      for (auto f : grid.density) {
         max_density = max(max_density, f);
       }
       if (max_density > 0.0f) {
-        for (auto& f : density) {
+        for (auto& f : grid.density) {
           f /= max_density;
         }
-        medium.density.count = density.size();
+        medium.density.count = grid.density.size();
         medium.density.a = reinterpret_cast<float*>(malloc(medium.density.count * sizeof(float)));
-        memcpy(medium.density.a, density.data(), sizeof(float) * medium.density.count);
+        memcpy(medium.density.a, grid.density.data(), sizeof(float) * medium.density.count);
+        if (grid.bricks.empty() == false) {
+          medium.bricks.count = grid.bricks.size();
+          medium.bricks.a = reinterpret_cast<uint32_t*>(malloc(medium.bricks.count * sizeof(uint32_t)));
+          memcpy(medium.bricks.a, grid.bricks.data(), sizeof(uint32_t) * medium.bricks.count);
+        }
+        build_majorant_grid(medium);
         medium.cls = Medium::Class::Heterogeneous;
       } else {
         medium.cls = Medium::Class::Homogeneous;
@@ -92,37 +109,99 @@ struct MediumPoolImpl {
     if (m.density.count > 0) {
       free(m.density.a);
     }
+    if (m.bricks.count > 0) {
+      free(m.bricks.a);
+    }
+    if (m.majorants.count > 0) {
+      free(m.majorants.a);
+    }
     m = {};
   }
 
-  std::vector<float> load_density_grid(const char* file_name, uint3& d) {
-    std::vector<float> density;
+  void build_majorant_grid(Medium& medium) {
+    const uint3& d = medium.dimensions;
+    constexpr uint32_t cs = Medium::kMajorantCellSize;
+
+    uint3 md = {(d.x + cs - 1u) / cs, (d.y + cs - 1u) / cs, (d.z + cs - 1u) / cs};
+    medium.majorant_dimensions = md;
+    medium.majorants.count = 1llu * md.x * md.y * md.z;
+    medium.majorants.a = reinterpret_cast<float2*>(malloc(medium.majorants.count * sizeof(float2)));
+
+    uint64_t empty_cells = 0;
+    for (uint32_t cz = 0; cz < md.z; ++cz) {
+      for (uint32_t cy = 0; cy < md.y; ++cy) {
+        for (uint32_t cx = 0; cx < md.x; ++cx) {
+          if ((medium.bricks.count > 0) && (has_bricks_around(medium, cx, cy, cz) == false)) {
+            medium.majorants[cx + 1llu * cy * md.x + 1llu * cz * md.x * md.y] = {};
+            empty_cells += 1u;
+            continue;
+          }
 
+          // trilinear lookup reaches one voxel beyond the cell on each side
+          uint32_t x0 = (cx * cs > 0u) ? cx * cs - 1u : 0u;
+          uint32_t y0 = (cy * cs > 0u) ? cy * cs - 1u : 0u;
+          uint32_t z0 = (cz * cs > 0u) ? cz * cs - 1u : 0u;
+          uint32_t x1 = std::min(d.x, (cx + 1u) * cs + 1u);
+          uint32_t y1 = std::min(d.y, (cy + 1u) * cs + 1u);
+          uint32_t z1 = std::min(d.z, (cz + 1u) * cs + 1u);
+
+          float2 bounds = {kMaxFloat, 0.0f};
+          for (uint32_t z = z0; z < z1; ++z) {
+            for (uint32_t y = y0; y < y1; ++y) {
+              for (uint32_t x = x0; x < x1; ++x) {
+                float val = medium.voxel(x, y, z);
+                bounds.x = std::min(bounds.x, val);
+                bounds.y = std::max(bounds.y, val);
+              }
+            }
+          }
+          bounds.x = std::min(bounds.x, bounds.y);
+          empty_cells += (bounds.y > 0.0f) ? 0u : 1u;
+          medium.majorants[cx + 1llu * cy * md.x + 1llu * cz * md.x * md.y] = bounds;
+        }
+      }
+    }
+
+    log::info("Majorant grid: [%u %u %u], %llu of %llu cells are empty", md.x, md.y, md.z, empty_cells, medium.majorants.count);
+  }
+
+  bool has_bricks_around(const Medium& medium, uint32_t cx, uint32_t cy, uint32_t cz) {
+    const uint3& md = medium.majorant_dimensions;
+    for (uint32_t z = (cz > 0u ? cz - 1u : 0u), ze = std::min(md.z, cz + 2u); z < ze; ++z) {
+      for (uint32_t y = (cy > 0u ? cy - 1u : 0u), ye = std::min(md.y, cy + 2u); y < ye; ++y) {
+        for (uint32_t x = (cx > 0u ? cx - 1u : 0u), xe = std::min(md.x, cx + 2u); x < xe; ++x) {
+          if (medium.bricks[x + 1llu * y * md.x + 1llu * z * md.x * md.y] != kInvalidIndex)
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void load_density_grid(const char* file_name, DensityGrid& grid) {
     const char* ext = get_file_ext(file_name);
     if (_stricmp(ext, ".nvdb") == 0) {
-      load_nvdb(file_name, density, d);
+      load_nvdb(file_name, grid);
     } else {
       log::error("Only NVDB volumetric data format is supported at the moment");
     }
-
-    return density;
   }
 
-  void load_nvdb(const char* file_name, std::vector<float>& density, uint3& d) {
-    d = {};
-    density.clear();
+  void load_nvdb(const char* file_name, DensityGrid& grid) {
+    grid = {};
 
     auto handle = nanovdb::io::readGrid(file_name);
-    auto grid = handle.grid<float>(0);
-    if (grid == nullptr) {
+    auto nvdb_grid = handle.grid<float>(0);
+    if (nvdb_grid == nullptr) {
       return;
     }
 
-    auto accessor = grid->getAccessor();
-    const auto& grid_bbox = grid->indexBBox();
+    auto accessor = nvdb_grid->getAccessor();
+    const auto& grid_bbox = nvdb_grid->indexBBox();
     const auto& min = grid_bbox.min();
     const auto& max = grid_bbox.max();
     auto dim = max - min;
+    uint3& d = grid.dimensions;
     d.x = static_cast<uint32_t>(dim.x());
     d.y = static_cast<uint32_t>(dim.y());
     d.z = static_cast<uint32_t>(dim.z());
@@ -134,36 +213,86 @@ struct MediumPoolImpl {
       grid_bbox.max().x(), grid_bbox.max().y(), grid_bbox.max().z(),                         //
       d.x, d.y, d.z, fd.x, fd.y, fd.z);
 
-    density.resize(1llu * d.x * d.y * d.z, 0.0f);
-
     float min_val = kMaxFloat;
     float max_val = -kMaxFloat;
     double avg_val = 0.0f;
     uint64_t value_count = 0;
-    nanovdb::Coord c = {};
-    for (c.z() = min.z(); c.z() < max.z(); ++c.z()) {
-      for (c.y() = min.y(); c.y() < max.y(); ++c.y()) {
-        for (c.x() = min.x(); c.x() < max.x(); ++c.x()) {
-          float val = accessor.getValue(c);
-          if (val > 0.0f) {
-            min_val = std::min(min_val, val);
-            max_val = std::max(max_val, val);
+
+    auto read_voxel = [&](const nanovdb::Coord& c, float* target) {
+      float val = accessor.getValue(c);
+      if (val > 0.0f) {
+        min_val = std::min(min_val, val);
+        max_val = std::max(max_val, val);
+        *target = val;
+        value_count += 1u;
+        avg_val += val;
+      }
+    };
+
+    if (1llu * d.x * d.y * d.z <= kDenseVoxelLimit) {
+      grid.density.resize(1llu * d.x * d.y * d.z, 0.0f);
+
+      nanovdb::Coord c = {};
+      for (c.z() = min.z(); c.z() < max.z(); ++c.z()) {
+        for (c.y() = min.y(); c.y() < max.y(); ++c.y()) {
+          for (c.x() = min.x(); c.x() < max.x(); ++c.x()) {
             nanovdb::Coord cr = c - min;
-            density[cr.x() + 1llu * cr.y() * d.x + 1llu * cr.z() * d.x * d.y] = val;
-            value_count += 1u;
-            avg_val += val;
+            read_voxel(c, grid.density.data() + cr.x() + 1llu * cr.y() * d.x + 1llu * cr.z() * d.x * d.y);
           }
         }
       }
+    } else {
+      constexpr int32_t cs = int32_t(Medium::kMajorantCellSize);
+      uint3 cells = {(d.x + cs - 1u) / cs, (d.y + cs - 1u) / cs, (d.z + cs - 1u) / cs};
+      grid.bricks.resize(1llu * cells.x * cells.y * cells.z, kInvalidIndex);
+
+      for (uint32_t cz = 0; cz < cells.z; ++cz) {
+        for (uint32_t cy = 0; cy < cells.y; ++cy) {
+          for (uint32_t cx = 0; cx < cells.x; ++cx) {
+            nanovdb::Coord c0 = min + nanovdb::Coord(cx * cs, cy * cs, cz * cs);
+            nanovdb::Coord c1 = nanovdb::Coord(std::min(c0.x() + cs, max.x()), std::min(c0.y() + cs, max.y()), std::min(c0.z() + cs, max.z()));
+
+            // every NanoVDB leaf or tile overlapping the brick contains at least one of its corners
+            bool occupied = false;
+            for (uint32_t i = 0; (occupied == false) && (i < 8u); ++i) {
+              nanovdb::Coord corner = {(i & 1u) ? c1.x() - 1 : c0.x(), (i & 2u) ? c1.y() - 1 : c0.y(), (i & 4u) ? c1.z() - 1 : c0.z()};
+              occupied = (accessor.probeLeaf(corner) != nullptr) || (accessor.getValue(corner) > 0.0f);
+            }
+            if (occupied == false)
+              continue;
+
+            uint64_t brick_value_count = value_count;
+            uint64_t brick_offset = grid.density.size();
+            grid.density.resize(brick_offset + Medium::kBrickVoxelCount, 0.0f);
+
+            nanovdb::Coord c = {};
+            for (c.z() = c0.z(); c.z() < c1.z(); ++c.z()) {
+              for (c.y() = c0.y(); c.y() < c1.y(); ++c.y()) {
+                for (c.x() = c0.x(); c.x() < c1.x(); ++c.x()) {
+                  nanovdb::Coord cr = c - c0;
+                  read_voxel(c, grid.density.data() + brick_offset + cr.x() + cr.y() * cs + cr.z() * cs * cs);
+                }
+              }
+            }
+
+            if (value_count > brick_value_count) {
+              grid.bricks[cx + 1llu * cy * cells.x + 1llu * cz * cells.x * cells.y] = static_cast<uint32_t>(brick_offset / Medium::kBrickVoxelCount);
+            } else {
+              grid.density.resize(brick_offset);
+            }
+          }
+        }
+      }
+
+      log::info("Sparse density grid: %llu of %llu bricks allocated (%.2f Mb)", grid.density.size() / Medium::kBrickVoxelCount, grid.bricks.size(),
+        double(grid.density.size() * sizeof(float) + grid.bricks.size() * sizeof(uint32_t)) / (1024.0 * 1024.0));
     }
     avg_val /= float(value_count);
 
     log::info("Density values range: %.5f ... %.5f ... %.5f", min_val, avg_val, max_val);
     if ((value_count == 0) || (min_val == kMaxFloat) || ((max_val - min_val) <= kEpsilon) || (avg_val <= kEpsilon)) {
       log::warning("Density is zero or too small, clearing...");
-      d = {};
-      density.clear();
-      density.shrink_to_fit();
+      grid = {};
     }
   }
 
@@ -94,6 +94,10 @@ struct ObjectIndexPool {
     return result;
   }
 
+  uint32_t capacity() const {
+    return _capacity;
+  }
+
   uint32_t latest_alive_index() const {
     uint32_t result = 0;
     for (uint32_t i = 0; i < _capacity; ++i) {
@@ -9,11 +9,16 @@
 #include <etx/render/host/image_pool.hxx>
 #include <etx/render/host/medium_pool.hxx>
 #include <etx/render/host/distribution_builder.hxx>
+#include <etx/render/host/atmosphere.hxx>
+#include <etx/render/host/bsdf_tables.hxx>
 
 #include <vector>
 #include <unordered_map>
 #include <string>
 #include <set>
+#include <map>
+#include <tuple>
+#include <algorithm>
 
 #include <mikktspace.h>
 #include <tiny_gltf.hxx>
@@ -68,6 +73,10 @@ Pointer<Spectrums> shared_spectrums() {
   return spectrums();
 }
 
+inline Material::MultipleScattering multiple_scattering_from_string(const char* s) {
+  return (strcmp(s, "compensation") == 0) ? Material::MultipleScattering::EnergyCompensation : Material::MultipleScattering::RandomWalk;
+}
+
 inline bool value_is_correct(float t) {
   return !std::isnan(t) && !std::isinf(t);
 }
@@ -99,10 +108,37 @@ struct SceneRepresentationImpl {
   SceneRepresentation::MaterialMapping material_mapping;
   uint32_t camera_medium_index = kInvalidIndex;
   uint32_t camera_lens_shape_image_index = kInvalidIndex;
+  Material::MultipleScattering multiple_scattering = Material::MultipleScattering::RandomWalk;
+  std::vector<float4> microfacet_energy_table;
+  std::vector<float4> thinfilm_table;
+  std::map<std::vector<float>, uint32_t> thinfilm_tables;
+  std::vector<float4> subsurface_profile_table;
 
   Scene scene;
   bool loaded = false;
 
+  struct AtmosphereSky {
+    Atmosphere::Parameters parameters = {};
+    float altitude = 1.0f;
+    uint2 dimensions = {512u, 256u};
+    uint32_t sun_emitter = kInvalidIndex;
+    uint32_t sky_emitter = kInvalidIndex;
+  };
+
+  /*
+   * baked sky survives scene reloading, it is evaluated again only if sun or atmosphere were changed
+   */
+  struct AtmosphereBake {
+    AtmosphereSky sky = {};
+    float3 sun_direction = {};
+    SpectralDistribution sun_emission = {};
+    std::vector<float4> image;
+  };
+
+  Atmosphere atmosphere;
+  AtmosphereSky atmosphere_sky;
+  AtmosphereBake atmosphere_bake;
+
   uint32_t add_image(const char* path, uint32_t options) {
     std::string id = path ? path : ("image-" + std::to_string(images.array_size()));
     return images.add_from_file(id, options | Image::DelayLoad);
@@ -115,7 +151,7 @@ struct SceneRepresentationImpl {
       return i->second;
     }
     uint32_t index = static_cast<uint32_t>(materials.size());
-    materials.emplace_back();
+    materials.emplace_back().multiple_scattering = multiple_scattering;
     material_mapping[id] = index;
     return index;
   }
@@ -149,6 +185,9 @@ struct SceneRepresentationImpl {
     triangle_to_emitter.clear();
     camera_medium_index = kInvalidIndex;
     camera_lens_shape_image_index = kInvalidIndex;
+    multiple_scattering = Material::MultipleScattering::RandomWalk;
+    thinfilm_tables.clear();
+    atmosphere_sky = {};
 
     images.remove_all();
     mediums.remove_all();
@@ -164,10 +203,231 @@ struct SceneRepresentationImpl {
     loaded = false;
   }
 
+  bool atmosphere_bake_valid(const Emitter& sun) const {
+    const auto& baked = atmosphere_bake;
+    const auto& sky = atmosphere_sky;
+    const auto& a = sky.parameters;
+    const auto& b = baked.sky.parameters;
+
+    bool same_parameters = (a.rayleigh == b.rayleigh) && (a.mie == b.mie) && (a.ozone == b.ozone) && (a.anisotropy == b.anisotropy) &&
+                           (a.multiple_scattering == b.multiple_scattering) && (sky.altitude == baked.sky.altitude) && (sky.dimensions == baked.sky.dimensions);
+
+    bool same_sun = (sun.direction == baked.sun_direction) && (sun.emission.spectrum.count == baked.sun_emission.count);
+    for (uint32_t i = 0; same_sun && (i < sun.emission.spectrum.count); ++i) {
+      same_sun = (sun.emission.spectrum.power[i] == baked.sun_emission.power[i]);
+    }
+
+    return (baked.image.empty() == false) && same_parameters && same_sun;
+  }
+
+  bool bake_atmosphere() {
+    if ((atmosphere_sky.sun_emitter == kInvalidIndex) || (atmosphere_sky.sky_emitter == kInvalidIndex)) {
+      return false;
+    }
+
+    const auto& sun = emitters[atmosphere_sky.sun_emitter];
+    auto& sky = emitters[atmosphere_sky.sky_emitter];
+
+    bool rebake = atmosphere_bake_valid(sun) == false;
+    if (rebake) {
+      TimeMeasure m = {};
+      atmosphere.build(scheduler, atmosphere_sky.parameters, spectrums());
+      atmosphere_bake.image.resize(1llu * atmosphere_sky.dimensions.x * atmosphere_sky.dimensions.y);
+      atmosphere.bake(scheduler, {0.0f, kPlanetRadius + atmosphere_sky.altitude, 0.0f}, sun.direction, sun.emission.spectrum, atmosphere_sky.dimensions,
+        atmosphere_bake.image.data());
+      atmosphere_bake.sky = atmosphere_sky;
+      atmosphere_bake.sun_direction = sun.direction;
+      atmosphere_bake.sun_emission = sun.emission.spectrum;
+      log::warning("Atmosphere baked in %.2f sec\n", m.measure());
+    }
+
+    if (rebake || (sky.emission.image_index == kInvalidIndex)) {
+      images.remove(sky.emission.image_index);
+      sky.emission.image_index = images.add_from_data(atmosphere_bake.image.data(), atmosphere_sky.dimensions, Image::BuildSamplingTable | Image::RepeatU);
+      scene.images = {images.as_array(), images.array_size()};
+      return true;
+    }
+
+    return false;
+  }
+
+  void update_thinfilm_table(uint32_t material_index) {
+    auto& mtl = materials[material_index];
+
+    // materials with the same film and media share one table, it is built only once
+    uint32_t previous_table = mtl.thinfilm.table_image;
+    mtl.thinfilm.table_image = kInvalidIndex;
+    if (previous_table != kInvalidIndex) {
+      bool shared = false;
+      for (const auto& other : materials) {
+        shared = shared || (other.thinfilm.table_image == previous_table);
+      }
+      if (shared == false) {
+        images.remove(previous_table);
+        std::erase_if(thinfilm_tables, [previous_table](const auto& entry) {
+          return entry.second == previous_table;
+        });
+      }
+    }
+
+    if (mtl.thinfilm.max_thickness * mtl.thinfilm.min_thickness <= 0.0f) {
+      return;
+    }
+
+    std::vector<float> key;
+    thinfilm_table_key(mtl, key);
+    auto cached = thinfilm_tables.find(key);
+    if (cached != thinfilm_tables.end()) {
+      mtl.thinfilm.table_image = cached->second;
+    } else {
+      build_thinfilm_table(scheduler, mtl, thinfilm_table);
+      mtl.thinfilm.table_image = images.add_from_data(thinfilm_table.data(), thinfilm_table_dimensions(), Image::Regular);
+      thinfilm_tables[key] = mtl.thinfilm.table_image;
+    }
+
+    SpectralQuery spect = {spectrum::kSpectralRendering ? 550.0f : spectrum::kUndefinedWavelength};
+    mtl.thinfilm.table_eta = {mtl.ext_ior(spect).eta.monochromatic(), mtl.int_ior(spect).eta.monochromatic()};
+  }
+
   float triangle_area(const Triangle& t) {
     return 0.5f * length(cross(vertices[t.i[1]].pos - vertices[t.i[0]].pos, vertices[t.i[2]].pos - vertices[t.i[0]].pos));
   }
 
+  /*
+   * table over the unit square of random_barycentric, each cell keeps the brightest of several texture lookups inside it;
+   * nothing is built when the triangle covers about one texel or the emission is nearly uniform over it
+   */
+  uint32_t build_emitter_sampling_table(const Triangle& tri, const Image& img) {
+    constexpr uint32_t kMaxTableSize = 64u;
+    constexpr uint32_t kCellSamples = 4u;
+
+    auto min_uv = min(vertices[tri.i[0]].tex, min(vertices[tri.i[1]].tex, vertices[tri.i[2]].tex));
+    auto max_uv = max(vertices[tri.i[0]].tex, max(vertices[tri.i[1]].tex, vertices[tri.i[2]].tex));
+    float footprint = max((max_uv.x - min_uv.x) * img.fsize.x, (max_uv.y - min_uv.y) * img.fsize.y);
+    uint32_t size = min(kMaxTableSize, static_cast<uint32_t>(ceilf(footprint)));
+    if (size <= 1u) {
+      return kInvalidIndex;
+    }
+
+    std::vector<float4> table(1llu * size * size);
+    ArrayView<Vertex> vertex_view = {vertices.data(), vertices.size()};
+    scheduler.execute(size * size, [&table, &img, &tri, vertex_view, size](uint32_t begin, uint32_t end, uint32_t) {
+      for (uint32_t i = begin; i < end; ++i) {
+        float value = 0.0f;
+        for (uint32_t sy = 0; sy < kCellSamples; ++sy) {
+          for (uint32_t sx = 0; sx < kCellSamples; ++sx) {
+            float2 rnd = {
+              (float(i % size) + (float(sx) + 0.5f) / float(kCellSamples)) / float(size),
+              (float(i / size) + (float(sy) + 0.5f) / float(kCellSamples)) / float(size),
+            };
+            float2 uv = lerp_uv(vertex_view, tri, random_barycentric(rnd));
+            value = max(value, luminance(to_float3(img.evaluate(uv))));
+          }
+        }
+        table[i] = {value, value, value, 1.0f};
+      }
+    });
+
+    float min_value = kMaxFloat;
+    float max_value = 0.0f;
+    float average = 0.0f;
+    for (const auto& value : table) {
+      min_value = min(min_value, value.x);
+      max_value = max(max_value, value.x);
+      average += value.x / float(table.size());
+    }
+
+    if (max_value - min_value <= 0.05f * max_value) {
+      return kInvalidIndex;
+    }
+
+    // emission could be missed by the lookups, so every cell keeps a small probability
+    for (auto& value : table) {
+      value += float4{0.01f * average, 0.01f * average, 0.01f * average, 0.0f};
+    }
+
+    return images.add_from_data(table.data(), {size, size}, Image::BuildSamplingTable | Image::UniformSamplingTable);
+  }
+
+  /*
+   * tables are built once all emitters are known: triangles mapped to the same texture region share one table,
+   * and when the image pool could not fit all of them the most powerful regions are preferred,
+   * emitters of the remaining regions are sampled uniformly
+   */
+  void build_emitter_sampling_tables() {
+    struct Region {
+      uint32_t image_index = kInvalidIndex;
+      float2 uv[3] = {};
+
+      bool operator<(const Region& other) const {
+        return std::tie(image_index, uv[0].x, uv[0].y, uv[1].x, uv[1].y, uv[2].x, uv[2].y) <
+               std::tie(other.image_index, other.uv[0].x, other.uv[0].y, other.uv[1].x, other.uv[1].y, other.uv[2].x, other.uv[2].y);
+      }
+    };
+
+    struct RegionEmitters {
+      float weight = 0.0f;
+      std::vector<uint32_t> emitters;
+    };
+
+    std::map<Region, RegionEmitters> regions;
+    for (uint32_t i = 0, e = static_cast<uint32_t>(emitters.size()); i < e; ++i) {
+      auto& em = emitters[i];
+      em.sampling_image_index = kInvalidIndex;
+      if ((em.is_local() == false) || (em.emission.image_index == kInvalidIndex)) {
+        continue;
+      }
+
+      const auto& tri = triangles[em.triangle_index];
+      const auto& img = images.get(em.emission.image_index);
+      Region region = {em.emission.image_index, {vertices[tri.i[0]].tex, vertices[tri.i[1]].tex, vertices[tri.i[2]].tex}};
+
+      // repeated textures look the same at integer offsets
+      auto min_uv = min(region.uv[0], min(region.uv[1], region.uv[2]));
+      float2 offset = {
+        (img.options & Image::RepeatU) ? floorf(min_uv.x) : 0.0f,
+        (img.options & Image::RepeatV) ? floorf(min_uv.y) : 0.0f,
+      };
+      for (auto& uv : region.uv) {
+        uv -= offset;
+      }
+
+      auto& target = regions[region];
+      target.weight += em.weight;
+      target.emitters.emplace_back(i);
+    }
+
+    std::vector<const RegionEmitters*> sorted_regions;
+    sorted_regions.reserve(regions.size());
+    for (const auto& region : regions) {
+      sorted_regions.emplace_back(&region.second);
+    }
+    std::sort(sorted_regions.begin(), sorted_regions.end(), [](const RegionEmitters* a, const RegionEmitters* b) {
+      return a->weight > b->weight;
+    });
+
+    // slots kept for thin-film tables rebuilt while editing materials and for the baked sky
+    uint32_t reserved_images = static_cast<uint32_t>(materials.size()) + 16u;
+
+    uint64_t uniform_emitters = 0;
+    for (const auto region : sorted_regions) {
+      if (images.free_slot_count() <= reserved_images) {
+        uniform_emitters += region->emitters.size();
+        continue;
+      }
+
+      const auto& em = emitters[region->emitters.front()];
+      uint32_t table = build_emitter_sampling_table(triangles[em.triangle_index], images.get(em.emission.image_index));
+      for (uint32_t i : region->emitters) {
+        emitters[i].sampling_image_index = table;
+      }
+    }
+
+    if (uniform_emitters > 0) {
+      log::warning("Image pool is full, %llu textured emitters are sampled uniformly", uniform_emitters);
+    }
+  }
+
   bool validate_triangle(Triangle& t) {
     t.geo_n = cross(vertices[t.i[1]].pos - vertices[t.i[0]].pos, vertices[t.i[2]].pos - vertices[t.i[0]].pos);
     float l = length(t.geo_n);
@@ -175,6 +435,10 @@ struct SceneRepresentationImpl {
       return false;
 
     t.geo_n /= l;
+
+    float2 duv_1 = vertices[t.i[1]].tex - vertices[t.i[0]].tex;
+    float2 duv_2 = vertices[t.i[2]].tex - vertices[t.i[0]].tex;
+    t.uv_scale = sqrtf(fabsf(duv_1.x * duv_2.y - duv_1.y * duv_2.x) / l);
     return true;
   }
 
@@ -310,6 +574,23 @@ struct SceneRepresentationImpl {
     }
     scene.camera_medium_index = camera_medium_index;
     scene.camera_lens_shape_image_index = camera_lens_shape_image_index;
+
+    if (microfacet_energy_table.empty()) {
+      build_microfacet_energy_table(scheduler, microfacet_energy_table);
+    }
+    scene.microfacet_energy_image_index = images.add_from_data(microfacet_energy_table.data(), {kMicrofacetEnergyTableSize, kMicrofacetEnergyTableSize}, Image::Regular);
+
+    if (subsurface_profile_table.empty()) {
+      build_subsurface_profile_table(subsurface_profile_table);
+    }
+    scene.subsurface_profile_image_index = images.add_from_data(subsurface_profile_table.data(), {subsurface::kProfileTableSize, 2u}, Image::Regular);
+
+    for (uint32_t i = 0, e = static_cast<uint32_t>(materials.size()); i < e; ++i) {
+      update_thinfilm_table(i);
+    }
+
+    build_emitter_sampling_tables();
+
     scene.vertices = {vertices.data(), vertices.size()};
     scene.triangles = {triangles.data(), triangles.size()};
     scene.triangle_to_material = {triangle_to_material.data(), triangle_to_material.size()};
@@ -398,6 +679,36 @@ SceneRepresentation::~SceneRepresentation() {
   ETX_PIMPL_CLEANUP(SceneRepresentation);
 }
 
+bool SceneRepresentation::bake_atmosphere() {
+  return _private->bake_atmosphere();
+}
+
+void SceneRepresentation::update_material(uint32_t index) {
+  if (index >= _private->materials.size())
+    return;
+
+  _private->update_thinfilm_table(index);
+  _private->scene.images = {_private->images.as_array(), _private->images.array_size()};
+}
+
+void SceneRepresentation::set_texture_cache_budget(uint64_t budget) {
+  _private->cleanup();
+  _private->images.set_texture_cache_budget(budget);
+}
+
+bool SceneRepresentation::has_loaded_images() {
+  return _private->images.has_loaded_images();
+}
+
+bool SceneRepresentation::publish_loaded_images() {
+  if (_private->images.publish_loaded_images() == false) {
+    return false;
+  }
+
+  _private->scene.images = {_private->images.as_array(), _private->images.array_size()};
+  return true;
+}
+
 Scene& SceneRepresentation::mutable_scene() {
   return _private->scene;
 }
@@ -440,14 +751,29 @@ void SceneRepresentation::write_materials(const char* filename) {
     return;
   }
 
-  for (const auto& em : _private->scene.emitters) {
+  const auto& sky = _private->atmosphere_sky;
+  for (uint32_t i = 0; i < _private->scene.emitters.count; ++i) {
+    const auto& em = _private->scene.emitters[i];
+    if (i == sky.sky_emitter) {
+      continue;
+    }
+
     switch (em.cls) {
       case Emitter::Class::Directional: {
         float3 e = em.emission.spectrum.to_xyz();
-        fprintf(fout, "newmtl et::dir\n");
+        fprintf(fout, "newmtl %s\n", (i == sky.sun_emitter) ? "et::atmosphere" : "et::dir");
         fprintf(fout, "color %.3f %.3f %.3f\n", e.x, e.y, e.z);
         fprintf(fout, "direction %.3f %.3f %.3f\n", em.direction.x, em.direction.y, em.direction.z);
         fprintf(fout, "angular_diameter %.3f\n", em.angular_size * 180.0f / kPi);
+        if (i == sky.sun_emitter) {
+          fprintf(fout, "rayleigh %.3f\n", sky.parameters.rayleigh);
+          fprintf(fout, "mie %.3f\n", sky.parameters.mie);
+          fprintf(fout, "ozone %.3f\n", sky.parameters.ozone);
+          fprintf(fout, "anisotropy %.3f\n", sky.parameters.anisotropy);
+          fprintf(fout, "multiple_scattering %u\n", sky.parameters.multiple_scattering ? 1u : 0u);
+          fprintf(fout, "altitude %.3f\n", sky.altitude);
+          fprintf(fout, "resolution %u %u\n", sky.dimensions.x, sky.dimensions.y);
+        }
         fprintf(fout, "\n");
         break;
       }
@@ -467,7 +793,8 @@ void SceneRepresentation::write_materials(const char* filename) {
     const auto& material = _private->scene.materials[mmap.second];
 
     fprintf(fout, "newmtl %s\n", mmap.first.c_str());
-    fprintf(fout, "material class %s\n", material_class_to_string(material.cls));
+    bool compensation = material.multiple_scattering == Material::MultipleScattering::EnergyCompensation;
+    fprintf(fout, "material class %s%s\n", material_class_to_string(material.cls), compensation ? " multiple_scattering compensation" : "");
     // TODO : support anisotripic roughness
     fprintf(fout, "Pr %.3f\n", sqrtf(0.5f * (sqr(material.roughness.x) + sqr(material.roughness.y))));
     {
@@ -569,6 +896,8 @@ bool SceneRepresentation::load_from_file(const char* filename, uint32_t options)
         _private->geometry_file_name = std::string(base_folder) + str_value;
       } else if (json_get_string(i, "materials", str_value)) {
         _private->mtl_file_name = std::string(base_folder) + str_value;
+      } else if (json_get_string(i, "multiple-scattering", str_value)) {
+        _private->multiple_scattering = multiple_scattering_from_string(str_value.c_str());
       } else if ((key == "camera") && obj.is_object()) {
         for (auto ci = obj.begin(), ce = obj.end(); ci != ce; ++ci) {
           const auto& ckey = ci.key();
@@ -637,10 +966,11 @@ bool SceneRepresentation::load_from_file(const char* filename, uint32_t options)
     log::warning("No emitters found, adding default environment image...");
     auto& sky = _private->emitters.emplace_back(Emitter::Class::Environment);
     sky.emission.spectrum = SpectralDistribution::from_constant(1.0f);
-    sky.emission.image_index = _private->add_image(env().file_in_data("assets/hdri/environment.exr"), Image::RepeatU | Image::BuildSamplingTable);
+    sky.emission.image_index = _private->add_image(env().file_in_data("assets/hdri/environment.exr"), Image::RepeatU | Image::BuildSamplingTable | Image::BlockCompressed);
     _private->images.load_images();
   }
 
+  _private->bake_atmosphere();
   _private->validate_materials();
 
   std::vector<bool> referenced_vertices;
@@ -868,7 +1198,7 @@ uint32_t SceneRepresentationImpl::load_from_obj(const char* file_name, const cha
         uint32_t emissive_image_index = kInvalidIndex;
         if (get_file(base_dir, source_material.emissive_texname, data_buffer, sizeof(data_buffer))) {
           emissive_image_index = add_image(data_buffer, Image::RepeatU | Image::RepeatV | Image::BuildSamplingTable);
-          images.load_images();
+          images.load_image(emissive_image_index);
         }
 
         float texture_emission = 1.0f;
@@ -1074,11 +1404,22 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
 
       uint32_t medium_index = add_medium(cls, name_buffer, tmp_buffer, s_a, s_t, g);
 
+      if (get_param(material, "transmittance", data_buffer)) {
+        auto& medium = mediums.get(medium_index);
+        if (strcmp(data_buffer, "ratio") == 0) {
+          medium.transmittance_estimator = Medium::TransmittanceEstimator::RatioTracking;
+        } else if (strcmp(data_buffer, "residual") == 0) {
+          medium.transmittance_estimator = Medium::TransmittanceEstimator::ResidualRatioTracking;
+        } else {
+          log::warning("Unknown transmittance estimator `%s` for medium `%s`", data_buffer, name_buffer);
+        }
+      }
+
       if (strcmp(name_buffer, "camera") == 0) {
         camera_medium_index = medium_index;
       }
 
-    } else if (material.name == "et::dir") {
+    } else if ((material.name == "et::dir") || (material.name == "et::atmosphere")) {
       auto& e = emitters.emplace_back(Emitter::Class::Directional);
 
       if (get_param(material, "color", data_buffer)) {
@@ -1107,6 +1448,43 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
           e.angular_size = val * kPi / 180.0f;
         }
       }
+
+      if (material.name == "et::atmosphere") {
+        auto& sky = atmosphere_sky;
+        sky.sun_emitter = static_cast<uint32_t>(emitters.size() - 1llu);
+
+        const struct {
+          const char* name;
+          float* value;
+        } values[] = {
+          {"rayleigh", &sky.parameters.rayleigh},
+          {"mie", &sky.parameters.mie},
+          {"ozone", &sky.parameters.ozone},
+          {"anisotropy", &sky.parameters.anisotropy},
+          {"altitude", &sky.altitude},
+        };
+        for (const auto& v : values) {
+          if (get_param(material, v.name, data_buffer)) {
+            sscanf(data_buffer, "%f", v.value);
+          }
+        }
+
+        if (get_param(material, "multiple_scattering", data_buffer)) {
+          sky.parameters.multiple_scattering = atoi(data_buffer) != 0;
+        }
+
+        if (get_param(material, "resolution", data_buffer)) {
+          uint32_t w = 0;
+          uint32_t h = 0;
+          if ((sscanf(data_buffer, "%u %u", &w, &h) == 2) && (w > 1u) && (h > 1u)) {
+            sky.dimensions = {w, h};
+          }
+        }
+
+        auto& env = emitters.emplace_back(Emitter::Class::Environment);
+        env.emission.spectrum = SpectralDistribution::from_constant(1.0f);
+        sky.sky_emitter = static_cast<uint32_t>(emitters.size() - 1llu);
+      }
     } else if (material.name == "et::env") {
       auto& e = emitters.emplace_back(Emitter::Class::Environment);
 
@@ -1114,7 +1492,7 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
         snprintf(tmp_buffer, sizeof(tmp_buffer), "%s/%s", base_dir, data_buffer);
       }
 
-      e.emission.image_index = add_image(tmp_buffer, Image::BuildSamplingTable | Image::RepeatU);
+      e.emission.image_index = add_image(tmp_buffer, Image::BuildSamplingTable | Image::RepeatU | Image::BlockCompressed);
 
       if (get_param(material, "color", data_buffer)) {
         e.emission.spectrum = load_illuminant_spectrum(data_buffer);
@@ -1137,17 +1515,7 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
       mtl.roughness = {material.roughness, material.roughness};
       mtl.metalness = material.metallic;
 
-      if (get_file(base_dir, material.diffuse_texname, data_buffer, sizeof(data_buffer))) {
-        mtl.diffuse.image_index = add_image(data_buffer, Image::RepeatU | Image::RepeatV);
-      }
-
-      if (get_file(base_dir, material.specular_texname, data_buffer, sizeof(data_buffer))) {
-        mtl.specular.image_index = add_image(data_buffer, Image::RepeatU | Image::RepeatV);
-      }
-
-      if (get_file(base_dir, material.transmittance_texname, data_buffer, sizeof(data_buffer))) {
-        mtl.transmittance.image_index = add_image(data_buffer, Image::RepeatU | Image::RepeatV);
-      }
+      uint32_t texture_options = Image::RepeatU | Image::RepeatV | Image::MipMapped | Image::BlockCompressed;
 
       if (get_param(material, "material", data_buffer)) {
         auto params = split_params(data_buffer);
@@ -1156,6 +1524,10 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
             mtl.cls = material_string_to_class(params[i + 1]);
             i += 1;
           }
+          if ((strcmp(params[i], "multiple_scattering") == 0) && (i + 1 < e)) {
+            mtl.multiple_scattering = multiple_scattering_from_string(params[i + 1]);
+            i += 1;
+          }
           if ((strcmp(params[i], "uroughness") == 0) && (i + 1 < e)) {
             float param = 0.0f;
             if (sscanf(params[i + 1], "%f", &param) == 1) {
@@ -1170,9 +1542,29 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
             }
             i += 1;
           }
+          if ((strcmp(params[i], "spectral_coefficients") == 0) && (i + 1 < e)) {
+            // uncompressed float coefficients trade memory for faster spectral texture lookups
+            uint32_t param = 0;
+            if ((sscanf(params[i + 1], "%u", &param) == 1) && (param != 0)) {
+              texture_options |= Image::SpectralCoefficients;
+            }
+            i += 1;
+          }
         }
       }
 
+      if (get_file(base_dir, material.diffuse_texname, data_buffer, sizeof(data_buffer))) {
+        mtl.diffuse.image_index = add_image(data_buffer, texture_options);
+      }
+
+      if (get_file(base_dir, material.specular_texname, data_buffer, sizeof(data_buffer))) {
+        mtl.specular.image_index = add_image(data_buffer, texture_options);
+      }
+
+      if (get_file(base_dir, material.transmittance_texname, data_buffer, sizeof(data_buffer))) {
+        mtl.transmittance.image_index = add_image(data_buffer, texture_options);
+      }
+
       if (get_param(material, "int_ior", data_buffer)) {
         float2 values = {};
         if (sscanf(data_buffer, "%f %f", &values.x, &values.y) == 2) {
@@ -1237,7 +1629,7 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
           if ((strcmp(params[i], "image") == 0) && (i + 1 < e)) {
             char buffer[1024] = {};
             snprintf(buffer, sizeof(buffer), "%s/%s", base_dir, params[i + 1]);
-            mtl.normal_image_index = add_image(buffer, Image::RepeatU | Image::RepeatV | Image::Linear);
+            mtl.normal_image_index = add_image(buffer, Image::RepeatU | Image::RepeatV | Image::Linear | Image::MipMapped | Image::BlockCompressed | Image::NormalMap);
             i += 1;
           }
           if ((strcmp(params[i], "scale") == 0) && (i + 1 < e)) {
@@ -1254,7 +1646,7 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
           if ((strcmp(params[i], "image") == 0) && (i + 1 < e)) {
             char buffer[1024] = {};
             snprintf(buffer, sizeof(buffer), "%s/%s", base_dir, params[i + 1]);
-            mtl.thinfilm.thinkness_image = add_image(buffer, Image::RepeatU | Image::RepeatV | Image::Linear);
+            mtl.thinfilm.thinkness_image = add_image(buffer, Image::RepeatU | Image::RepeatV | Image::Linear | Image::BlockCompressed);
             i += 1;
           }
 
@@ -1306,7 +1698,7 @@ void SceneRepresentationImpl::parse_obj_materials(const char* base_dir, const st
     }
   }
 
-  images.load_images();
+  images.load_images_in_background();
 }
 
 uint32_t SceneRepresentationImpl::load_from_gltf(const char* file_name, bool binary) {
@@ -25,6 +25,25 @@ struct SceneRepresentation {
   void save_to_file(const char* filename);
   void write_materials(const char* filename);
 
+  bool bake_atmosphere();
+
+  /*
+   * rebuilds precomputed data of the material (thin film reflectance table) after its parameters were changed
+   */
+  void update_material(uint32_t index);
+
+  /*
+   * material textures are decoded in background after loading, decoded images are swapped in
+   * by publish_loaded_images, which should be called while integrators are stopped
+   */
+  bool has_loaded_images();
+  bool publish_loaded_images();
+
+  /*
+   * budget of the out-of-core texture cache in bytes, zero keeps all images resident; unloads current scene
+   */
+  void set_texture_cache_budget(uint64_t budget);
+
   Scene& mutable_scene();
   Scene* mutable_scene_pointer();
 
@@ -36,7 +55,7 @@ struct SceneRepresentation {
 
   operator bool() const;
 
-  ETX_DECLARE_PIMPL(SceneRepresentation, 2048);
+  ETX_DECLARE_PIMPL(SceneRepresentation, 32768);
 };
 
 Camera build_camera(const float3& origin, const float3& target, const float3& up, const uint2& viewport, float fov, float lens_radius, float focal_distance);
@@ -5,21 +5,149 @@
 
 namespace etx {
 
-SpectralDistribution SpectralDistribution::from_black_body(float temperature, Pointer<Spectrums> spectrums) {
-  SpectralDistribution result;
-  result.count = spectrum::WavelengthCount;
-  for (uint32_t i = 0; i < spectrum::WavelengthCount; ++i) {
-    float wl = float(i + spectrum::ShortestWavelength);
-    result.entries[i] = {wl, spectrum::black_body_radiation(wl, temperature)};
+namespace {
+
+struct SpectralSample {
+  float wavelength = 0.0f;
+  float power = 0.0f;
+};
+
+using SpectralEntries = std::vector<SpectralSample>;
+
+float3 integrate_entries_to_xyz(const SpectralSample entries[], uint32_t count) {
+  auto xyz_at = [](float wl) -> float3 {
+    uint32_t i = static_cast<uint32_t>(clamp(wl, spectrum::kShortestWavelength, spectrum::kLongestWavelength) - spectrum::ShortestWavelength);
+    uint32_t j = min(i + 1u, spectrum::WavelengthCount - 1);
+    auto v0 = spectrum::spectral_xyz(i);
+    auto v1 = spectrum::spectral_xyz(j);
+    float dw = wl - floorf(wl);
+    return lerp(v0, v1, dw);
+  };
+
+  auto integrate = [entries, xyz_at](uint32_t index) -> float3 {
+    float3 result = {};
+
+    float l0 = entries[index + 0].wavelength;
+    float l1 = entries[index + 1].wavelength;
+    float p0 = entries[index + 0].power;
+    float p1 = entries[index + 1].power;
+    float begin = l0;
+    for (;;) {
+      float end = min(l1, begin + 1.0f);
+      float t0 = (begin - l0) / (l1 - l0);
+      float t1 = (end - l0) / (l1 - l0);
+      float p_begin = lerp(p0, p1, t0);
+      float p_end = lerp(p0, p1, t1);
+
+      auto v0 = xyz_at(begin) * p_begin;
+      auto v1 = xyz_at(end) * p_end;
+
+      result += (end - begin) * (v0 + 0.5f * (v1 - v0));
+      if (end == l1) {
+        break;
+      }
+      begin = end;
+    }
+    return result / spectrum::kYIntegral;
+  };
+
+  float3 result = {};
+  for (uint32_t i = 0; i + 1 < count; ++i) {
+    result += integrate(i);
+  }
+  return result;
+}
+
+/*
+ * integrates piecewise linear interpolation of sorted samples over [begin, end],
+ * values outside of the sampled range are extended with the nearest sample
+ */
+float integrate_samples(const SpectralEntries& samples, float begin, float end) {
+  float result = 0.0f;
+
+  const auto& first = samples.front();
+  if (begin < first.wavelength) {
+    result += (min(end, first.wavelength) - begin) * first.power;
+    begin = first.wavelength;
   }
 
-  if constexpr (spectrum::kSpectralRendering == false) {
-    float3 xyz = result.integrate_to_xyz();
-    result = rgb::make_spd(spectrum::xyz_to_rgb(xyz), spectrums->rgb_illuminant);
+  const auto& last = samples.back();
+  if (end > last.wavelength) {
+    result += (end - max(begin, last.wavelength)) * last.power;
+    end = last.wavelength;
+  }
+
+  for (uint64_t j = 0; (j + 1 < samples.size()) && (samples[j].wavelength < end); ++j) {
+    float l0 = samples[j].wavelength;
+    float l1 = samples[j + 1].wavelength;
+    float a = max(begin, l0);
+    float b = min(end, l1);
+    if ((b <= a) || (l1 <= l0))
+      continue;
+
+    float pa = lerp(samples[j].power, samples[j + 1].power, (a - l0) / (l1 - l0));
+    float pb = lerp(samples[j].power, samples[j + 1].power, (b - l0) / (l1 - l0));
+    result += 0.5f * (b - a) * (pa + pb);
   }
   return result;
 }
 
+/*
+ * converts sorted samples of arbitrary density into the compact representation:
+ * averaged over each bin of the uniform grid in spectral mode (so narrow emission lines
+ * keep their energy regardless of where they fall), or projected to RGB otherwise
+ */
+SpectralDistribution from_sorted_entries(const SpectralEntries& samples, const rgb::SpectrumSet& rgb_set) {
+  if (samples.empty()) {
+    return {};
+  }
+
+  if constexpr (spectrum::kSpectralRendering) {
+    SpectralDistribution result = {};
+    result.count = SpectralDistribution::kEntryCount;
+
+    constexpr float kHalfStep = 0.5f * float(spectrum::TableStep);
+    for (uint32_t i = 0; i < result.count; ++i) {
+      float wavelength = spectrum::table_wavelength(i);
+      float begin = max(wavelength - kHalfStep, spectrum::kShortestWavelength);
+      float end = min(wavelength + kHalfStep, spectrum::kLongestWavelength);
+      result.power[i] = integrate_samples(samples, begin, end) / (end - begin);
+    }
+    return result;
+  } else {
+    float3 xyz = integrate_entries_to_xyz(samples.data(), static_cast<uint32_t>(samples.size()));
+    return rgb::make_spd(spectrum::xyz_to_rgb(xyz), rgb_set);
+  }
+}
+
+void sort_and_scale_entries(SpectralEntries& samples) {
+  std::sort(samples.begin(), samples.end(), [](const auto& a, const auto& b) {
+    return a.wavelength < b.wavelength;
+  });
+
+  float value = samples.empty() ? 100.0f : samples.front().wavelength;
+  float wavelength_scale = 1.0f;
+  while (value < 100.0f) {
+    wavelength_scale *= 10.0f;
+    value *= 10.0f;
+  }
+
+  for (auto& sample : samples) {
+    sample.wavelength *= wavelength_scale;
+  }
+}
+
+}  // namespace
+
+SpectralDistribution SpectralDistribution::from_black_body(float temperature, Pointer<Spectrums> spectrums) {
+  SpectralEntries samples(spectrum::WavelengthCount);
+  for (uint32_t i = 0; i < spectrum::WavelengthCount; ++i) {
+    float wl = float(i + spectrum::ShortestWavelength);
+    samples[i] = {wl, spectrum::black_body_radiation(wl, temperature)};
+  }
+  return from_sorted_entries(samples, spectrums->rgb_illuminant);
+}
+
 SpectralDistribution::Class SpectralDistribution::load_from_file(const char* file_name, SpectralDistribution& values0, SpectralDistribution* values1,
   Pointer<Spectrums> spectrums) {
   auto file = fopen(file_name, "r");
@@ -97,40 +225,26 @@ SpectralDistribution::Class SpectralDistribution::load_from_file(const char* fil
     sample.wavelength *= scale;
   }
 
-  values0.count = 0;
-
+  SpectralEntries entries0;
+  SpectralEntries entries1;
+  entries0.reserve(samples.size());
+  entries1.reserve(samples.size());
   for (const auto& sample : samples) {
     if ((sample.wavelength >= spectrum::kShortestWavelength) && (sample.wavelength <= spectrum::kLongestWavelength)) {
-      values0.entries[values0.count++] = {sample.wavelength, sample.values[0]};
-      if (values0.count >= spectrum::kWavelengthCount) {
-        break;
-      }
+      entries0.push_back({sample.wavelength, sample.values[0]});
+      entries1.push_back({sample.wavelength, sample.values[1]});
     }
   }
 
-  if (values0.count == 0)
+  if (entries0.empty())
     return Class::Invalid;
 
-  if constexpr (spectrum::kSpectralRendering == false) {
-    float3 xyz = values0.integrate_to_xyz();
-    values0 = rgb::make_spd(spectrum::xyz_to_rgb(xyz), (cls == Class::Illuminant) ? spectrums->rgb_illuminant : spectrums->rgb_reflection);
-  }
+  const auto& rgb_set = (cls == Class::Illuminant) ? spectrums->rgb_illuminant : spectrums->rgb_reflection;
 
-  if (values1 != nullptr) {
-    values1->count = 0;
-    for (const auto& sample : samples) {
-      if ((sample.wavelength >= spectrum::kShortestWavelength) && (sample.wavelength <= spectrum::kLongestWavelength)) {
-        values1->entries[values1->count++] = {sample.wavelength, sample.values[1]};
-        if (values1->count >= spectrum::kWavelengthCount) {
-          break;
-        }
-      }
-    }
+  values0 = from_sorted_entries(entries0, rgb_set);
 
-    if constexpr (spectrum::kSpectralRendering == false) {
-      float3 xyz = values1->integrate_to_xyz();
-      *values1 = rgb::make_spd(spectrum::xyz_to_rgb(xyz), (cls == Class::Illuminant) ? spectrums->rgb_illuminant : spectrums->rgb_reflection);
-    }
+  if (values1 != nullptr) {
+    *values1 = from_sorted_entries(entries1, rgb_set);
   }
 
   return cls;
@@ -138,7 +252,7 @@ SpectralDistribution::Class SpectralDistribution::load_from_file(const char* fil
 
 bool SpectralDistribution::valid() const {
   for (uint32_t i = 0; i < count; ++i) {
-    if (valid_value(entries[i].power) == false) {
+    if (valid_value(power[i]) == false) {
       return false;
     }
   }
@@ -149,136 +263,50 @@ float3 SpectralDistribution::to_xyz() const {
   if constexpr (spectrum::kSpectralRendering) {
     return integrate_to_xyz();
   } else {
-    return spectrum::rgb_to_xyz({entries[0].power, entries[1].power, entries[2].power});
+    return spectrum::rgb_to_xyz({power[0], power[1], power[2]});
   }
 }
 
 float SpectralDistribution::maximum_power() const {
-  float result = entries[0].power;
+  float result = power[0];
   for (uint32_t i = 0; i < count; ++i) {
-    result = max(result, entries[i].power);
+    result = max(result, power[i]);
   }
   return result;
 }
 
 float3 SpectralDistribution::integrate_to_xyz() const {
-  auto xyz_at = [](float wl) -> float3 {
-    uint32_t i = static_cast<uint32_t>(clamp(wl, spectrum::kShortestWavelength, spectrum::kLongestWavelength) - spectrum::ShortestWavelength);
-    uint32_t j = min(i + 1u, spectrum::WavelengthCount - 1);
-    auto v0 = spectrum::spectral_xyz(i);
-    auto v1 = spectrum::spectral_xyz(j);
-    float dw = wl - floorf(wl);
-    return lerp(v0, v1, dw);
-  };
-
-  auto integrate = [entries = entries, xyz_at](uint32_t index) -> float3 {
-    float3 result = {};
-
-    float l0 = entries[index + 0].wavelength;
-    float l1 = entries[index + 1].wavelength;
-    float p0 = entries[index + 0].power;
-    float p1 = entries[index + 1].power;
-    float begin = l0;
-    for (;;) {
-      float end = min(l1, begin + 1.0f);
-      float t0 = (begin - l0) / (l1 - l0);
-      float t1 = (end - l0) / (l1 - l0);
-      float p_begin = lerp(p0, p1, t0);
-      float p_end = lerp(p0, p1, t1);
-
-      auto v0 = xyz_at(begin) * p_begin;
-      auto v1 = xyz_at(end) * p_end;
-
-      result += (end - begin) * (v0 + 0.5f * (v1 - v0));
-      if (end == l1) {
-        break;
-      }
-      begin = end;
-    }
-    return result / spectrum::kYIntegral;
-  };
-
-  float3 result = {};
-  for (uint32_t i = 0; i + 1 < count; ++i) {
-    result += integrate(i);
+  SpectralSample samples[kEntryCount] = {};
+  for (uint32_t i = 0; i < count; ++i) {
+    samples[i] = {spectrum::table_wavelength(i), power[i]};
   }
-  return result;
+  return integrate_entries_to_xyz(samples, count);
 }
 
 float SpectralDistribution::total_power() const {
   if constexpr (spectrum::kSpectralRendering) {
     return integrate_to_xyz().y;
   } else {
-    return entries[0].power * 0.2627f + entries[1].power * 0.678f + entries[2].power * 0.0593f;
-  }
-}
-
-SpectralDistribution SpectralDistribution::from_samples(const float wavelengths[], const float power[], uint32_t count) {
-  float value = (count > 0) ? wavelengths[0] : 100.0f;
-  float wavelength_scale = 1.0f;
-  while (value < 100.0f) {
-    wavelength_scale *= 10.0f;
-    value *= 10.0f;
-  }
-
-  SpectralDistribution result;
-  result.count = count;
-  for (uint32_t i = 0; i < count; ++i) {
-    result.entries[i] = {wavelengths[i] * wavelength_scale, power ? power[i] : 0.0f};
-  }
-
-  for (uint32_t i = 0; i < count; ++i) {
-    for (uint32_t j = i + 1; j < count; ++j) {
-      if (result.entries[i].wavelength > result.entries[j].wavelength) {
-        auto t = result.entries[i];
-        result.entries[i] = result.entries[j];
-        result.entries[j] = t;
-      }
-    }
+    return power[0] * 0.2627f + power[1] * 0.678f + power[2] * 0.0593f;
   }
-
-  return result;
 }
 
 SpectralDistribution SpectralDistribution::from_samples(const float wavelengths[], const float power[], uint32_t count, Class cls, Pointer<Spectrums> spectrums) {
-  auto result = from_samples(wavelengths, power, count);
-  if constexpr (spectrum::kSpectralRendering == false) {
-    float3 xyz = result.integrate_to_xyz();
-    result = rgb::make_spd(spectrum::xyz_to_rgb(xyz), (cls == Class::Reflectance) ? spectrums->rgb_reflection : spectrums->rgb_illuminant);
+  SpectralEntries samples(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    samples[i] = {wavelengths[i], power ? power[i] : 0.0f};
   }
-  return result;
+  sort_and_scale_entries(samples);
+  return from_sorted_entries(samples, (cls == Class::Reflectance) ? spectrums->rgb_reflection : spectrums->rgb_illuminant);
 }
 
 SpectralDistribution SpectralDistribution::from_samples(const float2 wavelengths_power[], uint32_t count, Class cls, Pointer<Spectrums> spectrums) {
-  float value = (count > 0) ? wavelengths_power[0].x : 100.0f;
-  float wavelength_scale = 1.0f;
-  while (value < 100.0f) {
-    wavelength_scale *= 10.0f;
-    value *= 10.0f;
-  }
-
-  SpectralDistribution result;
-  result.count = count;
-  for (uint32_t i = 0; i < count; ++i) {
-    result.entries[i] = {wavelengths_power[i].x * wavelength_scale, wavelengths_power[i].y};
-  }
-
+  SpectralEntries samples(count);
   for (uint32_t i = 0; i < count; ++i) {
-    for (uint32_t j = i + 1; j < count; ++j) {
-      if (result.entries[i].wavelength > result.entries[j].wavelength) {
-        auto t = result.entries[i];
-        result.entries[i] = result.entries[j];
-        result.entries[j] = t;
-      }
-    }
-  }
-
-  if constexpr (spectrum::kSpectralRendering == false) {
-    float3 xyz = result.integrate_to_xyz();
-    result = rgb::make_spd(spectrum::xyz_to_rgb(xyz), (cls == Class::Reflectance) ? spectrums->rgb_reflection : spectrums->rgb_illuminant);
+    samples[i] = {wavelengths_power[i].x, wavelengths_power[i].y};
   }
-
-  return result;
+  sort_and_scale_entries(samples);
+  return from_sorted_entries(samples, (cls == Class::Reflectance) ? spectrums->rgb_reflection : spectrums->rgb_illuminant);
 }
 
 namespace rgb {
@@ -388,6 +416,139 @@ void init_spectrums(Spectrums& spectrums) {
   }
 }
 
+namespace {
+
+constexpr uint32_t kFitIterationCount = 64u;
+
+/*
+ * color of the spectrum under equal-energy illumination, normalized the same way as SpectralResponse::to_xyz
+ */
+template <class F>
+float3 project_to_rgb(F spectrum_value) {
+  float3 xyz = {};
+  for (uint32_t i = 0; i < spectrum::TableEntryCount; ++i) {
+    float wavelength = spectrum::table_wavelength(i);
+    xyz += spectrum::spectral_xyz(i * spectrum::TableStep) * spectrum_value(wavelength);
+  }
+  return spectrum::xyz_to_rgb(xyz * (float(spectrum::TableStep) / spectrum::kYIntegral));
+}
+
+/*
+ * Levenberg-Marquardt iterations starting from `c`, minimizing difference of the colors (rather than values)
+ * of the fitted spectrum and the one built by `make_spd`; target is clamped away from 0 and 1 to keep coefficients finite
+ */
+float3 fit_coefficients(const float3& rgb, const SpectrumSet& spectrums, float3 c, float& error) {
+  float weights[Color::Count] = {};
+  compute_weights(rgb, weights);
+
+  float3 target = project_to_rgb([&](float wavelength) {
+    return clamp(spd_value(wavelength, weights, spectrums), 1.0e-3f, 1.0f - 1.0e-3f);
+  });
+
+  auto residual = [&target](const float3& c) {
+    return project_to_rgb([&c](float wavelength) {
+      return sigmoid_polynomial(c, wavelength);
+    }) - target;
+  };
+
+  float3 r = residual(c);
+  error = dot(r, r);
+  float damping = 1.0e-3f;
+  for (uint32_t iteration = 0; (iteration < kFitIterationCount) && (error > 1.0e-10f); ++iteration) {
+    // columns of the jacobian are colors of the derivatives of the spectrum with respect to each coefficient
+    float3 jacobian[3] = {};
+    for (uint32_t a = 0; a < 3u; ++a) {
+      jacobian[a] = project_to_rgb([&c, a](float wavelength) {
+        float x = (wavelength - spectrum::kShortestWavelength) / (spectrum::kLongestWavelength - spectrum::kShortestWavelength);
+        float v = (c.x * x + c.y) * x + c.z;
+        float q = 1.0f + v * v;
+        return (a == 0 ? x * x : (a == 1 ? x : 1.0f)) * 0.5f / (q * sqrtf(q));
+      });
+    }
+
+    float jtj[3][3] = {};
+    float jtr[3] = {};
+    for (uint32_t a = 0; a < 3u; ++a) {
+      for (uint32_t b = 0; b < 3u; ++b) {
+        jtj[a][b] = dot(jacobian[a], jacobian[b]);
+      }
+      jtj[a][a] *= 1.0f + damping;
+      jtr[a] = dot(jacobian[a], r);
+    }
+
+    float3 row_0 = {jtj[0][0], jtj[0][1], jtj[0][2]};
+    float3 row_1 = {jtj[1][0], jtj[1][1], jtj[1][2]};
+    float3 row_2 = {jtj[2][0], jtj[2][1], jtj[2][2]};
+    float det = dot(row_0, cross(row_1, row_2));
+    if (fabsf(det) < 1.0e-30f) {
+      break;
+    }
+
+    float3 rhs = {-jtr[0], -jtr[1], -jtr[2]};
+    float3 delta = {
+      dot(rhs, cross(row_1, row_2)) / det,
+      dot(row_0, cross(rhs, row_2)) / det,
+      dot(row_0, cross(row_1, rhs)) / det,
+    };
+
+    float3 candidate = c + delta;
+    float3 candidate_r = residual(candidate);
+    float candidate_error = dot(candidate_r, candidate_r);
+    if (candidate_error < error) {
+      c = candidate;
+      r = candidate_r;
+      error = candidate_error;
+      damping = max(damping * 0.25f, 1.0e-7f);
+    } else {
+      damping *= 4.0f;
+    }
+  }
+  return c;
+}
+
+}  // namespace
+
+void build_coefficient_table(const SpectrumSet& spectrums, float3 table[]) {
+  constexpr float kStep = 1.0f / float(kCoefficientTableSize - 1u);
+  for (uint32_t b = 0; b < kCoefficientTableSize; ++b) {
+    for (uint32_t g = 0; g < kCoefficientTableSize; ++g) {
+      // each row starts from a flat spectrum and is continued from the previous entry,
+      // a flat start is tried again when continuation ends up far from the target
+      float3 c = {};
+      for (uint32_t r = 0; r < kCoefficientTableSize; ++r) {
+        float3 rgb = {float(r) * kStep, float(g) * kStep, float(b) * kStep};
+        float error = 0.0f;
+        c = fit_coefficients(rgb, spectrums, c, error);
+        if (error > 1.0e-5f) {
+          float flat_error = 0.0f;
+          float3 flat = fit_coefficients(rgb, spectrums, {}, flat_error);
+          c = (flat_error < error) ? flat : c;
+        }
+        table[r + kCoefficientTableSize * (g + kCoefficientTableSize * b)] = c;
+      }
+    }
+  }
+}
+
+float3 lookup_coefficients(const float3 table[], const float3& rgb) {
+  constexpr float kScale = float(kCoefficientTableSize - 1u);
+  float3 p = {saturate(rgb.x) * kScale, saturate(rgb.y) * kScale, saturate(rgb.z) * kScale};
+  uint32_t x0 = min(static_cast<uint32_t>(p.x), kCoefficientTableSize - 2u);
+  uint32_t y0 = min(static_cast<uint32_t>(p.y), kCoefficientTableSize - 2u);
+  uint32_t z0 = min(static_cast<uint32_t>(p.z), kCoefficientTableSize - 2u);
+  float3 t = {p.x - float(x0), p.y - float(y0), p.z - float(z0)};
+
+  auto at = [table](uint32_t x, uint32_t y, uint32_t z) {
+    return table[x + kCoefficientTableSize * (y + kCoefficientTableSize * z)];
+  };
+
+  float3 c00 = lerp(at(x0, y0, z0), at(x0 + 1u, y0, z0), t.x);
+  float3 c10 = lerp(at(x0, y0 + 1u, z0), at(x0 + 1u, y0 + 1u, z0), t.x);
+  float3 c01 = lerp(at(x0, y0, z0 + 1u), at(x0 + 1u, y0, z0 + 1u), t.x);
+  float3 c11 = lerp(at(x0, y0 + 1u, z0 + 1u), at(x0 + 1u, y0 + 1u, z0 + 1u), t.x);
+  return lerp(lerp(c00, c10, t.y), lerp(c01, c11, t.y), t.z);
+}
+
 }  // namespace rgb
 
 }  // namespace etx
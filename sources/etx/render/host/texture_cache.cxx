@@ -0,0 +1,340 @@
+#include <etx/core/core.hxx>
+
+#include <etx/render/host/texture_cache.hxx>
+#include <etx/render/shared/base.hxx>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace etx {
+
+namespace {
+
+/*
+ * direct-mapped table of recently used pages, entries are validated against the slot key before and after the copy,
+ * so a page replaced by another thread in between is detected and the lookup falls back to the shared map
+ */
+struct ThreadPageTable {
+  static constexpr uint32_t kSize = 256u;
+
+  struct Entry {
+    const void* owner = nullptr;
+    uint64_t key = 0;
+    uint32_t slot = 0;
+  };
+
+  Entry entries[kSize] = {};
+};
+
+thread_local ThreadPageTable thread_pages;
+
+}  // namespace
+
+struct TextureCacheImpl {
+  /*
+   * sources only keep file names, cache files are opened on page misses
+   * and a few of the most recently read ones are kept open
+   */
+  static constexpr uint32_t kMaxOpenStreams = 16u;
+
+  struct Source {
+    std::string file_name;
+    uint64_t data_offset = 0;
+    uint64_t data_size = 0;
+    uint32_t stream = kInvalidIndex;
+  };
+
+  struct Stream {
+    std::ifstream file;
+    uint32_t source = kInvalidIndex;
+    uint64_t last_use = 0;
+  };
+
+  struct Slot {
+    uint64_t key = 0;
+    uint64_t queued_tick = 0;
+    uint32_t prev = kInvalidIndex;
+    uint32_t next = kInvalidIndex;
+  };
+
+  static uint64_t page_key(uint32_t source, uint64_t page) {
+    return (uint64_t(source + 1u) << 40u) | page;
+  }
+
+  static uint32_t key_source(uint64_t key) {
+    return static_cast<uint32_t>(key >> 40u) - 1u;
+  }
+
+  static uint32_t thread_table_index(uint64_t key) {
+    return static_cast<uint32_t>((key ^ (key >> 40u)) * 0x9e3779b1u) % ThreadPageTable::kSize;
+  }
+
+  void init(uint64_t budget) {
+    cleanup();
+
+    if (budget == 0) {
+      return;
+    }
+
+    uint64_t page_count = std::max(TextureCache::kMinPageCount, budget / TextureCache::kPageSize);
+    page_memory.resize(page_count * TextureCache::kPageSize);
+    slot_keys = std::vector<std::atomic<uint64_t>>(page_count);
+    slot_last_use = std::vector<std::atomic<uint64_t>>(page_count);
+    slots.resize(page_count);
+    for (uint32_t i = 0; i < page_count; ++i) {
+      push_front(i);
+    }
+  }
+
+  void cleanup() {
+    std::scoped_lock lock(slow_path_lock);
+    for (auto& stream : streams) {
+      stream.file.close();
+      stream.source = kInvalidIndex;
+      stream.last_use = 0;
+    }
+    sources.clear();
+    page_map.clear();
+    page_memory.clear();
+    page_memory.shrink_to_fit();
+    slot_keys.clear();
+    slot_last_use.clear();
+    slots.clear();
+    lru_head = kInvalidIndex;
+    lru_tail = kInvalidIndex;
+    tick = 0;
+  }
+
+  uint32_t add_source(const char* file_name, uint64_t data_offset, uint64_t data_size) {
+    std::scoped_lock lock(slow_path_lock);
+    uint32_t index = static_cast<uint32_t>(sources.size());
+    auto& source = sources.emplace_back();
+    source.data_offset = data_offset;
+    source.data_size = data_size;
+    if (std::ifstream(file_name, std::ios::binary | std::ios::in).is_open()) {
+      source.file_name = file_name;
+    } else {
+      log::error("Failed to open texture cache file: %s", file_name);
+    }
+    return index;
+  }
+
+  void remove_source(uint32_t index) {
+    std::scoped_lock lock(slow_path_lock);
+    if (index >= sources.size()) {
+      return;
+    }
+
+    auto& source = sources[index];
+    if (source.stream != kInvalidIndex) {
+      streams[source.stream].file.close();
+      streams[source.stream].source = kInvalidIndex;
+      streams[source.stream].last_use = 0;
+      source.stream = kInvalidIndex;
+    }
+    source.file_name.clear();
+
+    for (uint32_t i = 0, e = static_cast<uint32_t>(slots.size()); i < e; ++i) {
+      if ((slots[i].key != 0) && (key_source(slots[i].key) == index)) {
+        slot_keys[i].store(0, std::memory_order_release);
+        page_map.erase(slots[i].key);
+        slots[i].key = 0;
+      }
+    }
+  }
+
+  void read(uint32_t source, uint64_t offset, uint32_t size, void* target) {
+    ETX_ASSERT((offset % TextureCache::kPageSize) + size <= TextureCache::kPageSize);
+
+    const uint64_t page = offset / TextureCache::kPageSize;
+    const uint64_t page_offset = offset % TextureCache::kPageSize;
+    const uint64_t key = page_key(source, page);
+
+    auto& entry = thread_pages.entries[thread_table_index(key)];
+    if ((entry.owner == this) && (entry.key == key) && (entry.slot < slots.size())) {
+      auto& slot_key = slot_keys[entry.slot];
+      if (slot_key.load(std::memory_order_acquire) == key) {
+        memcpy(target, page_memory.data() + entry.slot * TextureCache::kPageSize + page_offset, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot_key.load(std::memory_order_relaxed) == key) {
+          touch(entry.slot);
+          return;
+        }
+      }
+    }
+
+    std::scoped_lock lock(slow_path_lock);
+    uint32_t slot = kInvalidIndex;
+    auto i = page_map.find(key);
+    if (i == page_map.end()) {
+      slot = evict();
+      load_page(slot, source, page, key);
+    } else {
+      slot = i->second;
+    }
+
+    uint64_t t = tick.fetch_add(1u, std::memory_order_relaxed) + 1u;
+    slot_last_use[slot].store(t, std::memory_order_relaxed);
+    slots[slot].queued_tick = t;
+    unlink(slot);
+    push_front(slot);
+
+    memcpy(target, page_memory.data() + slot * TextureCache::kPageSize + page_offset, size);
+    entry = {this, key, slot};
+  }
+
+  void touch(uint32_t slot) {
+    uint64_t t = tick.load(std::memory_order_relaxed);
+    if (slot_last_use[slot].load(std::memory_order_relaxed) != t) {
+      slot_last_use[slot].store(t, std::memory_order_relaxed);
+    }
+  }
+
+  /*
+   * pages hit since they were queued are moved to the front with their latest use,
+   * so the first page reaching the back unchanged is the least recently used one
+   */
+  uint32_t evict() {
+    for (;;) {
+      uint32_t slot = lru_tail;
+      uint64_t last_use = slot_last_use[slot].load(std::memory_order_relaxed);
+      if (last_use <= slots[slot].queued_tick) {
+        return slot;
+      }
+      slots[slot].queued_tick = last_use;
+      unlink(slot);
+      push_front(slot);
+    }
+  }
+
+  void load_page(uint32_t slot, uint32_t source_index, uint64_t page, uint64_t key) {
+    if (slots[slot].key != 0) {
+      page_map.erase(slots[slot].key);
+    }
+    slot_keys[slot].store(0, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint8_t* data = page_memory.data() + slot * TextureCache::kPageSize;
+    auto& source = sources[source_index];
+    uint64_t begin = page * TextureCache::kPageSize;
+    uint64_t size = (begin < source.data_size) ? std::min(TextureCache::kPageSize, source.data_size - begin) : 0llu;
+    std::ifstream* stream = (size > 0) ? open_stream(source_index) : nullptr;
+    if (stream != nullptr) {
+      stream->clear();
+      stream->seekg(static_cast<std::streamoff>(source.data_offset + begin));
+      stream->read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size));
+    } else {
+      size = 0;
+    }
+    memset(data + size, 0, TextureCache::kPageSize - size);
+
+    slots[slot].key = key;
+    page_map[key] = slot;
+    slot_keys[slot].store(key, std::memory_order_release);
+  }
+
+  std::ifstream* open_stream(uint32_t source_index) {
+    auto& source = sources[source_index];
+    if (source.file_name.empty()) {
+      return nullptr;
+    }
+
+    uint64_t t = ++stream_tick;
+    if (source.stream != kInvalidIndex) {
+      streams[source.stream].last_use = t;
+      return &streams[source.stream].file;
+    }
+
+    uint32_t index = 0;
+    for (uint32_t i = 1; i < kMaxOpenStreams; ++i) {
+      if (streams[i].last_use < streams[index].last_use) {
+        index = i;
+      }
+    }
+
+    auto& stream = streams[index];
+    if (stream.source != kInvalidIndex) {
+      sources[stream.source].stream = kInvalidIndex;
+      stream.file.close();
+    }
+
+    stream.file.open(source.file_name, std::ios::binary | std::ios::in);
+    if (stream.file.is_open() == false) {
+      log::error("Failed to open texture cache file: %s", source.file_name.c_str());
+      stream.source = kInvalidIndex;
+      stream.last_use = 0;
+      return nullptr;
+    }
+
+    stream.source = source_index;
+    stream.last_use = t;
+    source.stream = index;
+    return &stream.file;
+  }
+
+  void unlink(uint32_t slot) {
+    auto& s = slots[slot];
+    (s.prev == kInvalidIndex ? lru_head : slots[s.prev].next) = s.next;
+    (s.next == kInvalidIndex ? lru_tail : slots[s.next].prev) = s.prev;
+    s.prev = kInvalidIndex;
+    s.next = kInvalidIndex;
+  }
+
+  void push_front(uint32_t slot) {
+    slots[slot].prev = kInvalidIndex;
+    slots[slot].next = lru_head;
+    (lru_head == kInvalidIndex ? lru_tail : slots[lru_head].prev) = slot;
+    lru_head = slot;
+  }
+
+  std::vector<Source> sources;
+  std::vector<Stream> streams = std::vector<Stream>(kMaxOpenStreams);
+  uint64_t stream_tick = 0;
+  std::unordered_map<uint64_t, uint32_t> page_map;
+  std::vector<uint8_t> page_memory;
+  std::vector<std::atomic<uint64_t>> slot_keys;
+  std::vector<std::atomic<uint64_t>> slot_last_use;
+  std::vector<Slot> slots;
+  std::mutex slow_path_lock;
+  std::atomic<uint64_t> tick = {};
+  uint32_t lru_head = kInvalidIndex;
+  uint32_t lru_tail = kInvalidIndex;
+};
+
+ETX_PIMPL_IMPLEMENT_ALL(TextureCache, Impl);
+
+void TextureCache::init(uint64_t budget) {
+  _private->init(budget);
+}
+
+void TextureCache::cleanup() {
+  _private->cleanup();
+}
+
+bool TextureCache::enabled() const {
+  return _private->slots.empty() == false;
+}
+
+uint32_t TextureCache::add_source(const char* file_name, uint64_t data_offset, uint64_t data_size) {
+  return _private->add_source(file_name, data_offset, data_size);
+}
+
+void TextureCache::remove_source(uint32_t source) {
+  _private->remove_source(source);
+}
+
+void TextureCache::read(uint32_t source, uint64_t offset, uint32_t size, void* target) {
+  _private->read(source, offset, size, target);
+}
+
+void texture_cache_read(TextureCache* cache, uint32_t source, uint64_t offset, uint32_t size, void* target) {
+  ETX_ASSERT(cache != nullptr);
+  cache->read(source, offset, size, target);
+}
+
+}  // namespace etx
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <etx/core/pimpl.hxx>
+
+#include <stdint.h>
+
+namespace etx {
+
+/*
+ * pages of streamed images are read on demand from cache files into a fixed number of slots,
+ * least recently used pages are replaced when the budget is exhausted;
+ * lookups of resident pages go through a per-thread table and do not take locks
+ */
+struct TextureCache {
+  static constexpr uint64_t kPageSize = 64llu * 1024llu;
+  static constexpr uint64_t kMinPageCount = 64llu;
+
+  TextureCache();
+  ~TextureCache();
+
+  void init(uint64_t budget);
+  void cleanup();
+
+  bool enabled() const;
+
+  uint32_t add_source(const char* file_name, uint64_t data_offset, uint64_t data_size);
+  void remove_source(uint32_t source);
+
+  /*
+   * copies `size` bytes at `offset` of the source data, the range should not cross a page boundary
+   */
+  void read(uint32_t source, uint64_t offset, uint32_t size, void* target);
+
+  ETX_DECLARE_PIMPL(TextureCache, 512);
+};
+
+}  // namespace etx
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <etx/render/shared/base.hxx>
+
+namespace etx {
+
+/*
+ * decoding of single texels from 4x4 BCn blocks, texels inside a block are numbered row by row;
+ * BC1 and BC4 blocks take one 64-bit word, BC5 and BC6H blocks take two
+ */
+namespace bcn {
+
+constexpr uint32_t kBlockSize = 4u;
+constexpr uint32_t kBC6HMode11 = 0x03u;  // single region, 10-bit endpoints without transform
+
+ETX_GPU_CODE float3 decode_565(uint32_t c) {
+  return {
+    float((c >> 11u) & 0x1fu) / 31.0f,
+    float((c >> 5u) & 0x3fu) / 63.0f,
+    float(c & 0x1fu) / 31.0f,
+  };
+}
+
+ETX_GPU_CODE float4 decode_bc1(const uint64_t* block, uint32_t texel) {
+  uint32_t c0 = static_cast<uint32_t>(block[0] & 0xffffu);
+  uint32_t c1 = static_cast<uint32_t>((block[0] >> 16u) & 0xffffu);
+  uint32_t index = static_cast<uint32_t>(block[0] >> (32u + 2u * texel)) & 0x3u;
+  float3 e0 = decode_565(c0);
+  float3 e1 = decode_565(c1);
+
+  if (index == 0) {
+    return to_float4(e0);
+  } else if (index == 1) {
+    return to_float4(e1);
+  } else if (c0 > c1) {
+    return to_float4(index == 2 ? (2.0f * e0 + e1) / 3.0f : (e0 + 2.0f * e1) / 3.0f);
+  }
+  return (index == 2) ? to_float4(0.5f * (e0 + e1)) : float4{};
+}
+
+ETX_GPU_CODE float decode_bc4(const uint64_t* block, uint32_t texel) {
+  uint32_t r0 = static_cast<uint32_t>(block[0] & 0xffu);
+  uint32_t r1 = static_cast<uint32_t>((block[0] >> 8u) & 0xffu);
+  uint32_t index = static_cast<uint32_t>(block[0] >> (16u + 3u * texel)) & 0x7u;
+
+  if (index == 0) {
+    return float(r0) / 255.0f;
+  } else if (index == 1) {
+    return float(r1) / 255.0f;
+  } else if (r0 > r1) {
+    return float((8u - index) * r0 + (index - 1u) * r1) / (7.0f * 255.0f);
+  } else if (index >= 6) {
+    return (index == 6) ? 0.0f : 1.0f;
+  }
+  return float((6u - index) * r0 + (index - 1u) * r1) / (5.0f * 255.0f);
+}
+
+ETX_GPU_CODE float2 decode_bc5(const uint64_t* block, uint32_t texel) {
+  return {decode_bc4(block + 0, texel), decode_bc4(block + 1, texel)};
+}
+
+ETX_GPU_CODE uint32_t read_bits(const uint64_t* block, uint32_t offset, uint32_t count) {
+  uint32_t shift = offset % 64u;
+  uint64_t value = block[offset / 64u] >> shift;
+  if ((shift > 0) && (shift + count > 64u)) {
+    value |= block[1] << (64u - shift);
+  }
+  return static_cast<uint32_t>(value & ((1llu << count) - 1llu));
+}
+
+ETX_GPU_CODE float half_to_float(uint32_t h) {
+  uint32_t exponent = (h >> 10u) & 0x1fu;
+  uint32_t mantissa = h & 0x3ffu;
+  return (exponent == 0) ? float(mantissa) * 5.9604644775390625e-8f : ldexpf(float(mantissa | 0x400u), int32_t(exponent) - 25);
+}
+
+ETX_GPU_CODE uint32_t bc6h_unquantize(uint32_t e) {
+  return (e == 0) ? 0u : ((e == 0x3ffu) ? 0xffffu : (((e << 16u) + 0x8000u) >> 10u));
+}
+
+ETX_GPU_CODE uint32_t bc6h_weight(uint32_t index) {
+  return (index * 64u + 7u) / 15u;
+}
+
+ETX_GPU_CODE uint32_t bc6h_interpolate(uint32_t e0, uint32_t e1, uint32_t weight) {
+  uint32_t value = (bc6h_unquantize(e0) * (64u - weight) + bc6h_unquantize(e1) * weight + 32u) >> 6u;
+  return (value * 31u) >> 6u;
+}
+
+/*
+ * unsigned BC6H, only the mode written by the encoder (mode 11) is supported
+ */
+ETX_GPU_CODE float4 decode_bc6h(const uint64_t* block, uint32_t texel) {
+  if (read_bits(block, 0u, 5u) != kBC6HMode11)
+    return {};
+
+  uint32_t index = (texel == 0) ? read_bits(block, 65u, 3u) : read_bits(block, 64u + 4u * texel, 4u);
+  uint32_t weight = bc6h_weight(index);
+
+  float4 result = {0.0f, 0.0f, 0.0f, 1.0f};
+  result.x = half_to_float(bc6h_interpolate(read_bits(block, 5u, 10u), read_bits(block, 35u, 10u), weight));
+  result.y = half_to_float(bc6h_interpolate(read_bits(block, 15u, 10u), read_bits(block, 45u, 10u), weight));
+  result.z = half_to_float(bc6h_interpolate(read_bits(block, 25u, 10u), read_bits(block, 55u, 10u), weight));
+  return result;
+}
+
+}  // namespace bcn
+
+}  // namespace etx
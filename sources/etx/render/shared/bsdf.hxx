@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <etx/render/shared/material.hxx>
+#include <etx/render/shared/image.hxx>
 #include <etx/render/shared/sampler.hxx>
 
 namespace etx {
@@ -230,6 +231,9 @@ struct NormalDistribution {
   float2 _alpha = {};
 };
 
+// resolution of the directional and average albedo table of the GGX distribution, see `microfacet_energy`
+constexpr uint32_t kMicrofacetEnergyTableSize = 32u;
+
 ETX_GPU_CODE float fix_shading_normal(const float3& n_g, const float3& n_s, const float3& w_i, const float3& w_o) {
   float w_i_g = dot(w_i, n_g);
   float w_i_s = dot(w_i, n_s);
@@ -305,6 +309,58 @@ ETX_GPU_CODE float fresnel_thinfilm(float wavelength, const float cos_theta_0, c
   return complex_abs(1.0f - ratio * 0.5f * (tp + ts));
 }
 
+/*
+ * reads precomputed reflectance of the thin film, `reversed` selects the part of the table built for light coming from the internal medium
+ */
+ETX_GPU_CODE float4 thinfilm_table_block(const Thinfilm::Eval& thinfilm, float cos_theta, uint32_t block, bool reversed) {
+  float x = saturate(cos_theta) * float(Thinfilm::kTableCosineSize - 1u);
+  float y = saturate(thinfilm.table_thickness) * float(Thinfilm::kTableThicknessSize - 1u);
+  y += float((block + (reversed ? Thinfilm::kTableBlockCount : 0u)) * Thinfilm::kTableThicknessSize);
+  return thinfilm.table->read({x, y});
+}
+
+ETX_GPU_CODE float thinfilm_table_wavelength(const Thinfilm::Eval& thinfilm, float wavelength, float cos_theta, bool reversed) {
+  float w = clamp((wavelength - spectrum::kShortestWavelength) / float(Thinfilm::kTableWavelengthStep), 0.0f, float(Thinfilm::kTableWavelengthCount - 1u));
+  uint32_t w0 = static_cast<uint32_t>(w);
+  uint32_t w1 = min(w0 + 1u, Thinfilm::kTableWavelengthCount - 1u);
+  float dw = w - float(w0);
+
+  float4 b0 = thinfilm_table_block(thinfilm, cos_theta, w0 / 4u, reversed);
+  float r0 = (&b0.x)[w0 % 4u];
+  if (dw == 0.0f)
+    return r0;
+
+  float4 b1 = (w1 / 4u == w0 / 4u) ? b0 : thinfilm_table_block(thinfilm, cos_theta, w1 / 4u, reversed);
+  return lerp(r0, (&b1.x)[w1 % 4u], dw);
+}
+
+ETX_GPU_CODE SpectralResponse thinfilm_table(SpectralQuery spect, const Thinfilm::Eval& thinfilm, float cos_theta, bool reversed) {
+  if constexpr (spectrum::kSpectralRendering) {
+    return {
+      spect.wavelength,
+      {
+        thinfilm_table_wavelength(thinfilm, spectrum::lane_wavelength(spect.wavelength, 0u), cos_theta, reversed),
+        thinfilm_table_wavelength(thinfilm, spectrum::lane_wavelength(spect.wavelength, 1u), cos_theta, reversed),
+        thinfilm_table_wavelength(thinfilm, spectrum::lane_wavelength(spect.wavelength, 2u), cos_theta, reversed),
+      },
+    };
+  } else {
+    float4 value = thinfilm_table_block(thinfilm, cos_theta, 0u, reversed);
+    return {spect.wavelength, {value.x, value.y, value.z}};
+  }
+}
+
+/*
+ * table is built for the material's external and internal media, callers pass the medium light comes from as `ext_ior`
+ * (dielectric BSDFs swap the media for paths inside the material), so the second half of the table is used when `ext_ior`
+ * matches the internal medium; the closest match is taken instead of equality because `table_eta` holds values at 550 nm
+ * while dispersive media are queried at the path's wavelength
+ */
+ETX_GPU_CODE bool thinfilm_table_reversed(const Thinfilm::Eval& thinfilm, const RefractiveIndex::Sample& ext_ior) {
+  float eta = ext_ior.eta.monochromatic();
+  return fabsf(eta - thinfilm.table_eta.y) < fabsf(eta - thinfilm.table_eta.x);
+}
+
 ETX_GPU_CODE SpectralResponse conductor(SpectralQuery spect, const float3& i, const float3& m, const RefractiveIndex::Sample& ext_ior, const RefractiveIndex::Sample& int_ior,
   const Thinfilm::Eval& thinfilm) {
   ETX_ASSERT(spect.wavelength == ext_ior.wavelength);
@@ -313,16 +369,23 @@ ETX_GPU_CODE SpectralResponse conductor(SpectralQuery spect, const float3& i, co
   float cos_theta = fabsf(dot(i, m));
   if (thinfilm.thickness == 0.0f) {
     SpectralResponse result = {spect.wavelength, fresnel_generic(cos_theta, ext_ior.as_complex_x(), int_ior.as_complex_x())};
-    if constexpr (spectrum::kSpectralRendering == false) {
-      result.components.y = fresnel_generic(cos_theta, ext_ior.as_complex_y(), int_ior.as_complex_y());
-      result.components.z = fresnel_generic(cos_theta, ext_ior.as_complex_z(), int_ior.as_complex_z());
-    }
+    result.components.y = fresnel_generic(cos_theta, ext_ior.as_complex_y(), int_ior.as_complex_y());
+    result.components.z = fresnel_generic(cos_theta, ext_ior.as_complex_z(), int_ior.as_complex_z());
     return result;
   }
 
+  if (thinfilm.table != nullptr) {
+    return thinfilm_table(spect, thinfilm, cos_theta, false);
+  }
+
   SpectralResponse result = {spect.wavelength, 0.0f};
   if constexpr (spectrum::kSpectralRendering) {
-    result.components.x = fresnel_thinfilm(spect.wavelength, cos_theta, ext_ior.as_complex_x(), thinfilm.ior.as_complex_x(), int_ior.as_complex_x(), thinfilm.thickness);
+    float w0 = spectrum::lane_wavelength(spect.wavelength, 0u);
+    float w1 = spectrum::lane_wavelength(spect.wavelength, 1u);
+    float w2 = spectrum::lane_wavelength(spect.wavelength, 2u);
+    result.components.x = fresnel_thinfilm(w0, cos_theta, ext_ior.as_complex_x(), thinfilm.ior.as_complex_x(), int_ior.as_complex_x(), thinfilm.thickness);
+    result.components.y = fresnel_thinfilm(w1, cos_theta, ext_ior.as_complex_y(), thinfilm.ior.as_complex_y(), int_ior.as_complex_y(), thinfilm.thickness);
+    result.components.z = fresnel_thinfilm(w2, cos_theta, ext_ior.as_complex_z(), thinfilm.ior.as_complex_z(), int_ior.as_complex_z(), thinfilm.thickness);
   } else {
     result.components.x = fresnel_thinfilm(690.0f, cos_theta, ext_ior.as_complex_x(), thinfilm.ior.as_complex_x(), int_ior.as_complex_x(), thinfilm.thickness);
     result.components.y = fresnel_thinfilm(550.0f, cos_theta, ext_ior.as_complex_y(), thinfilm.ior.as_complex_y(), int_ior.as_complex_y(), thinfilm.thickness);
@@ -334,6 +397,36 @@ ETX_GPU_CODE SpectralResponse conductor(SpectralQuery spect, const float3& i, co
 ETX_GPU_CODE SpectralResponse dielectric(SpectralQuery spect, const float3& i, const float3& m, const RefractiveIndex::Sample ext_ior, const RefractiveIndex::Sample int_ior,
   const Thinfilm::Eval& thinfilm) {
   float cos_theta = fabsf(dot(i, m));
+
+  if ((thinfilm.table != nullptr) && (thinfilm.thickness > 0.0f)) {
+    return thinfilm_table(spect, thinfilm, cos_theta, thinfilm_table_reversed(thinfilm, ext_ior));
+  }
+
+  if constexpr (spectrum::kSpectralRendering) {
+    if (thinfilm.thickness == 0.0f) {
+      return {
+        spect.wavelength,
+        {
+          fresnel_generic(cos_theta, ext_ior.as_complex_x(), int_ior.as_complex_x()),
+          fresnel_generic(cos_theta, ext_ior.as_complex_y(), int_ior.as_complex_y()),
+          fresnel_generic(cos_theta, ext_ior.as_complex_z(), int_ior.as_complex_z()),
+        },
+      };
+    }
+
+    float w0 = spectrum::lane_wavelength(spect.wavelength, 0u);
+    float w1 = spectrum::lane_wavelength(spect.wavelength, 1u);
+    float w2 = spectrum::lane_wavelength(spect.wavelength, 2u);
+    return {
+      spect.wavelength,
+      {
+        fresnel_thinfilm(w0, cos_theta, ext_ior.as_complex_x(), thinfilm.ior.as_complex_x(), int_ior.as_complex_x(), thinfilm.thickness),
+        fresnel_thinfilm(w1, cos_theta, ext_ior.as_complex_y(), thinfilm.ior.as_complex_y(), int_ior.as_complex_y(), thinfilm.thickness),
+        fresnel_thinfilm(w2, cos_theta, ext_ior.as_complex_z(), thinfilm.ior.as_complex_z(), int_ior.as_complex_z(), thinfilm.thickness),
+      },
+    };
+  }
+
   auto c_e = ext_ior.as_monochromatic_complex();
   auto c_i = int_ior.as_monochromatic_complex();
   if (thinfilm.thickness == 0.0f) {
@@ -343,13 +436,9 @@ ETX_GPU_CODE SpectralResponse dielectric(SpectralQuery spect, const float3& i, c
   auto c_f = thinfilm.ior.as_monochromatic_complex();
 
   SpectralResponse result = {spect.wavelength, 0.0f};
-  if constexpr (spectrum::kSpectralRendering) {
-    result.components.x = fresnel_thinfilm(spect.wavelength, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
-  } else {
-    result.components.x = fresnel_thinfilm(690.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
-    result.components.y = fresnel_thinfilm(550.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
-    result.components.z = fresnel_thinfilm(430.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
-  }
+  result.components.x = fresnel_thinfilm(690.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
+  result.components.y = fresnel_thinfilm(550.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
+  result.components.z = fresnel_thinfilm(430.0f, cos_theta, c_e, c_f, c_i, thinfilm.thickness);
   return result;
 }
 
@@ -5,7 +5,7 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
   auto frame = data.get_normal_frame();
   auto thinfilm = evaluate_thinfilm(data.spectrum_sample, mtl.thinfilm, data.tex, scene);
   auto f = fresnel::conductor(data.spectrum_sample, data.w_i, frame.nrm, mtl.ext_ior(data.spectrum_sample), mtl.int_ior(data.spectrum_sample), thinfilm);
-  auto specular = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+  auto specular = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
 
   BSDFSample result;
   result.w_o = normalize(reflect(data.w_i, frame.nrm));
@@ -26,6 +26,95 @@ ETX_GPU_CODE float pdf(const BSDFData& data, const float3& w_o, const Material&
 
 }  // namespace DeltaConductorBSDF
 
+/*
+ * single scattering GGX reflection with tabulated multiple scattering compensation,
+ * deterministic alternative to the random walk on the microsurface
+ */
+namespace CompensatedConductorBSDF {
+
+ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Material& mtl, const Scene& scene, Sampler& smp) {
+  auto frame = data.get_normal_frame();
+
+  float n_dot_o = dot(frame.nrm, w_o);
+  float n_dot_i = -dot(frame.nrm, data.w_i);
+
+  float3 m = normalize(w_o - data.w_i);
+  float m_dot_o = dot(m, w_o);
+
+  if ((n_dot_o <= kEpsilon) || (n_dot_i <= kEpsilon) || (m_dot_o <= kEpsilon)) {
+    return {data.spectrum_sample.wavelength, 0.0f};
+  }
+
+  auto ext_ior = mtl.ext_ior(data.spectrum_sample);
+  auto int_ior = mtl.int_ior(data.spectrum_sample);
+  auto thinfilm = evaluate_thinfilm(data.spectrum_sample, mtl.thinfilm, data.tex, scene);
+  auto fr = fresnel::conductor(data.spectrum_sample, data.w_i, m, ext_ior, int_ior, thinfilm);
+  auto f0 = fresnel::conductor(data.spectrum_sample, frame.nrm, frame.nrm, ext_ior, int_ior, thinfilm);
+  auto f_avg = (20.0f * f0 + 1.0f) / 21.0f;
+
+  auto ggx = NormalDistribution(frame, mtl.roughness);
+  auto eval = ggx.evaluate(m, data.w_i, w_o);
+  auto e_i = microfacet_energy(n_dot_i, mtl.roughness, scene);
+  auto e_o = microfacet_energy(n_dot_o, mtl.roughness, scene);
+  float p_ms = 1.0f - e_i.x;
+
+  auto specular = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
+
+  BSDFEval result;
+  result.func = specular * (fr * (eval.ndf * eval.visibility / (4.0f * n_dot_i * n_dot_o)) + microfacet_compensation(f_avg, e_i.x, e_o.x, e_i.y));
+  ETX_VALIDATE(result.func);
+  result.bsdf = result.func * n_dot_o;
+  ETX_VALIDATE(result.bsdf);
+  result.pdf = (1.0f - p_ms) * eval.pdf / (4.0f * m_dot_o) + p_ms * kInvPi * n_dot_o;
+  ETX_VALIDATE(result.pdf);
+  result.weight = result.bsdf / result.pdf;
+  ETX_VALIDATE(result.weight);
+  return result;
+}
+
+ETX_GPU_CODE float pdf(const BSDFData& data, const float3& w_o, const Material& mtl, const Scene& scene, Sampler& smp) {
+  auto frame = data.get_normal_frame();
+
+  float n_dot_o = dot(frame.nrm, w_o);
+  float n_dot_i = -dot(frame.nrm, data.w_i);
+
+  float3 m = normalize(w_o - data.w_i);
+  float m_dot_o = dot(m, w_o);
+
+  if ((n_dot_o <= kEpsilon) || (n_dot_i <= kEpsilon) || (m_dot_o <= kEpsilon)) {
+    return 0.0f;
+  }
+
+  auto ggx = NormalDistribution(frame, mtl.roughness);
+  float p_ms = 1.0f - microfacet_energy(n_dot_i, mtl.roughness, scene).x;
+  float result = (1.0f - p_ms) * ggx.pdf(m, data.w_i, w_o) / (4.0f * m_dot_o) + p_ms * kInvPi * n_dot_o;
+  ETX_VALIDATE(result);
+  return result;
+}
+
+ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const Scene& scene, Sampler& smp) {
+  auto frame = data.get_normal_frame();
+
+  float n_dot_i = -dot(frame.nrm, data.w_i);
+  float p_ms = 1.0f - microfacet_energy(n_dot_i, mtl.roughness, scene).x;
+
+  float3 w_o = {};
+  if (smp.next() < p_ms) {
+    w_o = sample_cosine_distribution(smp.next_2d(), frame.nrm, 1.0f);
+  } else {
+    auto ggx = NormalDistribution(frame, mtl.roughness);
+    auto m = ggx.sample(smp, data.w_i);
+    w_o = normalize(reflect(data.w_i, m));
+  }
+
+  BSDFSample result = {w_o, evaluate(data, w_o, mtl, scene, smp), BSDFSample::Reflection};
+  result.medium_index = data.medium_index;
+  result.eta = 1.0f;
+  return result;
+}
+
+}  // namespace CompensatedConductorBSDF
+
 namespace ConductorBSDF {
 
 ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const Scene& scene, Sampler& smp) {
@@ -33,6 +122,10 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     return DeltaConductorBSDF::sample(data, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedConductorBSDF::sample(data, mtl, scene, smp);
+  }
+
   auto frame = data.get_normal_frame();
 
   LocalFrame local_frame(frame);
@@ -52,7 +145,7 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     result.pdf = external::D_ggx(normalize(result.w_o + w_i), alpha_x, alpha_y) / (1.0f + ray.Lambda) / (4.0f * w_i.z) + result.w_o.z;
     ETX_VALIDATE(result.pdf);
   }
-  result.weight *= apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+  result.weight *= apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
   ETX_VALIDATE(result.weight);
 
   result.w_o = normalize(local_frame.from_local(result.w_o));
@@ -64,6 +157,10 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& in_w_o, const
     return DeltaConductorBSDF::evaluate(data, in_w_o, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedConductorBSDF::evaluate(data, in_w_o, mtl, scene, smp);
+  }
+
   auto frame = data.get_normal_frame();
 
   LocalFrame local_frame(frame);
@@ -90,7 +187,7 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& in_w_o, const
     result.bsdf = 2.0f * external::eval_conductor(data.spectrum_sample, smp, w_o, w_i, alpha_x, alpha_y, ext_ior, int_ior, thinfilm) / w_i.z * w_o.z;
     ETX_VALIDATE(result.bsdf);
   }
-  result.bsdf *= apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+  result.bsdf *= apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
   ETX_VALIDATE(result.bsdf);
 
   result.func = result.bsdf / w_o.z;
@@ -113,6 +210,10 @@ ETX_GPU_CODE float pdf(const BSDFData& data, const float3& in_w_o, const Materia
     return DeltaConductorBSDF::pdf(data, in_w_o, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedConductorBSDF::pdf(data, in_w_o, mtl, scene, smp);
+  }
+
   auto frame = data.get_normal_frame();
 
   LocalFrame local_frame(frame);
@@ -19,7 +19,7 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     result.w_o = normalize(reflect(data.w_i, frame.nrm));
     result.pdf = f;
     ETX_VALIDATE(result.pdf);
-    result.weight = (fr / f) * apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+    result.weight = (fr / f) * apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
     ETX_VALIDATE(result.weight);
     result.properties = BSDFSample::Delta | BSDFSample::Reflection;
     result.medium_index = frame.entering_material() ? mtl.ext_medium : mtl.int_medium;
@@ -32,7 +32,10 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     result.pdf = 1.0f - f;
     ETX_VALIDATE(result.pdf);
 
-    result.weight = (1.0f - fr) / (1.0f - f) * apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene);
+    result.weight = (1.0f - fr) / (1.0f - f) * apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint);
+    if (ior_i.dispersive() || ior_o.dispersive()) {
+      result.weight = result.weight.collapse_to_hero();
+    }
     ETX_VALIDATE(result.weight);
 
     result.properties = BSDFSample::Delta | BSDFSample::Transmission | BSDFSample::MediumChanged;
@@ -71,14 +74,14 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     }
     result.w_o = normalize(result.w_o);
     result.pdf = f;
-    result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+    result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
     result.weight *= (fr / f);
     result.properties = BSDFSample::Delta | BSDFSample::Reflection;
     result.medium_index = frame.entering_material() ? mtl.ext_medium : mtl.int_medium;
   } else {
     result.w_o = data.w_i;
     result.pdf = 1.0f - f;
-    result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene);
+    result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint);
     result.weight *= (1.0f - fr) / (1.0f - f);
     result.properties = BSDFSample::Delta | BSDFSample::Transmission | BSDFSample::MediumChanged;
     result.medium_index = frame.entering_material() ? mtl.int_medium : mtl.ext_medium;
@@ -101,6 +104,141 @@ ETX_GPU_CODE bool is_delta(const Material& material, const float2& tex, const Sc
 
 }  // namespace ThinfilmBSDF
 
+/*
+ * single scattering rough dielectric (Walter et al.) with tabulated multiple scattering compensation,
+ * missing energy is distributed between reflection and transmission using average Fresnel
+ */
+namespace CompensatedDielectricBSDF {
+
+// hemispherical average of the dielectric Fresnel term for relative index of refraction, fit by d'Eon
+ETX_GPU_CODE float average_fresnel(float eta) {
+  if (eta >= 1.0f) {
+    return (eta - 1.0f) / (4.08567f + 1.00071f * eta);
+  }
+  return 0.997118f + 0.1014f * eta - 0.965241f * eta * eta - 0.130607f * eta * eta * eta;
+}
+
+ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Material& mtl, const Scene& scene, Sampler& smp) {
+  auto frame = data.get_normal_frame();
+
+  float n_dot_i = -dot(frame.nrm, data.w_i);
+  float n_dot_o = dot(frame.nrm, w_o);
+  if ((n_dot_i <= kEpsilon) || (fabsf(n_dot_o) <= kEpsilon)) {
+    return {data.spectrum_sample.wavelength, 0.0f};
+  }
+
+  auto ior_i = (frame.entering_material() ? mtl.ext_ior : mtl.int_ior)(data.spectrum_sample);
+  auto ior_o = (frame.entering_material() ? mtl.int_ior : mtl.ext_ior)(data.spectrum_sample);
+  float eta = ior_o.eta.monochromatic() / ior_i.eta.monochromatic();
+
+  bool reflection = n_dot_o > 0.0f;
+  float3 m = normalize(reflection ? (w_o - data.w_i) : (w_o * eta - data.w_i));
+  m *= (dot(m, frame.nrm) >= 0.0f) ? 1.0f : -1.0f;
+
+  float m_dot_i = -dot(m, data.w_i);
+  float m_dot_o = dot(m, w_o);
+  if ((m_dot_i <= kEpsilon) || (reflection ? (m_dot_o <= kEpsilon) : (m_dot_o >= -kEpsilon))) {
+    return {data.spectrum_sample.wavelength, 0.0f};
+  }
+
+  auto thinfilm = evaluate_thinfilm(data.spectrum_sample, mtl.thinfilm, data.tex, scene);
+  auto fr = fresnel::dielectric(data.spectrum_sample, data.w_i, m, ior_i, ior_o, thinfilm);
+  float f = fr.monochromatic();
+
+  auto ggx = NormalDistribution(frame, mtl.roughness);
+  auto eval = ggx.evaluate(m, data.w_i, w_o);
+  auto e_i = microfacet_energy(n_dot_i, mtl.roughness, scene);
+  auto e_o = microfacet_energy(fabsf(n_dot_o), mtl.roughness, scene);
+  float p_ms = 1.0f - e_i.x;
+  float f_avg = average_fresnel(eta);
+
+  SpectralResponse single_scattering = {};
+  SpectralResponse multiple_scattering = microfacet_compensation({data.spectrum_sample.wavelength, 1.0f}, e_i.x, e_o.x, e_i.y);
+  float pdf_single = 0.0f;
+  float pdf_multiple = p_ms * kInvPi * fabsf(n_dot_o);
+
+  if (reflection) {
+    single_scattering = fr * (eval.ndf * eval.visibility / (4.0f * n_dot_i * n_dot_o));
+    multiple_scattering *= f_avg;
+    pdf_single = f * eval.pdf / (4.0f * m_dot_o);
+    pdf_multiple *= f_avg;
+  } else {
+    float denom = sqr(m_dot_i + eta * m_dot_o);
+    float scale = (data.path_source == PathSource::Camera) ? 1.0f : sqr(eta);
+    single_scattering = (1.0f - fr) * (scale * eval.ndf * eval.visibility * m_dot_i * fabsf(m_dot_o) / (n_dot_i * fabsf(n_dot_o) * denom));
+    multiple_scattering *= (1.0f - f_avg) * scale;
+    pdf_single = (1.0f - f) * eval.pdf * sqr(eta) * fabsf(m_dot_o) / denom;
+    pdf_multiple *= 1.0f - f_avg;
+  }
+
+  auto tint = apply_image(data.spectrum_sample, reflection ? mtl.specular : mtl.transmittance, data.tex, scene, data.tex_footprint);
+
+  BSDFEval result;
+  result.func = tint * (single_scattering + multiple_scattering);
+  ETX_VALIDATE(result.func);
+  result.bsdf = result.func * fabsf(n_dot_o);
+  ETX_VALIDATE(result.bsdf);
+  result.pdf = (1.0f - p_ms) * pdf_single + pdf_multiple;
+  ETX_VALIDATE(result.pdf);
+  result.weight = result.bsdf / result.pdf;
+  ETX_VALIDATE(result.weight);
+  result.eta = reflection ? 1.0f : eta;
+  if ((reflection == false) && (ior_i.dispersive() || ior_o.dispersive())) {
+    result.func = result.func.collapse_to_hero();
+    result.bsdf = result.bsdf.collapse_to_hero();
+    result.weight = result.weight.collapse_to_hero();
+  }
+  return result;
+}
+
+ETX_GPU_CODE float pdf(const BSDFData& data, const float3& w_o, const Material& mtl, const Scene& scene, Sampler& smp) {
+  return evaluate(data, w_o, mtl, scene, smp).pdf;
+}
+
+ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const Scene& scene, Sampler& smp) {
+  auto frame = data.get_normal_frame();
+
+  auto ior_i = (frame.entering_material() ? mtl.ext_ior : mtl.int_ior)(data.spectrum_sample);
+  auto ior_o = (frame.entering_material() ? mtl.int_ior : mtl.ext_ior)(data.spectrum_sample);
+  float eta = ior_o.eta.monochromatic() / ior_i.eta.monochromatic();
+
+  float n_dot_i = -dot(frame.nrm, data.w_i);
+  float p_ms = 1.0f - microfacet_energy(n_dot_i, mtl.roughness, scene).x;
+
+  float3 w_o = {};
+  if (smp.next() < p_ms) {
+    w_o = sample_cosine_distribution(smp.next_2d(), frame.nrm, 1.0f);
+    w_o *= (smp.next() < average_fresnel(eta)) ? 1.0f : -1.0f;
+  } else {
+    auto ggx = NormalDistribution(frame, mtl.roughness);
+    auto m = ggx.sample(smp, data.w_i);
+    auto thinfilm = evaluate_thinfilm(data.spectrum_sample, mtl.thinfilm, data.tex, scene);
+    float f = fresnel::dielectric(data.spectrum_sample, data.w_i, m, ior_i, ior_o, thinfilm).monochromatic();
+
+    float cos_theta_i = -dot(m, data.w_i);
+    float sin_theta_o_squared = (1.0f - cos_theta_i * cos_theta_i) / sqr(eta);
+    if ((smp.next() < f) || (sin_theta_o_squared >= 1.0f)) {
+      w_o = normalize(reflect(data.w_i, m));
+    } else {
+      float cos_theta_o = sqrtf(1.0f - sin_theta_o_squared);
+      w_o = normalize(data.w_i / eta + m * (cos_theta_i / eta - cos_theta_o));
+    }
+  }
+
+  bool reflection = dot(frame.nrm, w_o) > 0.0f;
+  uint32_t properties = reflection ? uint32_t(BSDFSample::Reflection) : (BSDFSample::Transmission | BSDFSample::MediumChanged);
+
+  BSDFSample result = {w_o, evaluate(data, w_o, mtl, scene, smp), properties};
+  if (reflection) {
+    result.medium_index = frame.entering_material() ? mtl.ext_medium : mtl.int_medium;
+  } else {
+    result.medium_index = frame.entering_material() ? mtl.int_medium : mtl.ext_medium;
+  }
+  return result;
+}
+
+}  // namespace CompensatedDielectricBSDF
+
 namespace DielectricBSDF {
 
 ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const Scene& scene, Sampler& smp) {
@@ -108,6 +246,10 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     return DeltaDielectricBSDF::sample(data, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedDielectricBSDF::sample(data, mtl, scene, smp);
+  }
+
   LocalFrame local_frame = {data.tan, data.btn, data.nrm};
   auto w_i = local_frame.to_local(-data.w_i);
   auto ext_ior = mtl.ext_ior(data.spectrum_sample);
@@ -132,14 +274,17 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
     if (LocalFrame::cos_theta(result.w_o) > 0) {
       // reflection
       result.eta = 1.0f;
-      result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+      result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
       result.properties = BSDFSample::Reflection;
       result.medium_index = mtl.ext_medium;
     } else {
       // refraction
       result.eta = m_eta;
       float factor = (data.path_source == PathSource::Camera) ? sqr(m_invEta) : 1.0f;
-      result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene) * factor;
+      result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint) * factor;
+      if (ext_ior.dispersive() || int_ior.dispersive()) {
+        result.weight = result.weight.collapse_to_hero();
+      }
       result.properties = BSDFSample::Transmission | BSDFSample::MediumChanged;
       result.medium_index = mtl.int_medium;
     }
@@ -158,13 +303,16 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
       // refraction
       result.eta = m_invEta;
       float factor = (data.path_source == PathSource::Camera) ? sqr(m_eta) : 1.0f;
-      result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene) * factor;
+      result.weight = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint) * factor;
+      if (ext_ior.dispersive() || int_ior.dispersive()) {
+        result.weight = result.weight.collapse_to_hero();
+      }
       result.properties = BSDFSample::Transmission | BSDFSample::MediumChanged;
       result.medium_index = mtl.ext_medium;
     } else {
       // reflection
       result.eta = 1.0f;
-      result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+      result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
       result.properties = BSDFSample::Reflection;
       result.medium_index = mtl.int_medium;
     }
@@ -179,6 +327,10 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& in_w_o, const
     return DeltaDielectricBSDF::evaluate(data, in_w_o, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedDielectricBSDF::evaluate(data, in_w_o, mtl, scene, smp);
+  }
+
   LocalFrame local_frame = {data.tan, data.btn, data.nrm};
   auto w_i = local_frame.to_local(-data.w_i);
   if (LocalFrame::cos_theta(w_i) == 0)
@@ -220,12 +372,17 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& in_w_o, const
     return {data.spectrum_sample.wavelength, 0.0f};
 
   BSDFEval eval;
-  eval.func = apply_image(data.spectrum_sample, reflection ? mtl.specular : mtl.transmittance, data.tex, scene) * (2.0f * value);
+  eval.func = apply_image(data.spectrum_sample, reflection ? mtl.specular : mtl.transmittance, data.tex, scene, data.tex_footprint) * (2.0f * value);
   ETX_VALIDATE(eval.func);
   eval.bsdf = eval.func * fabsf(LocalFrame::cos_theta(w_o));
   eval.pdf = pdf(data, w_o, mtl, scene, smp);
   eval.weight = eval.bsdf / eval.pdf;
   ETX_VALIDATE(eval.weight);
+  if ((reflection == false) && (ext_ior.dispersive() || int_ior.dispersive())) {
+    eval.func = eval.func.collapse_to_hero();
+    eval.bsdf = eval.bsdf.collapse_to_hero();
+    eval.weight = eval.weight.collapse_to_hero();
+  }
   return eval;
 }
 
@@ -234,6 +391,10 @@ ETX_GPU_CODE float pdf(const BSDFData& data, const float3& in_w_o, const Materia
     return DeltaDielectricBSDF::pdf(data, in_w_o, mtl, scene, smp);
   }
 
+  if (mtl.multiple_scattering == Material::MultipleScattering::EnergyCompensation) {
+    return CompensatedDielectricBSDF::pdf(data, in_w_o, mtl, scene, smp);
+  }
+
   LocalFrame local_frame = {data.tan, data.btn, data.nrm};
   auto w_i = local_frame.to_local(-data.w_i);
   if (LocalFrame::cos_theta(w_i) == 0.0f)
@@ -12,7 +12,7 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Ma
   if (n_dot_o <= kEpsilon)
     return {data.spectrum_sample.wavelength, 0.0f};
 
-  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene);
+  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene, data.tex_footprint);
 
   BSDFEval result;
   result.func = diffuse * kInvPi;
@@ -43,10 +43,10 @@ namespace TranslucentBSDF {
 ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const Scene& scene, Sampler& smp) {
   auto frame = data.get_normal_frame();
 
-  float t = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene).average();
+  float t = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint).average();
   bool transmittance = (smp.next() < t);
 
-  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene);
+  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene, data.tex_footprint);
 
   BSDFSample result;
   result.weight = diffuse;
@@ -71,7 +71,7 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Ma
   float n_dot_i = -dot(data.nrm, data.w_i);
   float n_dot_o = dot(data.nrm, w_o);
 
-  float t = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene).average();
+  float t = apply_image(data.spectrum_sample, mtl.transmittance, data.tex, scene, data.tex_footprint).average();
   bool transmittance = (smp.next() < t);
   bool reflection = n_dot_o * n_dot_i > 0.0f;
 
@@ -79,7 +79,7 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Ma
     return {data.spectrum_sample.wavelength, 0.0f};
   }
 
-  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene);
+  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene, data.tex_footprint);
 
   n_dot_o = fabsf(n_dot_o);
 
@@ -111,7 +111,7 @@ ETX_GPU_CODE BSDFSample sample(const BSDFData& data, const Material& mtl, const
 
   BSDFSample result;
   result.w_o = normalize(reflect(data.w_i, frame.nrm));
-  result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+  result.weight = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
   result.pdf = 1.0f;
   result.properties = BSDFSample::Delta | BSDFSample::Reflection;
   return result;
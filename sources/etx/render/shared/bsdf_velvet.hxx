@@ -73,8 +73,8 @@ ETX_GPU_CODE BSDFEval evaluate(const BSDFData& data, const float3& w_o, const Ma
     ETX_VALIDATE(specular_scale_base);
   }
 
-  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene);
-  auto specular = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene);
+  auto diffuse = apply_image(data.spectrum_sample, mtl.diffuse, data.tex, scene, data.tex_footprint);
+  auto specular = apply_image(data.spectrum_sample, mtl.specular, data.tex, scene, data.tex_footprint);
 
   float diffuse_scale = diffuse_burley(alpha, n_dot_i, n_dot_o, m_dot_o);
 
@@ -14,6 +14,20 @@ struct Gather {
   float total_weight = 0.0f;
 };
 
+constexpr float kMaxRadius = 47.827155457397595950044717258511f;
+
+/*
+ * normalized Burley profile does not depend on the material, so one table is shared by all of them:
+ * row 0 - inverse CDF of the radius (in units of scattering distance) over uniform random number in [0..1],
+ * row 1 - exp(-r) + exp(-r / 3) over radius in [0..kMaxRadius]
+ */
+constexpr uint32_t kProfileTableSize = 1024u;
+
+ETX_GPU_CODE float profile_table_lookup(const Image& table, float x, uint32_t row) {
+  uint32_t i0 = min(static_cast<uint32_t>(x), kProfileTableSize - 2u);
+  return lerp(table.pixel(i0, row).x, table.pixel(i0 + 1u, row).x, x - float(i0));
+}
+
 ETX_GPU_CODE float sample_s_r(float rnd) {
   if (rnd < 0.25f) {
     rnd = fminf(4.0f * rnd, 1.0f - kEpsilon);
@@ -24,12 +38,37 @@ ETX_GPU_CODE float sample_s_r(float rnd) {
   return 3.0f * logf(1.0f / (1.0f - rnd));
 }
 
-ETX_GPU_CODE SpectralResponse evaluate(const SpectralQuery spect, const SubsurfaceMaterial& m, float radius) {
+ETX_GPU_CODE float sample_s_r(float rnd, const Image* table) {
+  if (table == nullptr)
+    return sample_s_r(rnd);
+
+  float x = rnd * float(kProfileTableSize - 1u);
+  if (x < float(kProfileTableSize - 2u))
+    return profile_table_lookup(*table, x, 0u);
+
+  // the last interval is not tabulated, exp(-r) is negligible there
+  return 3.0f * logf(0.75f / fmaxf(1.0f - rnd, kEpsilon));
+}
+
+ETX_GPU_CODE SpectralResponse evaluate(const SpectralQuery spect, const SubsurfaceMaterial& m, float radius, const Image* table) {
   auto sd = m.scattering_distance(spect) * m.scale;
   ETX_VALIDATE(sd);
 
   radius = fmaxf(radius, kEpsilon);
 
+  if (table != nullptr) {
+    constexpr float kScale = float(kProfileTableSize - 1u) / kMaxRadius;
+    SpectralResponse result = {spect.wavelength, 0.0f};
+    for (uint32_t i = 0; i < SpectralResponse::component_count(); ++i) {
+      float sd_i = sd.component(i);
+      float x = (sd_i > 0.0f) ? radius / sd_i : kMaxRadius;
+      float value = (x < kMaxRadius) ? profile_table_lookup(*table, x * kScale, 1u) : 0.0f;
+      (&result.components.x)[i] = value / fmaxf(sd_i * (4.0f * radius * kDoublePi), kEpsilon);
+    }
+    ETX_VALIDATE(result);
+    return result;
+  }
+
   auto term_0 = exp(-radius / (3.0f * sd));
   ETX_VALIDATE(term_0);
 
@@ -56,7 +95,7 @@ struct Sample {
   }
 };
 
-ETX_GPU_CODE Sample sample(SpectralQuery spect, const Vertex& data, const SubsurfaceMaterial& mtl, const uint32_t direction, Sampler& smp) {
+ETX_GPU_CODE Sample sample(SpectralQuery spect, const Vertex& data, const SubsurfaceMaterial& mtl, const uint32_t direction, const Image* table, Sampler& smp) {
   uint32_t channel = uint32_t(SpectralResponse::component_count() * smp.next());
   float scattering_distance = mtl.scale * mtl.scattering_distance(spect).component(channel);
   if (scattering_distance == 0.0f)
@@ -89,9 +128,8 @@ ETX_GPU_CODE Sample sample(SpectralQuery spect, const Vertex& data, const Subsur
       ETX_FAIL("Invalid direction");
   }
 
-  constexpr float kMaxRadius = 47.827155457397595950044717258511f;
   float r_max = scattering_distance * kMaxRadius;
-  result.sampled_radius = scattering_distance * sample_s_r(smp.next());
+  result.sampled_radius = scattering_distance * sample_s_r(smp.next(), table);
   if (result.sampled_radius >= r_max)
     return {};
 
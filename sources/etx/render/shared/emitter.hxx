@@ -30,6 +30,8 @@ struct ETX_ALIGNED Emitter {
   float angular_size_cosine = 1.0f;
   float weight = 0.0f;
   float triangle_area = 0.0f;
+  // textured area emitters: table over unit square of random_barycentric, proportional to emission
+  uint32_t sampling_image_index = kInvalidIndex;
 
   Emitter() = default;
 
@@ -2,14 +2,25 @@
 
 #include <etx/render/shared/distribution.hxx>
 #include <etx/render/shared/spectrum.hxx>
+#include <etx/render/shared/block_compression.hxx>
 
 namespace etx {
 
+struct TextureCache;
+
+#if (ETX_NVCC_COMPILER == 0)
+void texture_cache_read(TextureCache* cache, uint32_t source, uint64_t offset, uint32_t size, void* target);
+#endif
+
 struct Image {
   enum class Format : uint32_t {
     Undefined,
     RGBA32F,
     RGBA8,
+    BC1,
+    BC4,
+    BC5,
+    BC6H,
   };
 
   enum : uint32_t {
@@ -21,8 +32,24 @@ struct Image {
     HasAlphaChannel = 1u << 4u,
     UniformSamplingTable = 1u << 5u,
     DelayLoad = 1u << 6u,
+    MipMapped = 1u << 7u,
+    BlockCompressed = 1u << 8u,
+    NormalMap = 1u << 9u,
+    Streamed = 1u << 10u,
+    SpectralCoefficients = 1u << 11u,
   };
 
+  /*
+   * mip-mapped images are stored level after level, each level is split into square tiles
+   * with Morton order of pixels inside a tile, so neighbouring lookups stay within a few cache lines;
+   * block-compressed images store levels as rows of 4x4 blocks and `level_offset` is measured in 64-bit words;
+   * streamed images keep the element count of the storage, but its data is read through the texture cache on CPU;
+   * images with spectral coefficients store coefficients of rgb::sigmoid_polynomial in RGB channels and alpha in W
+   */
+  static constexpr uint32_t kMaxLevels = 16u;
+  static constexpr uint32_t kTileSize = 8u;
+  static constexpr uint32_t kTilePixelCount = kTileSize * kTileSize;
+
   struct Gather {
     float4 p00 = {};
     float4 p01 = {};
@@ -35,6 +62,7 @@ struct Image {
   union {
     ArrayView<float4> f32;
     ArrayView<ubyte4> u8;
+    ArrayView<uint64_t> blocks;
   } pixels = {};
 
   ArrayView<Distribution> x_distributions = {};
@@ -44,28 +72,45 @@ struct Image {
   float normalization = 0.0f;
   uint32_t options = 0;
   Format format = Format::Undefined;
-  uint32_t pad = {};
+  uint32_t level_count = 0;
+  uint32_t level_offset[kMaxLevels] = {};
+  TextureCache* cache = nullptr;
+  uint32_t cache_source = kInvalidIndex;
 
   ETX_GPU_CODE Gather gather(const float2& in_uv) const {
-    float2 uv = in_uv * fsize;
-    auto x0 = tex_coord_u(uv.x, fsize.x);
-    auto y0 = tex_coord_v(uv.y, fsize.y);
+    return gather(in_uv, 0u);
+  }
+
+  ETX_GPU_CODE Gather gather(const float2& in_uv, uint32_t level) const {
+    uint2 size = level_size(level);
+    float2 lsize = {float(size.x), float(size.y)};
+    float2 uv = in_uv * lsize;
+    auto x0 = tex_coord_u(uv.x, lsize.x);
+    auto y0 = tex_coord_v(uv.y, lsize.y);
     float dx = x0 - floorf(x0);
     float dy = y0 - floorf(y0);
 
-    uint32_t row_0 = clamp(static_cast<uint32_t>(y0), 0u, isize.y - 1u);
-    uint32_t row_1 = clamp(row_0 + 1u, 0u, isize.y - 1u);
-    uint32_t col_0 = clamp(static_cast<uint32_t>(x0), 0u, isize.x - 1u);
-    uint32_t col_1 = clamp(col_0 + 1u, 0u, isize.x - 1u);
-
-    const auto& p00 = pixel(col_0, row_0) * (1.0f - dx) * (1.0f - dy);
-    ETX_VALIDATE(p00);
-    const auto& p01 = pixel(col_1, row_0) * (dx) * (1.0f - dy);
-    ETX_VALIDATE(p01);
-    const auto& p10 = pixel(col_0, row_1) * (1.0f - dx) * (dy);
-    ETX_VALIDATE(p10);
-    const auto& p11 = pixel(col_1, row_1) * (dx) * (dy);
-    ETX_VALIDATE(p11);
+    uint32_t row_0 = clamp(static_cast<uint32_t>(y0), 0u, size.y - 1u);
+    uint32_t row_1 = clamp(row_0 + 1u, 0u, size.y - 1u);
+    uint32_t col_0 = clamp(static_cast<uint32_t>(x0), 0u, size.x - 1u);
+    uint32_t col_1 = clamp(col_0 + 1u, 0u, size.x - 1u);
+
+    const auto& p00 = pixel(col_0, row_0, level) * (1.0f - dx) * (1.0f - dy);
+    const auto& p01 = pixel(col_1, row_0, level) * (dx) * (1.0f - dy);
+    const auto& p10 = pixel(col_0, row_1, level) * (1.0f - dx) * (dy);
+    const auto& p11 = pixel(col_1, row_1, level) * (dx) * (dy);
+    if (options & SpectralCoefficients) {
+      // coefficients are signed
+      ETX_CHECK_FINITE(p00);
+      ETX_CHECK_FINITE(p01);
+      ETX_CHECK_FINITE(p10);
+      ETX_CHECK_FINITE(p11);
+    } else {
+      ETX_VALIDATE(p00);
+      ETX_VALIDATE(p01);
+      ETX_VALIDATE(p10);
+      ETX_VALIDATE(p11);
+    }
 
     return {p00, p01, p10, p11, row_0, row_1};
   }
@@ -75,6 +120,100 @@ struct Image {
     return g.p00 + g.p01 + g.p10 + g.p11;
   }
 
+  ETX_GPU_CODE float4 evaluate_level(const float2& in_uv, uint32_t level) const {
+    auto g = gather(in_uv, level);
+    return g.p00 + g.p01 + g.p10 + g.p11;
+  }
+
+  /*
+   * trilinear lookup, `footprint` is the width of the filter region in texture coordinates
+   */
+  ETX_GPU_CODE float4 evaluate(const float2& in_uv, float footprint) const {
+    if ((footprint <= 0.0f) || (level_count <= 1u)) {
+      return evaluate(in_uv);
+    }
+
+    float lod = clamp(log2f(footprint * sqrtf(fsize.x * fsize.y)), 0.0f, float(level_count - 1u));
+    uint32_t level_0 = static_cast<uint32_t>(lod);
+    uint32_t level_1 = min(level_0 + 1u, level_count - 1u);
+    float t = lod - floorf(lod);
+
+    float4 result = evaluate_level(in_uv, level_0);
+    if ((t > 0.0f) && (level_1 != level_0)) {
+      result = result * (1.0f - t) + evaluate_level(in_uv, level_1) * t;
+    }
+    return result;
+  }
+
+  ETX_GPU_CODE uint2 level_size(uint32_t level) const {
+    return {max(1u, isize.x >> level), max(1u, isize.y >> level)};
+  }
+
+  ETX_GPU_CODE uint32_t tiled_index(uint32_t x, uint32_t y, uint32_t level) const {
+    uint2 size = level_size(level);
+    x = min(x, size.x - 1u);
+    y = min(y, size.y - 1u);
+    uint32_t tiles_x = (size.x + kTileSize - 1u) / kTileSize;
+    uint32_t tile = (y / kTileSize) * tiles_x + (x / kTileSize);
+    return level_offset[level] + tile * kTilePixelCount + morton_index(x % kTileSize, y % kTileSize);
+  }
+
+  ETX_GPU_CODE static uint32_t morton_index(uint32_t x, uint32_t y) {
+    x = (x | (x << 2u)) & 0x33u;
+    x = (x | (x << 1u)) & 0x55u;
+    y = (y | (y << 2u)) & 0x33u;
+    y = (y | (y << 1u)) & 0x55u;
+    return x | (y << 1u);
+  }
+
+  ETX_GPU_CODE static uint32_t tiled_level_pixel_count(const uint2& size) {
+    return ((size.x + kTileSize - 1u) / kTileSize) * ((size.y + kTileSize - 1u) / kTileSize) * kTilePixelCount;
+  }
+
+  ETX_GPU_CODE bool block_compressed() const {
+    return (format == Format::BC1) || (format == Format::BC4) || (format == Format::BC5) || (format == Format::BC6H);
+  }
+
+  ETX_GPU_CODE static uint32_t block_word_count(Format fmt) {
+    return ((fmt == Format::BC1) || (fmt == Format::BC4)) ? 1u : 2u;
+  }
+
+  ETX_GPU_CODE static uint32_t block_level_word_count(const uint2& size, Format fmt) {
+    return ((size.x + bcn::kBlockSize - 1u) / bcn::kBlockSize) * ((size.y + bcn::kBlockSize - 1u) / bcn::kBlockSize) * block_word_count(fmt);
+  }
+
+  ETX_GPU_CODE uint32_t block_index(uint32_t x, uint32_t y, uint32_t level) const {
+    uint2 size = level_size(level);
+    uint32_t blocks_x = (size.x + bcn::kBlockSize - 1u) / bcn::kBlockSize;
+    return level_offset[level] + ((y / bcn::kBlockSize) * blocks_x + (x / bcn::kBlockSize)) * block_word_count(format);
+  }
+
+  ETX_GPU_CODE float4 block_pixel(uint32_t x, uint32_t y, uint32_t level) const {
+    uint2 size = level_size(level);
+    x = min(x, size.x - 1u);
+    y = min(y, size.y - 1u);
+
+    uint64_t block_data[2] = {};
+    const uint64_t* block = stored(pixels.blocks, block_index(x, y, level), block_word_count(format), block_data);
+    uint32_t texel = (x % bcn::kBlockSize) + (y % bcn::kBlockSize) * bcn::kBlockSize;
+    switch (format) {
+      case Format::BC1:
+        return bcn::decode_bc1(block, texel);
+      case Format::BC4: {
+        float value = bcn::decode_bc4(block, texel);
+        return {value, value, value, 1.0f};
+      }
+      case Format::BC5: {
+        float2 value = bcn::decode_bc5(block, texel);
+        return {value.x, value.y, 0.0f, 1.0f};
+      }
+      case Format::BC6H:
+        return bcn::decode_bc6h(block, texel);
+      default:
+        return {};
+    }
+  }
+
   ETX_GPU_CODE float pdf(const float2& in_uv) const {
     auto g = gather(in_uv);
 
@@ -88,21 +227,66 @@ struct Image {
   }
 
   ETX_GPU_CODE float4 pixel(uint32_t i) const {
-    ETX_ASSERT(format != Format::Undefined);
+    ETX_ASSERT((format == Format::RGBA8) || (format == Format::RGBA32F));
+
+    if (format == Format::RGBA8) {
+      ubyte4 value = {};
+      return to_float4(*stored(pixels.u8, i, 1u, &value));
+    } else {
+      float4 value = {};
+      return *stored(pixels.f32, i, 1u, &value);
+    }
+  }
 
-    if (format == Format::RGBA8)
-      return to_float4(pixels.u8[i]);
-    else
-      return pixels.f32[i];
+  /*
+   * returns `count` consecutive elements of the storage, for streamed images they are copied to `target`
+   */
+  template <class T>
+  ETX_GPU_CODE const T* stored(const ArrayView<T>& view, uint64_t index, uint32_t count, T target[]) const {
+#if (ETX_NVCC_COMPILER == 0)
+    if (options & Streamed) {
+      texture_cache_read(cache, cache_source, index * sizeof(T), count * sizeof(T), target);
+      return target;
+    }
+#endif
+    return &view[index];
+  }
+
+  ETX_GPU_CODE uint64_t storage_size() const {
+    if (block_compressed()) {
+      return pixels.blocks.count * sizeof(uint64_t);
+    }
+    return (format == Format::RGBA8) ? pixels.u8.count * sizeof(ubyte4) : pixels.f32.count * sizeof(float4);
   }
 
   ETX_GPU_CODE float4 pixel(uint32_t x, uint32_t y) const {
+    return pixel(x, y, 0u);
+  }
+
+  ETX_GPU_CODE float4 pixel(uint32_t x, uint32_t y, uint32_t level) const {
+    if (block_compressed()) {
+      return block_pixel(x, y, level);
+    }
+
+    if (options & MipMapped) {
+      return pixel(tiled_index(x, y, level));
+    }
+
     int32_t i = min(x + y * isize.x, isize.x * isize.y - 1u);
     return pixel(i);
   }
 
   ETX_GPU_CODE float3 evaluate_normal(const float2& uv, float scale) const {
-    float4 value = evaluate(uv);
+    return evaluate_normal(uv, scale, 0.0f);
+  }
+
+  ETX_GPU_CODE float3 evaluate_normal(const float2& uv, float scale, float footprint) const {
+    float4 value = evaluate(uv, footprint);
+    if (format == Format::BC5) {
+      float x = value.x * 2.0f - 1.0f;
+      float y = value.y * 2.0f - 1.0f;
+      value.z = 0.5f * sqrtf(max(0.0f, 1.0f - x * x - y * y)) + 0.5f;
+    }
     return {
       scale * (value.x * 2.0f - 1.0f),
       scale * (value.y * 2.0f - 1.0f),
@@ -111,6 +295,12 @@ struct Image {
   }
 
   ETX_GPU_CODE float2 sample(const float2& rnd, float& image_pdf, uint2& location) const {
+    float2 uv = sample(rnd, location);
+    image_pdf = pdf(uv);
+    return uv;
+  }
+
+  ETX_GPU_CODE float2 sample(const float2& rnd, uint2& location) const {
     float y_pdf = 0.0f;
     location.y = y_distribution.sample(rnd.y, y_pdf);
 
@@ -118,27 +308,26 @@ struct Image {
     const auto& x_distribution = x_distributions[location.y];
     location.x = x_distribution.sample(rnd.x, x_pdf);
 
-    auto x0 = x_distribution.values[location.x];
-    auto x1 = x_distribution.values[min(location.x + 1llu, x_distribution.values.count - 1)];
-    float dx = (rnd.x - x0.cdf);
-    if (x1.cdf - x0.cdf > 0.0f) {
-      dx /= (x1.cdf - x0.cdf);
-    }
+    // each entry spans [cdf, cdf + pdf), this includes the last one
+    const auto& x0 = x_distribution.values[location.x];
+    float dx = (x0.pdf > 0.0f) ? saturate((rnd.x - x0.cdf) / x0.pdf) : 0.0f;
 
-    auto y0 = y_distribution.values[location.y];
-    auto y1 = y_distribution.values[min(location.y + 1llu, y_distribution.values.count - 1)];
-    float dy = (rnd.y - y0.cdf);
-    if (y1.cdf - y0.cdf > 0.0f) {
-      dy /= (y1.cdf - y0.cdf);
-    }
+    const auto& y0 = y_distribution.values[location.y];
+    float dy = (y0.pdf > 0.0f) ? saturate((rnd.y - y0.cdf) / y0.pdf) : 0.0f;
 
-    float2 uv = {
+    return {
       (float(location.x) + dx) / fsize.x,
       (float(location.y) + dy) / fsize.y,
     };
+  }
 
-    image_pdf = pdf(uv);
-    return uv;
+  /*
+   * exact density of `sample` in texture coordinates, constant over each pixel (unlike filtered `pdf`)
+   */
+  ETX_GPU_CODE float sampling_pdf(const float2& uv) const {
+    uint32_t x = min(static_cast<uint32_t>(saturate(uv.x) * fsize.x), isize.x - 1u);
+    uint32_t y = min(static_cast<uint32_t>(saturate(uv.y) * fsize.y), isize.y - 1u);
+    return y_distribution.values[y].pdf * x_distributions[y].values[x].pdf * (fsize.x * fsize.y);
   }
 
   ETX_GPU_CODE float tex_coord_repeat(float u, float size) const {
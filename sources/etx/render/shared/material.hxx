@@ -10,17 +10,33 @@ struct ETX_ALIGNED SpectralImage {
   uint32_t image_index = kInvalidIndex;
 };
 
+struct Image;
+
 struct ETX_ALIGNED Thinfilm {
+  /*
+   * reflectance of the film is tabulated over cosine of the incident angle (columns) and thickness (rows),
+   * in spectral mode each block of rows holds four wavelengths, second half of the table is for light coming from the internal medium
+   */
+  static constexpr uint32_t kTableCosineSize = 64u;
+  static constexpr uint32_t kTableThicknessSize = 128u;
+  static constexpr uint32_t kTableWavelengthStep = spectrum::TableStep;
+  static constexpr uint32_t kTableWavelengthCount = (spectrum::WavelengthCount - 1u) / kTableWavelengthStep + 1u;
+  static constexpr uint32_t kTableBlockCount = spectrum::kSpectralRendering ? (kTableWavelengthCount + 3u) / 4u : 1u;
+
   struct Eval {
     RefractiveIndex::Sample ior;
     float thickness = 0.0f;
+    const Image* table = nullptr;
+    float table_thickness = 0.0f;
+    float2 table_eta = {};
   };
 
   RefractiveIndex ior = {};
   uint32_t thinkness_image = kInvalidIndex;
   float min_thickness = 0.0f;
   float max_thickness = 0.0f;
-  float pad;
+  uint32_t table_image = kInvalidIndex;
+  float2 table_eta = {};
 };
 
 struct SubsurfaceMaterial {
@@ -51,6 +67,15 @@ struct ETX_ALIGNED Material {
     Undefined = kInvalidIndex,
   };
 
+  /*
+   * multiple scattering between microfacets of rough conductors and dielectrics:
+   * stochastic random walk on the microsurface or tabulated energy compensation (Kulla and Conty)
+   */
+  enum class MultipleScattering : uint32_t {
+    RandomWalk,
+    EnergyCompensation,
+  };
+
   Class cls = Class::Undefined;
   SpectralImage diffuse;
   SpectralImage specular;
@@ -65,6 +90,7 @@ struct ETX_ALIGNED Material {
   SubsurfaceMaterial subsurface = {};
 
   float2 roughness = {};
+  MultipleScattering multiple_scattering = MultipleScattering::RandomWalk;
 
   uint32_t normal_image_index = kInvalidIndex;
   uint32_t metal_roughness_image_index = kInvalidIndex;
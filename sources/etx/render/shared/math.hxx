@@ -114,11 +114,13 @@ struct ETX_ALIGNED Vertex {
   float3 tan = {};
   float3 btn = {};
   float2 tex = {};
+  float tex_footprint = 0.0f;  // width of the ray footprint in texture space
 };
 
 struct ETX_ALIGNED Triangle {
   uint32_t i[3] = {kInvalidIndex, kInvalidIndex, kInvalidIndex};
   float3 geo_n = {};
+  float uv_scale = 0.0f;  // square root of texture space to world space area ratio
 };
 
 struct ETX_ALIGNED LocalFrame {
@@ -173,6 +175,19 @@ struct ETX_ALIGNED Ray {
   float max_t = kMaxFloat;
 };
 
+/*
+ * ray cone used to estimate texture footprint: `width` at the origin of the ray and `spread` angle,
+ * zero width and spread means no filtering
+ */
+struct RayCone {
+  float width = 0.0f;
+  float spread = 0.0f;
+
+  ETX_GPU_CODE float width_at(float t) const {
+    return fabsf(width + spread * t);
+  }
+};
+
 struct ETX_ALIGNED IntersectionBase {
   float2 barycentric = {};
   uint32_t triangle_index = kInvalidIndex;
@@ -345,6 +360,15 @@ ETX_GPU_CODE float3 random_barycentric(const float2 rnd) {
   return {1.0f - r1, r1 * (1.0f - rnd.y), r1 * rnd.y};
 }
 
+/*
+ * inverse of random_barycentric, the mapping preserves area, so densities over the unit square
+ * become densities over the triangle after division by its area
+ */
+ETX_GPU_CODE float2 random_barycentric_inverse(const float3& bc) {
+  float r1 = 1.0f - bc.x;
+  return {r1 * r1, (r1 > 0.0f) ? saturate(bc.z / r1) : 0.0f};
+}
+
 ETX_GPU_CODE float2 sample_disk(const float2& rnd) {
   float2 offset = {2.0f * rnd.x - 1.0f, 2.0f * rnd.y - 1.0f};
   if ((offset.x == 0.0f) && (offset.y == 0.0f))
@@ -469,6 +493,41 @@ ETX_GPU_CODE uint32_t to_int(float value) {
   return result;
 }
 
+ETX_GPU_CODE uint32_t pack_unorm2x16(const float2& v) {
+  uint32_t x = static_cast<uint32_t>(saturate(v.x) * 65535.0f + 0.5f);
+  uint32_t y = static_cast<uint32_t>(saturate(v.y) * 65535.0f + 0.5f);
+  return x | (y << 16u);
+}
+
+ETX_GPU_CODE float2 unpack_unorm2x16(uint32_t packed) {
+  return {
+    float(packed & 0xffffu) / 65535.0f,
+    float(packed >> 16u) / 65535.0f,
+  };
+}
+
+// octahedral mapping of the unit vector, 16 bits per component
+ETX_GPU_CODE uint32_t pack_unit_vector(const float3& v) {
+  float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+  float2 p = {v.x / l1, v.y / l1};
+  if (v.z < 0.0f) {
+    p = {
+      (1.0f - fabsf(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+      (1.0f - fabsf(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f),
+    };
+  }
+  return pack_unorm2x16(p * 0.5f + 0.5f);
+}
+
+ETX_GPU_CODE float3 unpack_unit_vector(uint32_t packed) {
+  float2 p = unpack_unorm2x16(packed) * 2.0f - 1.0f;
+  float3 v = {p.x, p.y, 1.0f - fabsf(p.x) - fabsf(p.y)};
+  float t = saturate(-v.z);
+  v.x += (v.x >= 0.0f) ? -t : t;
+  v.y += (v.y >= 0.0f) ? -t : t;
+  return normalize(v);
+}
+
 ETX_GPU_CODE float3 offset_ray(const float3& p, const float3& n) {
   constexpr float int_scale = 256.0f;
   constexpr float float_scale = 1.0f / 65536.0f;
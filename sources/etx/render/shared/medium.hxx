@@ -12,6 +12,11 @@ struct ETX_ALIGNED Medium {
     Heterogeneous,
   };
 
+  enum class TransmittanceEstimator : uint32_t {
+    RatioTracking,
+    ResidualRatioTracking,
+  };
+
   struct ETX_ALIGNED Sample {
     SpectralResponse weight = {};
     float3 pos = {};
@@ -26,14 +31,40 @@ struct ETX_ALIGNED Medium {
     }
   };
 
+  /*
+   * each majorant cell covers kMajorantCellSize^3 density voxels
+   * and stores (min, max) of the normalized density over the cell and its one-voxel border
+   */
+  static constexpr uint32_t kMajorantCellSize = 8u;
+
+  /*
+   * sparse volumes keep only non-empty bricks of kMajorantCellSize^3 voxels (matching NanoVDB leaf nodes),
+   * `bricks` maps majorant cell to the brick offset in `density` or kInvalidIndex for empty cells
+   */
+  static constexpr uint32_t kBrickVoxelCount = kMajorantCellSize * kMajorantCellSize * kMajorantCellSize;
+
+  struct MajorantIterator {
+    float t_next[3] = {};
+    float t_delta[3] = {};
+    int32_t cell[3] = {};
+    int32_t step[3] = {};
+    int32_t limit[3] = {};
+    float t = 0.0f;
+    float t_max = 0.0f;
+  };
+
   Class cls = Class::Vacuum;
+  TransmittanceEstimator transmittance_estimator = TransmittanceEstimator::RatioTracking;
   SpectralDistribution s_absorption = {};
   SpectralDistribution s_scattering = {};
   ArrayView<float> density = {};
+  ArrayView<uint32_t> bricks = {};
+  ArrayView<float2> majorants = {};
   BoundingBox bounds = {};
   float phase_function_g = 0.0f;
   float max_sigma = 0.0f;
   uint3 dimensions = {};
+  uint3 majorant_dimensions = {};
 
   ETX_GPU_CODE SpectralResponse transmittance(const SpectralQuery spect, Sampler& smp, const float3& pos, const float3& direction, float distance) const {
     switch (cls) {
@@ -69,22 +100,43 @@ struct ETX_ALIGNED Medium {
 
     float tr = 1.0f;
 
-    float t = t_min;
-    while (true) {
-      t -= logf(1.0f - smp.next()) / max_sigma;
-      if (t >= t_max)
-        break;
+    float t0 = 0.0f;
+    float t1 = 0.0f;
+    float2 majorant = {};
+    auto it = start_majorant_iteration(pos, dir, t_min, t_max);
+    while (next_majorant_segment(it, t0, t1, majorant)) {
+      if (majorant.y <= 0.0f)
+        continue;
+
+      // residual ratio tracking uses lower bound of the density within the cell as a control extinction
+      // and estimates only the residual part stochastically
+      float control = 0.0f;
+      if (transmittance_estimator == TransmittanceEstimator::ResidualRatioTracking) {
+        control = majorant.x;
+        tr *= expf(-max_sigma * control * (t1 - t0));
+      }
+
+      float residual = majorant.y - control;
+      if (residual <= 0.0f)
+        continue;
 
-      float density = sample_density(pos + dir * t);
-      tr *= max(0.0f, 1.0f - density);
+      float t = t0;
+      while (true) {
+        t -= logf(1.0f - smp.next()) / (max_sigma * residual);
+        if (t >= t1)
+          break;
 
-      if (tr < rr_threshold) {
-        float q = max(0.05f, 1.0f - tr);
+        float density = sample_density(pos + dir * t);
+        tr *= max(0.0f, 1.0f - (density - control) / residual);
 
-        if (smp.next() < q)
-          return {spect.wavelength, 0.0f};
+        if (tr < rr_threshold) {
+          float q = max(0.05f, 1.0f - tr);
 
-        tr /= 1.0f - q;
+          if (smp.next() < q)
+            return {spect.wavelength, 0.0f};
+
+          tr /= 1.0f - q;
+        }
       }
     }
 
@@ -110,10 +162,6 @@ struct ETX_ALIGNED Medium {
 
   ETX_GPU_CODE static uint32_t sample_spectrum_component(const SpectralQuery spect, const SpectralResponse& albedo, const SpectralResponse& throughput, Sampler& smp,
     SpectralResponse& pdf) {
-    if constexpr (spectrum::kSpectralRendering) {
-      pdf = {spect.wavelength, 1.0f};
-      return 0;
-    }
     SpectralResponse at = albedo * throughput;
 
     float rnd = smp.next();
@@ -176,20 +224,29 @@ struct ETX_ALIGNED Medium {
       return {{spect.wavelength, 1.0f}};
     }
 
-    float t = t_min;
-    while (true) {
-      t -= logf(1.0f - smp.next()) / max_sigma;
-      if (t >= t_max)
-        break;
-
-      float3 local_pos = pos + dir * t;
-      float density = sample_density(local_pos);
-      if (smp.next() <= density) {
-        Sample result;
-        result.weight = s_scattering(spect) / (s_scattering(spect) + s_absorption(spect));
-        result.pos = bounds.from_local(local_pos);
-        result.t = t;
-        return result;
+    float t0 = 0.0f;
+    float t1 = 0.0f;
+    float2 majorant = {};
+    auto it = start_majorant_iteration(pos, dir, t_min, t_max);
+    while (next_majorant_segment(it, t0, t1, majorant)) {
+      if (majorant.y <= 0.0f)
+        continue;
+
+      float t = t0;
+      while (true) {
+        t -= logf(1.0f - smp.next()) / (max_sigma * majorant.y);
+        if (t >= t1)
+          break;
+
+        float3 local_pos = pos + dir * t;
+        float density = sample_density(local_pos);
+        if (smp.next() * majorant.y <= density) {
+          Sample result;
+          result.weight = s_scattering(spect) / (s_scattering(spect) + s_absorption(spect));
+          result.pos = bounds.from_local(local_pos);
+          result.t = t;
+          return result;
+        }
       }
     }
 
@@ -239,23 +296,23 @@ struct ETX_ALIGNED Medium {
     float py = clamp(coord.y * float(dimensions.y) - 0.5f, 0.0f, float(dimensions.y) - 1.0f);
     float pz = clamp(coord.z * float(dimensions.z) - 0.5f, 0.0f, float(dimensions.z) - 1.0f);
 
-    uint64_t ix = min(dimensions.x - 1llu, static_cast<uint64_t>(px));
-    uint64_t nx = min(dimensions.x - 1llu, ix + 1);
+    uint32_t ix = min(dimensions.x - 1u, static_cast<uint32_t>(px));
+    uint32_t nx = min(dimensions.x - 1u, ix + 1u);
 
-    uint64_t iy = min(dimensions.y - 1llu, static_cast<uint64_t>(py));
-    uint64_t ny = min(dimensions.y - 1llu, iy + 1);
+    uint32_t iy = min(dimensions.y - 1u, static_cast<uint32_t>(py));
+    uint32_t ny = min(dimensions.y - 1u, iy + 1u);
 
-    uint64_t iz = min(dimensions.z - 1llu, static_cast<uint64_t>(pz));
-    uint64_t nz = min(dimensions.z - 1llu, iz + 1);
+    uint32_t iz = min(dimensions.z - 1u, static_cast<uint32_t>(pz));
+    uint32_t nz = min(dimensions.z - 1u, iz + 1u);
 
-    float d000 = density[ix + iy * dimensions.x + iz * dimensions.x * dimensions.y];
-    float d001 = density[nx + iy * dimensions.x + iz * dimensions.x * dimensions.y];
-    float d010 = density[ix + ny * dimensions.x + iz * dimensions.x * dimensions.y];
-    float d011 = density[nx + ny * dimensions.x + iz * dimensions.x * dimensions.y];
-    float d100 = density[ix + iy * dimensions.x + nz * dimensions.x * dimensions.y];
-    float d101 = density[nx + iy * dimensions.x + nz * dimensions.x * dimensions.y];
-    float d110 = density[ix + ny * dimensions.x + nz * dimensions.x * dimensions.y];
-    float d111 = density[nx + ny * dimensions.x + nz * dimensions.x * dimensions.y];
+    float d000 = voxel(ix, iy, iz);
+    float d001 = voxel(nx, iy, iz);
+    float d010 = voxel(ix, ny, iz);
+    float d011 = voxel(nx, ny, iz);
+    float d100 = voxel(ix, iy, nz);
+    float d101 = voxel(nx, iy, nz);
+    float d110 = voxel(ix, ny, nz);
+    float d111 = voxel(nx, ny, nz);
 
     float dx = px - floorf(px);
     float dy = py - floorf(py);
@@ -266,6 +323,93 @@ struct ETX_ALIGNED Medium {
     return lerp(d_bottom, d_top, dz);
   }
 
+  ETX_GPU_CODE float voxel(uint32_t x, uint32_t y, uint32_t z) const {
+    if (bricks.count == 0) {
+      return density[x + 1llu * y * dimensions.x + 1llu * z * dimensions.x * dimensions.y];
+    }
+
+    constexpr uint32_t cs = kMajorantCellSize;
+    uint64_t cell = (x / cs) + 1llu * (y / cs) * majorant_dimensions.x + 1llu * (z / cs) * majorant_dimensions.x * majorant_dimensions.y;
+    uint32_t brick = bricks[cell];
+    if (brick == kInvalidIndex) {
+      return 0.0f;
+    }
+
+    return density[1llu * brick * kBrickVoxelCount + (x % cs) + (y % cs) * cs + (z % cs) * cs * cs];
+  }
+
+  /*
+   * 3D DDA over the majorant grid in the local [0..1] space of the medium,
+   * yields consecutive segments [t0, t1) along with (min, max) normalized density within the segment
+   */
+  ETX_GPU_CODE MajorantIterator start_majorant_iteration(const float3& in_pos, const float3& in_dir, float t_min, float t_max) const {
+    MajorantIterator it = {};
+    it.t = t_min;
+    it.t_max = t_max;
+
+    if (majorants.count == 0) {
+      for (uint32_t i = 0; i < 3; ++i) {
+        it.t_next[i] = kMaxFloat;
+        it.limit[i] = 1;
+      }
+      return it;
+    }
+
+    float3 p = in_pos + in_dir * t_min;
+    float pos[3] = {p.x, p.y, p.z};
+    float dir[3] = {in_dir.x, in_dir.y, in_dir.z};
+    uint32_t dim[3] = {dimensions.x, dimensions.y, dimensions.z};
+    uint32_t cells[3] = {majorant_dimensions.x, majorant_dimensions.y, majorant_dimensions.z};
+
+    for (uint32_t i = 0; i < 3; ++i) {
+      float scale = float(dim[i]) / float(kMajorantCellSize);
+      float g = pos[i] * scale;
+      it.cell[i] = clamp(static_cast<int32_t>(floorf(g)), 0, static_cast<int32_t>(cells[i]) - 1);
+
+      if (dir[i] > 0.0f) {
+        it.step[i] = 1;
+        it.limit[i] = static_cast<int32_t>(cells[i]);
+        it.t_next[i] = t_min + (float(it.cell[i] + 1) - g) / (scale * dir[i]);
+        it.t_delta[i] = 1.0f / (scale * dir[i]);
+      } else if (dir[i] < 0.0f) {
+        it.step[i] = -1;
+        it.limit[i] = -1;
+        it.t_next[i] = t_min + (float(it.cell[i]) - g) / (scale * dir[i]);
+        it.t_delta[i] = -1.0f / (scale * dir[i]);
+      } else {
+        it.limit[i] = static_cast<int32_t>(cells[i]);
+        it.t_next[i] = kMaxFloat;
+        it.t_delta[i] = kMaxFloat;
+      }
+    }
+
+    return it;
+  }
+
+  ETX_GPU_CODE bool next_majorant_segment(MajorantIterator& it, float& t0, float& t1, float2& majorant) const {
+    if (it.t >= it.t_max)
+      return false;
+
+    uint32_t axis = (it.t_next[0] < it.t_next[1]) ? ((it.t_next[0] < it.t_next[2]) ? 0u : 2u) : ((it.t_next[1] < it.t_next[2]) ? 1u : 2u);
+
+    t0 = it.t;
+    t1 = min(it.t_next[axis], it.t_max);
+
+    if (majorants.count == 0) {
+      majorant = {0.0f, 1.0f};
+      it.t = it.t_max;
+      return true;
+    }
+
+    uint64_t index = it.cell[0] + 1llu * it.cell[1] * majorant_dimensions.x + 1llu * it.cell[2] * majorant_dimensions.x * majorant_dimensions.y;
+    majorant = majorants[index];
+
+    it.cell[axis] += it.step[axis];
+    it.t_next[axis] += it.t_delta[axis];
+    it.t = (it.cell[axis] == it.limit[axis]) ? it.t_max : t1;
+    return true;
+  }
+
  private:
   ETX_GPU_CODE constexpr static float gamma(int n) {
     constexpr auto e = kEpsilon * 0.5f;
@@ -38,6 +38,8 @@ struct ETX_ALIGNED Scene {
   uint64_t acceleration_structure ETX_EMPTY_INIT;
   uint32_t camera_medium_index ETX_INIT_WITH(kInvalidIndex);
   uint32_t camera_lens_shape_image_index ETX_INIT_WITH(kInvalidIndex);
+  uint32_t microfacet_energy_image_index ETX_INIT_WITH(kInvalidIndex);
+  uint32_t subsurface_profile_image_index ETX_INIT_WITH(kInvalidIndex);
   uint32_t max_path_length ETX_INIT_WITH(65535u);
   uint32_t samples ETX_INIT_WITH(256u);
   uint32_t random_path_termination ETX_INIT_WITH(6u);
@@ -107,10 +109,19 @@ ETX_GPU_CODE float3 shading_pos(const ArrayView<Vertex>& vertices, const Triangl
   return offset_ray(convex ? sh_pos : geo_pos, t.geo_n * direction);
 }
 
-ETX_GPU_CODE Intersection make_intersection(const Scene& scene, const float3& w_i, const IntersectionBase& base) {
+/*
+ * projects width of the ray cone at the hit point onto the triangle and converts it to texture space
+ */
+ETX_GPU_CODE float texture_footprint(const Triangle& tri, const float3& w_i, float cone_width) {
+  constexpr float kMinCosTheta = 1.0f / 64.0f;
+  return cone_width * tri.uv_scale / max(kMinCosTheta, fabsf(dot(tri.geo_n, w_i)));
+}
+
+ETX_GPU_CODE Intersection make_intersection(const Scene& scene, const float3& w_i, const IntersectionBase& base, float cone_width = 0.0f) {
   float3 bc = barycentrics(base.barycentric);
   const auto& tri = scene.triangles[base.triangle_index];
   Intersection result_intersection = lerp_vertex(scene.vertices, tri, bc);
+  result_intersection.tex_footprint = texture_footprint(tri, w_i, cone_width);
   result_intersection.barycentric = bc;
   result_intersection.triangle_index = static_cast<uint32_t>(base.triangle_index);
   result_intersection.w_i = w_i;
@@ -120,7 +131,7 @@ ETX_GPU_CODE Intersection make_intersection(const Scene& scene, const float3& w_
 
   const auto& mat = scene.materials[result_intersection.material_index];
   if ((mat.normal_image_index != kInvalidIndex) && (mat.normal_scale > 0.0f)) {
-    auto sampled_normal = scene.images[mat.normal_image_index].evaluate_normal(result_intersection.tex, mat.normal_scale);
+    auto sampled_normal = scene.images[mat.normal_image_index].evaluate_normal(result_intersection.tex, mat.normal_scale, result_intersection.tex_footprint);
     float3x3 from_local = {
       float3{result_intersection.tan.x, result_intersection.tan.y, result_intersection.tan.z},
       float3{result_intersection.btn.x, result_intersection.btn.y, result_intersection.btn.z},
@@ -153,12 +164,17 @@ ETX_GPU_CODE bool random_continue(uint32_t path_length, uint32_t start_path_leng
   return false;
 }
 
-ETX_GPU_CODE SpectralResponse apply_image(SpectralQuery spect, const SpectralImage& img, const float2& uv, const Scene& scene) {
+ETX_GPU_CODE SpectralResponse apply_image(SpectralQuery spect, const SpectralImage& img, const float2& uv, const Scene& scene, float footprint = 0.0f) {
   SpectralResponse result = img.spectrum(spect);
 
   if (img.image_index != kInvalidIndex) {
-    float4 eval = scene.images[img.image_index].evaluate(uv);
-    result *= rgb::query_spd(spect, {eval.x, eval.y, eval.z}, scene.spectrums->rgb_reflection);
+    const auto& image = scene.images[img.image_index];
+    float4 eval = image.evaluate(uv, footprint);
+    if (image.options & Image::SpectralCoefficients) {
+      result *= rgb::query_coefficients(spect, {eval.x, eval.y, eval.z});
+    } else {
+      result *= rgb::query_spd(spect, {eval.x, eval.y, eval.z}, scene.spectrums->rgb_reflection);
+    }
     ETX_VALIDATE(result);
   }
   return result;
@@ -94,13 +94,46 @@ namespace bsdf {
 }  // namespace bsdf
 
 ETX_GPU_CODE Thinfilm::Eval evaluate_thinfilm(SpectralQuery spect, const Thinfilm& film, const float2& uv, const Scene& scene) {
+  Thinfilm::Eval result = {};
   if (film.max_thickness * film.min_thickness <= 0.0f) {
-    return {{}, 0.0f};
+    return result;
   }
 
   float t = (film.thinkness_image == kInvalidIndex) ? 1.0f : scene.images[film.thinkness_image].evaluate(uv).x;
-  float thickness = lerp(film.min_thickness, film.max_thickness, t);
-  return {film.ior(spect), thickness};
+  result.thickness = lerp(film.min_thickness, film.max_thickness, t);
+  if (film.table_image == kInvalidIndex) {
+    result.ior = film.ior(spect);
+    return result;
+  }
+
+  result.ior.wavelength = spect.wavelength;
+  result.table = &scene.images[film.table_image];
+  result.table_thickness = saturate(t);
+  result.table_eta = film.table_eta;
+  return result;
+}
+
+/*
+ * directional (x) and average (y) albedo of the single scattering GGX lobe with unit Fresnel
+ */
+ETX_GPU_CODE float2 microfacet_energy(float cos_theta, const float2& roughness, const Scene& scene) {
+  if (scene.microfacet_energy_image_index == kInvalidIndex) {
+    return {1.0f, 1.0f};
+  }
+
+  constexpr float kScale = float(kMicrofacetEnergyTableSize - 1u) / float(kMicrofacetEnergyTableSize);
+  float alpha = sqrtf(roughness.x * roughness.y);
+  float4 value = scene.images[scene.microfacet_energy_image_index].evaluate({saturate(cos_theta) * kScale, saturate(alpha) * kScale});
+  return {value.x, value.y};
+}
+
+/*
+ * multiple scattering lobe restoring energy lost by the single scattering microfacet model (Kulla and Conty),
+ * `f_avg` is hemispherical average of the Fresnel term, the result is not multiplied by cosine
+ */
+ETX_GPU_CODE SpectralResponse microfacet_compensation(const SpectralResponse& f_avg, float e_i, float e_o, float e_avg) {
+  auto f_ms = f_avg * f_avg * e_avg / (1.0f - f_avg * (1.0f - e_avg));
+  return f_ms * ((1.0f - e_i) * (1.0f - e_o) / (kPi * max(kEpsilon, 1.0f - e_avg)));
 }
 
 ETX_GPU_CODE SpectralResponse apply_emitter_image(SpectralQuery spect, const SpectralImage& img, const float2& uv, const Scene& scene) {
@@ -118,13 +151,13 @@ ETX_GPU_CODE SpectralResponse apply_emitter_image(SpectralQuery spect, const Spe
   return result;
 }
 
-ETX_GPU_CODE bool alpha_test_pass(const Material& mat, const Triangle& t, const float3& bc, const Scene& scene, Sampler& smp) {
+ETX_GPU_CODE bool alpha_test_pass(const Material& mat, const Triangle& t, const float3& bc, const Scene& scene, Sampler& smp, float footprint = 0.0f) {
   if (mat.diffuse.image_index == kInvalidIndex)
     return false;
 
   auto uv = lerp_uv(scene.vertices, t, bc);
   const auto& img = scene.images[mat.diffuse.image_index];
-  return (img.options & Image::HasAlphaChannel) && (img.evaluate(uv).w <= smp.next());
+  return (img.options & Image::HasAlphaChannel) && (img.evaluate(uv, footprint).w <= smp.next());
 }
 
 }  // namespace etx
@@ -15,6 +15,16 @@ ETX_GPU_CODE float film_pdf_out(const Camera& camera, const float3& to_point) {
   return 1.0f / fabsf(camera.area * cos_t * cos_t * cos_t);
 }
 
+/*
+ * angle subtended by a single pixel, used as spread of the ray cone of camera rays
+ */
+ETX_GPU_CODE float pixel_spread_angle(const Camera& camera) {
+  if (camera.cls == Camera::Class::Equirectangular) {
+    return kDoublePi / float(max(1u, camera.image_size.x));
+  }
+  return 2.0f * camera.tan_half_fov / float(max(1u, camera.image_size.y));
+}
+
 ETX_GPU_CODE Ray generate_ray(Sampler& smp, const Scene& scene, const float2& uv) {
   ETX_CHECK_FINITE(uv);
 
@@ -2,13 +2,27 @@
 
 namespace etx {
 
-ETX_GPU_CODE float emitter_pdf_area_local(const Emitter& em, const Scene& scene) {
+ETX_GPU_CODE float emitter_pdf_area_local(const Emitter& em, const float3& barycentric, const Scene& scene) {
   ETX_ASSERT(em.is_local());
-  return 1.0f / em.triangle_area;
+  if (em.sampling_image_index == kInvalidIndex) {
+    return 1.0f / em.triangle_area;
+  }
+
+  const auto& table = scene.images[em.sampling_image_index];
+  return table.sampling_pdf(random_barycentric_inverse(barycentric)) / em.triangle_area;
+}
+
+ETX_GPU_CODE float3 emitter_sample_barycentric(const Emitter& em, const float2& rnd, const Scene& scene) {
+  if (em.sampling_image_index == kInvalidIndex) {
+    return random_barycentric(rnd);
+  }
+
+  uint2 location = {};
+  return random_barycentric(scene.images[em.sampling_image_index].sample(rnd, location));
 }
 
-ETX_GPU_CODE SpectralResponse emitter_get_radiance(const Emitter& em, const SpectralQuery spect, const float2& uv, const float3& pos, const float3& to_point, float& pdf_area,
-  float& pdf_dir, float& pdf_dir_out, const Scene& scene, const bool no_collimation) {
+ETX_GPU_CODE SpectralResponse emitter_get_radiance(const Emitter& em, const SpectralQuery spect, const float2& uv, const float3& barycentric, const float3& pos,
+  const float3& to_point, float& pdf_area, float& pdf_dir, float& pdf_dir_out, const Scene& scene, const bool no_collimation) {
   ETX_ASSERT(em.is_local());
 
   const auto& tri = scene.triangles[em.triangle_index];
@@ -18,7 +32,7 @@ ETX_GPU_CODE SpectralResponse emitter_get_radiance(const Emitter& em, const Spec
 
   auto dp = pos - to_point;
 
-  pdf_area = emitter_pdf_area_local(em, scene);
+  pdf_area = emitter_pdf_area_local(em, barycentric, scene);
   if (em.emission_direction == Emitter::Direction::Omni) {
     pdf_dir = pdf_area * dot(dp, dp);
     pdf_dir_out = pdf_area;
@@ -30,8 +44,8 @@ ETX_GPU_CODE SpectralResponse emitter_get_radiance(const Emitter& em, const Spec
   return apply_emitter_image(spect, em.emission, uv, scene);
 }
 
-ETX_GPU_CODE SpectralResponse emitter_evaluate_out_local(const Emitter& em, const SpectralQuery spect, const float2& uv, const float3& emitter_normal, const float3& direction,
-  float& pdf_area, float& pdf_dir, float& pdf_dir_out, const Scene& scene) {
+ETX_GPU_CODE SpectralResponse emitter_evaluate_out_local(const Emitter& em, const SpectralQuery spect, const float2& uv, const float3& barycentric, const float3& emitter_normal,
+  const float3& direction, float& pdf_area, float& pdf_dir, float& pdf_dir_out, const Scene& scene) {
   ETX_ASSERT(em.is_local());
 
   switch (em.emission_direction) {
@@ -50,7 +64,7 @@ ETX_GPU_CODE SpectralResponse emitter_evaluate_out_local(const Emitter& em, cons
   }
   ETX_ASSERT(pdf_dir > 0.0f);
 
-  pdf_area = emitter_pdf_area_local(em, scene);
+  pdf_area = emitter_pdf_area_local(em, barycentric, scene);
   ETX_ASSERT(pdf_area > 0.0f);
 
   pdf_dir_out = pdf_dir * pdf_area;
@@ -158,12 +172,12 @@ ETX_GPU_CODE EmitterSample emitter_sample_in(const Emitter& em, const SpectralQu
   switch (em.cls) {
     case Emitter::Class::Area: {
       const auto& tri = scene.triangles[em.triangle_index];
-      result.barycentric = random_barycentric(smp.next_2d());
+      result.barycentric = emitter_sample_barycentric(em, smp.next_2d(), scene);
       result.origin = lerp_pos(scene.vertices, tri, result.barycentric);
       result.normal = lerp_normal(scene.vertices, tri, result.barycentric);
       result.direction = normalize(result.origin - from_point);
-      result.value = emitter_get_radiance(em, spect, lerp_uv(scene.vertices, tri, result.barycentric), from_point, result.origin, result.pdf_area, result.pdf_dir,
-        result.pdf_dir_out, scene, false);
+      result.value = emitter_get_radiance(em, spect, lerp_uv(scene.vertices, tri, result.barycentric), result.barycentric, from_point, result.origin, result.pdf_area,
+        result.pdf_dir, result.pdf_dir_out, scene, false);
       break;
     }
 
@@ -235,13 +249,68 @@ ETX_GPU_CODE EmitterSample sample_emitter(SpectralQuery spect, uint32_t emitter_
   return sample;
 }
 
+ETX_GPU_CODE float3 emitter_sample_data(const EmitterSample& sample) {
+  return (sample.triangle_index == kInvalidIndex) ? sample.direction : sample.barycentric;
+}
+
+/*
+ * Reconstructs emitter sample from the data returned by emitter_sample_data (barycentric coordinates
+ * for area emitters and direction for distant ones), as seen from another point.
+ */
+ETX_GPU_CODE EmitterSample evaluate_emitter_sample(SpectralQuery spect, uint32_t emitter_index, const float3& sample_data, const float3& from_point, const Scene& scene) {
+  const auto& em = scene.emitters[emitter_index];
+
+  EmitterSample result = {{spect.wavelength, 0.0f}};
+  switch (em.cls) {
+    case Emitter::Class::Area: {
+      const auto& tri = scene.triangles[em.triangle_index];
+      result.barycentric = sample_data;
+      result.origin = lerp_pos(scene.vertices, tri, result.barycentric);
+      result.normal = lerp_normal(scene.vertices, tri, result.barycentric);
+      result.direction = normalize(result.origin - from_point);
+      result.value = emitter_get_radiance(em, spect, lerp_uv(scene.vertices, tri, result.barycentric), result.barycentric, from_point, result.origin, result.pdf_area,
+        result.pdf_dir, result.pdf_dir_out, scene, false);
+      break;
+    }
+
+    case Emitter::Class::Environment: {
+      result.direction = sample_data;
+      result.normal = -result.direction;
+      result.origin = from_point + result.direction * distance_to_sphere(from_point, result.direction, scene.bounding_sphere_center, scene.bounding_sphere_radius);
+      result.value = emitter_get_radiance(em, spect, result.direction, result.pdf_area, result.pdf_dir, result.pdf_dir_out, scene);
+      break;
+    }
+
+    case Emitter::Class::Directional: {
+      result.direction = sample_data;
+      result.normal = em.direction * (-1.0f);
+      result.origin = from_point + result.direction * distance_to_sphere(from_point, result.direction, scene.bounding_sphere_center, scene.bounding_sphere_radius);
+      result.pdf_area = 1.0f / (kPi * scene.bounding_sphere_radius * scene.bounding_sphere_radius);
+      result.pdf_dir = 1.0f;
+      result.pdf_dir_out = result.pdf_dir * result.pdf_area;
+      float2 uv = (em.angular_size > 0.0f) ? disk_uv(em.direction, result.direction, em.equivalent_disk_size, em.angular_size_cosine) : float2{0.5f, 0.5f};
+      result.value = apply_image(spect, em.emission, uv, scene);
+      break;
+    }
+
+    default:
+      return result;
+  }
+
+  result.pdf_sample = emitter_discrete_pdf(em, scene.emitters_distribution);
+  result.emitter_index = emitter_index;
+  result.triangle_index = em.triangle_index;
+  result.is_delta = em.is_delta();
+  return result;
+}
+
 ETX_GPU_CODE EmitterSample emitter_sample_out(const Emitter& em, const SpectralQuery spect, Sampler& smp, const struct Scene& scene) {
   EmitterSample result = {};
   switch (em.cls) {
     case Emitter::Class::Area: {
       const auto& tri = scene.triangles[em.triangle_index];
       result.triangle_index = em.triangle_index;
-      result.barycentric = random_barycentric(smp.next_2d());
+      result.barycentric = emitter_sample_barycentric(em, smp.next_2d(), scene);
       result.origin = lerp_pos(scene.vertices, tri, result.barycentric);
       result.normal = lerp_normal(scene.vertices, tri, result.barycentric);
       switch (em.emission_direction) {
@@ -271,8 +340,8 @@ ETX_GPU_CODE EmitterSample emitter_sample_out(const Emitter& em, const SpectralQ
         default:
           ETX_FAIL("Invalid direction");
       }
-      result.value = emitter_evaluate_out_local(em, spect, lerp_uv(scene.vertices, tri, result.barycentric), result.normal, result.direction,  //
-        result.pdf_area, result.pdf_dir, result.pdf_dir_out, scene);                                                                           //
+      result.value = emitter_evaluate_out_local(em, spect, lerp_uv(scene.vertices, tri, result.barycentric), result.barycentric, result.normal,  //
+        result.direction, result.pdf_area, result.pdf_dir, result.pdf_dir_out, scene);                                                          //
       break;
     }
 
@@ -22,6 +22,14 @@ constexpr float kLongestWavelength = static_cast<float>(LongestWavelength);
 constexpr float kWavelengthCount = static_cast<float>(WavelengthCount);
 constexpr float kYIntegral = 106.85689544677734375f;
 
+// spectral distributions are stored on a uniform grid with this step (in nm)
+constexpr uint32_t TableStep = 5u;
+constexpr uint32_t TableEntryCount = (WavelengthCount - 1u) / TableStep + 1u;
+
+ETX_GPU_CODE constexpr float table_wavelength(uint32_t i) {
+  return kShortestWavelength + float(i * TableStep);
+}
+
 ETX_GPU_CODE float3 spectral_xyz(uint32_t i) {
   ETX_ASSERT(i < WavelengthCount);
 
@@ -181,6 +189,29 @@ ETX_GPU_CODE float black_body_radiation(float wavelength_nm, float t_kelvins) {
   return isinf(d) ? 0.0f : (Lc1 / d);
 }
 
+/*
+ * in spectral mode each path carries kHeroLaneCount wavelengths: the sampled (hero) one
+ * and the others rotated uniformly over the visible range, one per SpectralResponse component
+ */
+constexpr uint32_t kHeroLaneCount = 3u;
+
+ETX_GPU_CODE float lane_wavelength(float hero_wavelength, uint32_t lane) {
+  float offset = hero_wavelength - kShortestWavelength + float(lane) * (kWavelengthCount / float(kHeroLaneCount));
+  return kShortestWavelength + (offset >= kWavelengthCount ? offset - kWavelengthCount : offset);
+}
+
+ETX_GPU_CODE float3 wavelength_to_xyz(float wavelength) {
+  if ((wavelength < kShortestWavelength) || (wavelength > kLongestWavelength)) {
+    return {};
+  }
+
+  float w = floorf(wavelength);
+  float dw = wavelength - w;
+  uint32_t i = static_cast<uint32_t>(w - kShortestWavelength);
+  uint32_t j = min(i + 1u, WavelengthCount - 1u);
+  return lerp<float3>(spectral_xyz(i), spectral_xyz(j), dw);
+}
+
 ETX_GPU_CODE SpectralQuery sample(float rnd) {
   if constexpr (kSpectralRendering) {
     return SpectralQuery{kShortestWavelength + rnd * kWavelengthCount};
@@ -204,10 +235,7 @@ struct ETX_ALIGNED SpectralResponse {
   float wavelength = 0.0f;
 
   constexpr static uint32_t component_count() {
-    if constexpr (spectrum::kSpectralRendering)
-      return 1u;
-    else
-      return 3u;
+    return 3u;
   }
 
   SpectralResponse() = default;
@@ -228,36 +256,26 @@ struct ETX_ALIGNED SpectralResponse {
         return {};
       }
 
-      float w = floorf(wavelength);
-      float dw = wavelength - w;
-      uint32_t i = static_cast<uint32_t>(w - spectrum::kShortestWavelength);
-      uint32_t j = min(i + 1u, spectrum::WavelengthCount - 1u);
-      float3 xyz0 = spectrum::spectral_xyz(i);
-      float3 xyz1 = spectrum::spectral_xyz(j);
-      return lerp<float3>(xyz0, xyz1, dw) * (components.x / spectrum::kYIntegral);
+      float3 xyz = spectrum::wavelength_to_xyz(spectrum::lane_wavelength(wavelength, 0u)) * components.x +
+                   spectrum::wavelength_to_xyz(spectrum::lane_wavelength(wavelength, 1u)) * components.y +
+                   spectrum::wavelength_to_xyz(spectrum::lane_wavelength(wavelength, 2u)) * components.z;
+      return xyz / (float(spectrum::kHeroLaneCount) * spectrum::kYIntegral);
     } else {
       return spectrum::rgb_to_xyz({components.x, components.y, components.z});
     }
   }
 
   ETX_GPU_CODE float minimum() const {
-    if constexpr (spectrum::kSpectralRendering) {
-      return components.x;
-    } else {
-      return min(components.x, min(components.y, components.z));
-    }
+    return min(components.x, min(components.y, components.z));
   }
 
   ETX_GPU_CODE float maximum() const {
-    if constexpr (spectrum::kSpectralRendering) {
-      return components.x;
-    } else {
-      return max(components.x, max(components.y, components.z));
-    }
+    return max(components.x, max(components.y, components.z));
   }
 
   ETX_GPU_CODE float monochromatic() const {
     if constexpr (spectrum::kSpectralRendering) {
+      // hero wavelength
       return components.x;
     } else {
       return luminance(components);
@@ -265,27 +283,26 @@ struct ETX_ALIGNED SpectralResponse {
   }
 
   ETX_GPU_CODE float sum() const {
-    if constexpr (spectrum::kSpectralRendering) {
-      return components.x;
-    } else {
-      return components.x + components.y + components.z;
-    }
+    return components.x + components.y + components.z;
   }
 
   ETX_GPU_CODE float average() const {
-    if constexpr (spectrum::kSpectralRendering) {
-      return components.x;
-    } else {
-      return (components.x + components.y + components.z) / 3.0f;
-    }
+    return (components.x + components.y + components.z) / 3.0f;
   }
 
   ETX_GPU_CODE float component(uint32_t i) const {
+    ETX_ASSERT(i < 3);
+    return *(&components.x + i);
+  }
+
+  /*
+   * terminates secondary wavelengths, used when path direction depends on wavelength (dispersion)
+   */
+  ETX_GPU_CODE SpectralResponse collapse_to_hero() const {
     if constexpr (spectrum::kSpectralRendering) {
-      return components.x;
+      return {wavelength, {components.x * float(spectrum::kHeroLaneCount), 0.0f, 0.0f}};
     } else {
-      ETX_ASSERT(i < 3);
-      return *(&components.x + i);
+      return *this;
     }
   }
 
@@ -440,10 +457,14 @@ struct ETX_ALIGNED SpectralDistribution {
     Illuminant,
   };
 
-  struct {
-    float wavelength = 0.0f;
-    float power = 0.0f;
-  } entries[spectrum::WavelengthCount] = {};
+  /*
+   * spectral mode keeps values on a uniform wavelength grid (spectrum::TableStep) for O(1) lookup,
+   * entry i is at spectrum::table_wavelength(i), so wavelengths are not stored;
+   * RGB mode keeps only three components
+   */
+  static constexpr uint32_t kEntryCount = spectrum::kSpectralRendering ? spectrum::TableEntryCount : 3u;
+
+  float power[kEntryCount] = {};
   uint32_t count = 0u;
 
  public:  // device
@@ -453,26 +474,16 @@ struct ETX_ALIGNED SpectralDistribution {
         return {q.wavelength, 0.0f};
       }
 
-      uint32_t i = lower_bound(q.wavelength);
-      if (i >= count) {
-        return {q.wavelength, 0.0f};
-      }
-
-      if ((i == 0) && (q.wavelength < entries[i].wavelength)) {
-        return {q.wavelength, entries[i].power};
-      }
-
-      if (i + 1 == count) {
-        return {q.wavelength, entries[i].power};
-      }
-
-      uint32_t j = min(i + 1u, count - 1);
-      float t = (q.wavelength - entries[i].wavelength) / (entries[j].wavelength - entries[i].wavelength);
-      float p = lerp(entries[i].power, entries[j].power, t);
-      ETX_VALIDATE(p);
-      return SpectralResponse{q.wavelength, p};
+      return SpectralResponse{
+        q.wavelength,
+        {
+          value_at(spectrum::lane_wavelength(q.wavelength, 0u)),
+          value_at(spectrum::lane_wavelength(q.wavelength, 1u)),
+          value_at(spectrum::lane_wavelength(q.wavelength, 2u)),
+        },
+      };
     } else {
-      return SpectralResponse{q.wavelength, {entries[0].power, entries[1].power, entries[2].power}};
+      return SpectralResponse{q.wavelength, {power[0], power[1], power[2]}};
     }
   }
 
@@ -480,23 +491,22 @@ struct ETX_ALIGNED SpectralDistribution {
     return query(q);
   }
 
-  ETX_GPU_CODE uint32_t lower_bound(float wavelength) const {
-    uint32_t b = 0;
-    uint32_t e = count;
-    do {
-      uint32_t m = b + (e - b) / 2;
-      if (entries[m].wavelength > wavelength) {
-        e = m;
-      } else {
-        b = m;
-      }
-    } while ((e - b) > 1);
-    return b;
+  ETX_GPU_CODE float value_at(float wavelength) const {
+    if (count == 0) {
+      return 0.0f;
+    }
+
+    float x = clamp((wavelength - spectrum::kShortestWavelength) / float(spectrum::TableStep), 0.0f, float(count - 1u));
+    uint32_t i = static_cast<uint32_t>(x);
+    uint32_t j = min(i + 1u, count - 1u);
+    float p = lerp(power[i], power[j], x - float(i));
+    ETX_VALIDATE(p);
+    return p;
   }
 
-  ETX_SHARED_CODE void make_constant(float power) {
+  ETX_SHARED_CODE void make_constant(float value) {
     for (uint32_t i = 0; i < count; ++i) {
-      entries[i].power = power;
+      power[i] = value;
     }
   }
 
@@ -506,7 +516,7 @@ struct ETX_ALIGNED SpectralDistribution {
 
   ETX_GPU_CODE bool is_zero() const {
     for (uint32_t i = 0; i < count; ++i) {
-      if (entries[i].power != 0.0f) {
+      if (power[i] != 0.0f) {
         return false;
       }
     }
@@ -516,25 +526,25 @@ struct ETX_ALIGNED SpectralDistribution {
  public:
   SpectralDistribution& operator*=(float other) {
     for (uint32_t i = 0; i < count; ++i) {
-      entries[i].power *= other;
+      power[i] *= other;
     }
     return *this;
   }
   SpectralDistribution& operator/=(float other) {
     for (uint32_t i = 0; i < count; ++i) {
-      entries[i].power /= other;
+      power[i] /= other;
     }
     return *this;
   }
   SpectralDistribution& operator+=(float other) {
     for (uint32_t i = 0; i < count; ++i) {
-      entries[i].power += other;
+      power[i] += other;
     }
     return *this;
   }
   SpectralDistribution& operator-=(float other) {
     for (uint32_t i = 0; i < count; ++i) {
-      entries[i].power -= other;
+      power[i] -= other;
     }
     return *this;
   }
@@ -571,19 +581,19 @@ struct ETX_ALIGNED SpectralDistribution {
   static constexpr SpectralDistribution from_constant(float value) {
     SpectralDistribution result;
     if constexpr (spectrum::kSpectralRendering) {
-      result.count = 2;
-      result.entries[0] = {spectrum::kShortestWavelength, value};
-      result.entries[1] = {spectrum::kLongestWavelength, value};
+      result.count = kEntryCount;
+      for (uint32_t i = 0; i < kEntryCount; ++i) {
+        result.power[i] = value;
+      }
     } else {
       result.count = 3;
-      result.entries[0] = {spectrum::kUndefinedWavelength, value};
-      result.entries[1] = {spectrum::kUndefinedWavelength, value};
-      result.entries[2] = {spectrum::kUndefinedWavelength, value};
+      result.power[0] = value;
+      result.power[1] = value;
+      result.power[2] = value;
     }
     return result;
   }
 
-  static SpectralDistribution from_samples(const float wavelengths[], const float power[], uint32_t count);
   static SpectralDistribution from_samples(const float wavelengths[], const float power[], uint32_t count, Class cls, Pointer<Spectrums>);
   static SpectralDistribution from_samples(const float2 wavelengths_power[], uint32_t count, Class cls, Pointer<Spectrums>);
   static SpectralDistribution from_black_body(float temperature, Pointer<Spectrums>);
@@ -615,6 +625,14 @@ struct RefractiveIndex {
       return {eta.monochromatic(), k.monochromatic()};
     }
 
+    ETX_GPU_CODE bool dispersive() const {
+      if constexpr (spectrum::kSpectralRendering) {
+        return (eta.components.x != eta.components.y) || (eta.components.x != eta.components.z);
+      } else {
+        return false;
+      }
+    }
+
     ETX_GPU_CODE Sample operator/(const Sample& other) const {
       return {wavelength, eta / other.eta, k / other.eta};
     }
@@ -700,36 +718,61 @@ ETX_GPU_CODE void compute_weights(const float3& rgb, float weights[Color::Count]
   }
 }
 
+ETX_GPU_CODE float spd_value(float wavelength, const float weights[Color::Count], const SpectrumSet& spectrums) {
+  constexpr float kSampleWavelengths[SampleCount] = {380.000000f, 390.967743f, 401.935486f, 412.903229f, 423.870972f, 434.838715f, 445.806458f, 456.774200f, 467.741943f,
+    478.709686f, 489.677429f, 500.645172f, 511.612915f, 522.580627f, 533.548340f, 544.516052f, 555.483765f, 566.451477f, 577.419189f, 588.386902f, 599.354614f, 610.322327f,
+    621.290039f, 632.257751f, 643.225464f, 654.193176f, 665.160889f, 676.128601f, 687.096313f, 698.064026f, 709.031738f, 720.000000f};
+
+  uint32_t i = 0;
+  uint32_t e = SampleCount;
+  do {
+    uint32_t m = i + (e - i) / 2;
+    if (kSampleWavelengths[m] > wavelength) {
+      e = m;
+    } else {
+      i = m;
+    }
+  } while ((e - i) > 1);
+
+  uint32_t j = min(i + 1u, SampleCount - 1u);
+
+  float t;
+  if ((i == 0) && (wavelength < kSampleWavelengths[0])) {
+    t = 0.0f;
+  } else if (i + 1 == SampleCount) {
+    t = 1.0f;
+  } else {
+    t = (wavelength - kSampleWavelengths[i]) / (kSampleWavelengths[j] - kSampleWavelengths[i]);
+  }
+
+  float p = weights[0] * lerp(spectrums.values[0][i], spectrums.values[0][j], t) +  //
+            weights[1] * lerp(spectrums.values[1][i], spectrums.values[1][j], t) +  //
+            weights[2] * lerp(spectrums.values[2][i], spectrums.values[2][j], t) +  //
+            weights[3] * lerp(spectrums.values[3][i], spectrums.values[3][j], t) +  //
+            weights[4] * lerp(spectrums.values[4][i], spectrums.values[4][j], t) +  //
+            weights[5] * lerp(spectrums.values[5][i], spectrums.values[5][j], t) +  //
+            weights[6] * lerp(spectrums.values[6][i], spectrums.values[6][j], t);
+
+  return max(0.0f, p);
+}
+
 ETX_GPU_CODE SpectralDistribution make_spd(float3 rgb, const SpectrumSet& spectrums) {
   rgb = max(float3{0.0f, 0.0f, 0.0f}, rgb);
 
   SpectralDistribution r;
   if constexpr (spectrum::kSpectralRendering == false) {
     r.count = 3;
-    r.entries[0] = {spectrum::kUndefinedWavelength, rgb.x};
-    r.entries[1] = {spectrum::kUndefinedWavelength, rgb.y};
-    r.entries[2] = {spectrum::kUndefinedWavelength, rgb.z};
+    r.power[0] = rgb.x;
+    r.power[1] = rgb.y;
+    r.power[2] = rgb.z;
   } else {
-    constexpr float wavelengths[SampleCount] = {380.000000f, 390.967743f, 401.935486f, 412.903229f, 423.870972f, 434.838715f, 445.806458f, 456.774200f, 467.741943f, 478.709686f,
-      489.677429f, 500.645172f, 511.612915f, 522.580627f, 533.548340f, 544.516052f, 555.483765f, 566.451477f, 577.419189f, 588.386902f, 599.354614f, 610.322327f, 621.290039f,
-      632.257751f, 643.225464f, 654.193176f, 665.160889f, 676.128601f, 687.096313f, 698.064026f, 709.031738f, 720.000000f};
-
     float weights[Color::Count] = {};
     compute_weights(rgb, weights);
 
-    r.count = SampleCount;
-    for (uint32_t i = 0; i < SampleCount; ++i) {
-      r.entries[i].wavelength = wavelengths[i];
-      r.entries[i].power = weights[0] * spectrums.values[0][i] +  //
-                           weights[1] * spectrums.values[1][i] +  //
-                           weights[2] * spectrums.values[2][i] +  //
-                           weights[3] * spectrums.values[3][i] +  //
-                           weights[4] * spectrums.values[4][i] +  //
-                           weights[5] * spectrums.values[5][i] +  //
-                           weights[6] * spectrums.values[6][i];
-    }
+    r.count = SpectralDistribution::kEntryCount;
     for (uint32_t i = 0; i < r.count; ++i) {
-      r.entries[i].power = max(0.0f, r.entries[i].power);
+      float wavelength = spectrum::table_wavelength(i);
+      r.power[i] = spd_value(wavelength, weights, spectrums);
     }
   }
   return r;
@@ -747,53 +790,56 @@ ETX_GPU_CODE SpectralResponse query_spd(const SpectralQuery spect, const float3&
   if constexpr (spectrum::kSpectralRendering == false) {
     return SpectralResponse(spect.wavelength, rgb);
   } else {
-    constexpr float wavelengths[SampleCount] = {380.000000f, 390.967743f, 401.935486f, 412.903229f, 423.870972f, 434.838715f, 445.806458f, 456.774200f, 467.741943f, 478.709686f,
-      489.677429f, 500.645172f, 511.612915f, 522.580627f, 533.548340f, 544.516052f, 555.483765f, 566.451477f, 577.419189f, 588.386902f, 599.354614f, 610.322327f, 621.290039f,
-      632.257751f, 643.225464f, 654.193176f, 665.160889f, 676.128601f, 687.096313f, 698.064026f, 709.031738f, 720.000000f};
-
-    uint32_t i = 0;
-    uint32_t e = SampleCount;
-    do {
-      uint32_t m = i + (e - i) / 2;
-      if (wavelengths[m] > spect.wavelength) {
-        e = m;
-      } else {
-        i = m;
-      }
-    } while ((e - i) > 1);
-
-    if (i >= SampleCount) {
-      return {spect.wavelength, 0.0f};
-    }
-
-    uint32_t j = min(i + 1u, SampleCount - 1u);
-
-    float t;
-    if ((i == 0) && (spect.wavelength < wavelengths[0])) {
-      t = 0.0f;
-    } else if (i + 1 == SampleCount) {
-      t = 1.0f;
-    } else {
-      t = (spect.wavelength - wavelengths[i]) / (wavelengths[j] - wavelengths[i]);
-    }
-
     float weights[Color::Count] = {};
     compute_weights(rgb, weights);
 
-    float p = weights[0] * lerp(spectrums.values[0][i], spectrums.values[0][j], t) +  //
-              weights[1] * lerp(spectrums.values[1][i], spectrums.values[1][j], t) +  //
-              weights[2] * lerp(spectrums.values[2][i], spectrums.values[2][j], t) +  //
-              weights[3] * lerp(spectrums.values[3][i], spectrums.values[3][j], t) +  //
-              weights[4] * lerp(spectrums.values[4][i], spectrums.values[4][j], t) +  //
-              weights[5] * lerp(spectrums.values[5][i], spectrums.values[5][j], t) +  //
-              weights[6] * lerp(spectrums.values[6][i], spectrums.values[6][j], t);
+    return SpectralResponse{
+      spect.wavelength,
+      {
+        spd_value(spectrum::lane_wavelength(spect.wavelength, 0u), weights, spectrums),
+        spd_value(spectrum::lane_wavelength(spect.wavelength, 1u), weights, spectrums),
+        spd_value(spectrum::lane_wavelength(spect.wavelength, 2u), weights, spectrums),
+      },
+    };
+  }
+}
+
+/*
+ * smooth reflectance spectrum given by three coefficients of a quadratic polynomial over normalized wavelength,
+ * mapped to [0, 1] with an algebraic sigmoid; images can store the coefficients per texel (see Image::SpectralCoefficients)
+ */
+ETX_GPU_CODE float sigmoid_polynomial(const float3& c, float wavelength) {
+  float x = (wavelength - spectrum::kShortestWavelength) / (spectrum::kLongestWavelength - spectrum::kShortestWavelength);
+  float v = (c.x * x + c.y) * x + c.z;
+  return 0.5f + 0.5f * v / sqrtf(1.0f + v * v);
+}
 
-    return SpectralResponse{spect.wavelength, max(0.0f, p)};
+ETX_GPU_CODE SpectralResponse query_coefficients(const SpectralQuery spect, const float3& c) {
+  if constexpr (spectrum::kSpectralRendering == false) {
+    return SpectralResponse(spect.wavelength, c);
+  } else {
+    return SpectralResponse{
+      spect.wavelength,
+      {
+        sigmoid_polynomial(c, spectrum::lane_wavelength(spect.wavelength, 0u)),
+        sigmoid_polynomial(c, spectrum::lane_wavelength(spect.wavelength, 1u)),
+        sigmoid_polynomial(c, spectrum::lane_wavelength(spect.wavelength, 2u)),
+      },
+    };
   }
 }
 
 void init_spectrums(Spectrums&);
 
+/*
+ * coefficients of spectra having the same colors as the ones produced by `make_spd` for RGB values on a regular grid,
+ * table holds kCoefficientTableSize^3 entries with red changing fastest
+ */
+constexpr uint32_t kCoefficientTableSize = 33u;
+
+void build_coefficient_table(const SpectrumSet& spectrums, float3 table[]);
+float3 lookup_coefficients(const float3 table[], const float3& rgb);
+
 }  // namespace rgb
 
 }  // namespace etx
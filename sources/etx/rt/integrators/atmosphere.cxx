@@ -4,94 +4,12 @@
 #include <etx/render/shared/bsdf.hxx>
 #include <etx/render/host/rnd_sampler.hxx>
 #include <etx/render/host/film.hxx>
+#include <etx/render/host/atmosphere.hxx>
 
 #include <etx/rt/integrators/atmosphere.hxx>
 
 namespace etx {
 
-constexpr float kMaxSteps = 256.0f;
-
-inline float scattering_rayleigh(float l) {
-  l /= 100.0f;
-  float l2 = l * l;
-  return 1.169939f / (l2 * l2 * 100.0f);
-}
-
-inline float scattering_mie(float l) {
-  constexpr float scale = 0.3954608f * (kPi * kPi * kPi);
-  return scale / (l * l);
-}
-
-inline float ozone_absorbtion(float l) {
-  const float na = 6.022140857f /* e+23f cancelled with base */;
-  const float concentration = 41.58f * 0.000001f;
-  float x = l;
-  float x2 = x * x;
-  float x3 = x2 * x;
-  float x4 = x2 * x2;
-  float x5 = x4 * x;
-  float x6 = x4 * x2;
-  float base = max(0.0f, -1.109902e-15f * x6 + 3.950001e-12f * x5 - 5.784719e-09f * x4 + 4.460262e-06f * x3 - 1.909367e-03f * x2 + 4.303677e-01f * x - 3.992226e+01f);
-  return base * na * concentration;
-}
-
-inline float ozone_vertical_profile(float h) {
-  float x = h / 1000.0f;
-  float x2 = x * x;
-  float x3 = x2 * x;
-  float x4 = x2 * x2;
-  float x5 = x4 * x;
-  float x6 = x3 * x3;
-  float f = 3.759384E-08f * x6 - 1.067250E-05f * x5 + 1.080311E-03f * x4 - 4.851181E-02f * x3 + 9.185432E-01f * x2 - 4.886021E+00f * x + 7.900478E+00f;
-  const float n = 30.8491249f;
-  return max(0.0f, f / n);
-}
-
-inline float3 density(float height_above_ground) {
-  constexpr float density_h_r = 7994.0f;
-  constexpr float density_h_m = 1200.0f;
-  height_above_ground = max(0.0f, height_above_ground);
-  return {expf(-height_above_ground / density_h_r), expf(-height_above_ground / density_h_m), ozone_vertical_profile(height_above_ground)};
-}
-
-inline constexpr float3 density_k() {
-  constexpr float density_h_r = 7994.0f;
-  constexpr float density_h_m = 1200.0f;
-  return {-1.0f / density_h_r, -1.0f / density_h_m, 0.0f};
-}
-
-inline float3 optical_length(float3 p, const float3& target, Sampler& smp, float opt_step_scale) {
-  constexpr auto d_k = density_k();
-  const float delta_density = 0.025f;
-
-  float3 result = {};
-
-  float3 dp = (target - p);
-  float total_distance = length(dp);
-  dp /= total_distance;
-  float t = 0.0f;
-  while (t < total_distance) {
-    float3 current_density = density(length(p) - kPlanetRadius);
-    float r_step = -logf(delta_density / current_density.x + 1.0f) / d_k.x;
-    float m_step = -logf(delta_density / current_density.y + 1.0f) / d_k.y;
-    float dt = min(total_distance - t, min(r_step, m_step) * (1.0f + opt_step_scale * smp.next()));
-
-    p += dp * dt;
-    t += dt;
-
-    result += dt * density(length(p) - kPlanetRadius);
-  }
-  return result;
-}
-
-inline float phase_rayleigh(float l_dot_v) {
-  return (3.0f / 4.0f) * (1.0f + l_dot_v * l_dot_v) * (1.0f / (4.0f * kPi));
-}
-
-inline float phase_mie(float l_dot_v, float g) {
-  return (3.0f / 2.0f) * ((1.0f - g * g) * (1.0f + l_dot_v * l_dot_v)) / ((2.0f + g * g) * powf(1.0f + g * g - 2.0f * g * l_dot_v, 1.5f)) * (1.0f / (4.0f * kPi));
-}
-
 struct CPUAtmosphereImpl : public Task {
   Raytracing& rt;
   Film camera_image;
@@ -103,20 +21,15 @@ struct CPUAtmosphereImpl : public Task {
   Task::Handle current_task = {};
   uint32_t iteration = 0u;
   uint32_t opt_max_iterations = 4u;
-  float opt_phase_function_g = 0.75f;
   float opt_step_scale = 10.0f;
-  float opt_rayleigh = 1.0f;
-  float opt_mie = 1.0f;
-  float opt_ozone = 1.0f;
   float total_time_value = 0.0f;
   bool opt_render_sun = false;
 
   std::atomic<uint32_t> pixels_processed = {};
   std::atomic<Integrator::State>* state = nullptr;
 
-  SpectralDistribution rayleigh = {};
-  SpectralDistribution mie = {};
-  SpectralDistribution ozone = {};
+  Atmosphere atmosphere;
+  Atmosphere::Parameters parameters = {};
 
   CPUAtmosphereImpl(Raytracing& a_rt, std::atomic<Integrator::State>* st)
     : rt(a_rt)
@@ -124,49 +37,21 @@ struct CPUAtmosphereImpl : public Task {
     , state(st) {
   }
 
-  void init_spectrums() {
-    if (rayleigh.count > 0) {
-      return;
-    }
-
-    for (uint32_t w = spectrum::ShortestWavelength; w <= spectrum::LongestWavelength; ++w) {
-      uint32_t i = w - spectrum::ShortestWavelength;
-      rayleigh.entries[i] = {float(w), scattering_rayleigh(float(w))};
-      mie.entries[i] = {float(w), scattering_mie(float(w))};
-      ozone.entries[i] = {float(w), ozone_absorbtion(float(w))};
-    }
-    rayleigh.count = spectrum::WavelengthCount;
-    mie.count = spectrum::WavelengthCount;
-    ozone.count = spectrum::WavelengthCount;
-
-    if constexpr (spectrum::kSpectralRendering == false) {
-      auto xyz = rayleigh.integrate_to_xyz();
-      rayleigh = rgb::make_reflectance_spd(spectrum::xyz_to_rgb(xyz), rt.scene().spectrums);
-    }
-    if constexpr (spectrum::kSpectralRendering == false) {
-      auto xyz = mie.integrate_to_xyz();
-      mie = rgb::make_reflectance_spd(spectrum::xyz_to_rgb(xyz), rt.scene().spectrums);
-    }
-    if constexpr (spectrum::kSpectralRendering == false) {
-      auto xyz = ozone.integrate_to_xyz();
-      ozone = rgb::make_reflectance_spd(spectrum::xyz_to_rgb(xyz), rt.scene().spectrums);
-    }
-  }
-
   bool running() const {
     return (state->load() == Integrator::State::Preview) || (state->load() == Integrator::State::Running);
   }
 
   void start(const Options& opt) {
-    init_spectrums();
-
     opt_max_iterations = opt.get("spp", opt_max_iterations).to_integer();
-    opt_phase_function_g = opt.get("g", opt_phase_function_g).to_float();
     opt_step_scale = opt.get("step", opt_step_scale).to_float();
     opt_render_sun = opt.get("sun", opt_render_sun).to_bool();
-    opt_rayleigh = opt.get("r", opt_rayleigh).to_float();
-    opt_mie = opt.get("m", opt_mie).to_float();
-    opt_ozone = opt.get("o", opt_ozone).to_float();
+    parameters.anisotropy = opt.get("g", parameters.anisotropy).to_float();
+    parameters.rayleigh = opt.get("r", parameters.rayleigh).to_float();
+    parameters.mie = opt.get("m", parameters.mie).to_float();
+    parameters.ozone = opt.get("o", parameters.ozone).to_float();
+    parameters.multiple_scattering = opt.get("ms", parameters.multiple_scattering).to_bool();
+
+    atmosphere.build(rt.scheduler(), parameters, rt.scene().spectrums);
 
     iteration = 0;
     snprintf(status, sizeof(status), "[%u] %s ...", iteration, (state->load() == Integrator::State::Running ? "Running" : "Preview"));
@@ -191,77 +76,33 @@ struct CPUAtmosphereImpl : public Task {
   }
 
   float3 trace_pixel(RNDSampler& smp, const float2& uv) {
-    constexpr float kSphereSize = kPlanetRadius + kAtmosphereRadius;
+    constexpr uint32_t entry_count = Atmosphere::kEntryCount;
 
     auto& scene = rt.scene();
 
     auto ray = generate_ray(smp, scene, uv);
-    float to_space = distance_to_sphere(ray.o, ray.d, {}, kSphereSize);
-
     float to_planet = distance_to_sphere(ray.o, ray.d, {}, kPlanetRadius);
-    if (to_planet > 0.0f) {
-      to_space = to_planet;
-    }
-
-    const uint32_t entry_count = spectrum::kSpectralRendering ? spectrum::WavelengthCount : 3;
 
     SpectralDistribution result = {{}, entry_count};
-    for (uint32_t i = 0; i < entry_count; ++i) {
-      result.entries[i].wavelength = float(spectrum::ShortestWavelength + i);
-    }
 
-    float3 position = ray.o;
     float3 total_optical_path = {};
-    float t = 0.0f;
-
-    constexpr auto d_k = density_k();
-    const float delta_density = 0.025f;
-
-    while (running() && (t < to_space)) {
-      float3 current_density = density(length(position) - kPlanetRadius);
-      float r_step = -logf(delta_density / current_density.x + 1.0f) / d_k.x;
-      float m_step = -logf(delta_density / current_density.y + 1.0f) / d_k.y;
-      float dt = min(to_space - t, min(r_step, m_step) * (1.0f + opt_step_scale * smp.next()));
-      position += ray.d * dt;
-      t += dt;
-
-      float3 d = dt * density(length(position) - kPlanetRadius);
-
-      for (uint32_t i = 0; i < scene.environment_emitters.count; ++i) {
-        auto local_em = sample_emitter({0.5f * (spectrum::kShortestWavelength + spectrum::kLongestWavelength)}, i, smp, ray.o, scene);
-        auto cos_t = dot(local_em.direction, ray.d);
-        auto phase_r = phase_rayleigh(cos_t);
-        auto phase_m = phase_mie(cos_t, opt_phase_function_g);
-        auto distance_to_space = distance_to_sphere(position, local_em.direction, {}, kSphereSize);
-        auto optical_path = optical_length(position, position + distance_to_space * local_em.direction, smp, opt_step_scale);
-        const auto& em = scene.emitters[local_em.emitter_index];
-        float3 current_optical_path = total_optical_path + optical_path;
+    float values[entry_count] = {};
 
-        if constexpr (spectrum::kSpectralRendering) {
-          for (uint32_t s = 0; s < entry_count; ++s) {
-            float e = em.emission.spectrum.query({float(spectrum::ShortestWavelength + s)}).components.x;
-            auto value = expf(-current_optical_path.x * rayleigh.entries[s].power * opt_rayleigh -  //
-                              current_optical_path.y * mie.entries[s].power * opt_mie -             //
-                              current_optical_path.z * ozone.entries[s].power * opt_ozone);
-            result.entries[s].power += e * value * (d.x * phase_r * rayleigh.entries[s].power * opt_rayleigh + d.y * phase_m * mie.entries[s].power * opt_mie);
-            ETX_VALIDATE(result.entries[s].power);
-          }
-        } else {
-          auto e = em.emission.spectrum.query({-1.0f});
-          float accum[3] = {};
-          for (uint32_t s = 0; s < entry_count; ++s) {
-            auto value = expf(-current_optical_path.x * rayleigh.entries[s].power * opt_rayleigh  //
-                              - current_optical_path.y * mie.entries[s].power * opt_mie           //
-                              - current_optical_path.z * ozone.entries[s].power * opt_ozone);
-            accum[s] = value * (d.x * phase_r * rayleigh.entries[s].power * opt_rayleigh + d.y * phase_m * mie.entries[s].power * opt_mie);
-            ETX_VALIDATE(result.entries[s].power);
-          }
-          result.entries[0].power += e.components.x * accum[0];
-          result.entries[1].power += e.components.y * accum[1];
-          result.entries[2].power += e.components.z * accum[2];
-        }
+    for (uint32_t i = 0; running() && (i < scene.environment_emitters.count); ++i) {
+      auto local_em = sample_emitter({0.5f * (spectrum::kShortestWavelength + spectrum::kLongestWavelength)}, i, smp, ray.o, scene);
+      total_optical_path = atmosphere.in_scattering(ray.o, ray.d, local_em.direction, opt_step_scale, smp, values);
 
-        total_optical_path += d;
+      const auto& em = scene.emitters[local_em.emitter_index];
+      if constexpr (spectrum::kSpectralRendering) {
+        for (uint32_t s = 0; s < entry_count; ++s) {
+          float e = em.emission.spectrum.query({spectrum::table_wavelength(s)}).components.x;
+          result.power[s] += e * values[s];
+        }
+      } else {
+        auto e = em.emission.spectrum.query({-1.0f});
+        result.power[0] += e.components.x * values[0];
+        result.power[1] += e.components.y * values[1];
+        result.power[2] += e.components.z * values[2];
       }
     }
 
@@ -272,19 +113,14 @@ struct CPUAtmosphereImpl : public Task {
         float scale = 1.0f / (kDoublePi * (1.0f - cosf(0.5f * scene.emitters[e_index].angular_size)));
         if constexpr (spectrum::kSpectralRendering) {
           for (uint32_t s = 0; s < entry_count; ++s) {
-            auto em = emitter_get_radiance(scene.emitters[e_index], {float(spectrum::ShortestWavelength + s)}, ray.d, pdfs[0], pdfs[1], pdfs[2], scene);
-            result.entries[s].power +=
-              scale * em.components.x * expf(-total_optical_path.x * rayleigh.entries[s].power * opt_rayleigh - total_optical_path.y * mie.entries[s].power * opt_mie);
+            auto em = emitter_get_radiance(scene.emitters[e_index], {spectrum::table_wavelength(s)}, ray.d, pdfs[0], pdfs[1], pdfs[2], scene);
+            result.power[s] += scale * em.components.x * atmosphere.transmittance(total_optical_path, s);
           }
         } else {
           auto em = emitter_get_radiance(scene.emitters[e_index], {-1.0f}, ray.d, pdfs[0], pdfs[1], pdfs[2], scene);
-          float accum[3] = {};
-          for (uint32_t s = 0; s < entry_count; ++s) {
-            accum[s] = scale * expf(-total_optical_path.x * rayleigh.entries[s].power * opt_rayleigh - total_optical_path.y * mie.entries[s].power * opt_mie);
-          }
-          result.entries[0].power += accum[0] * em.components.x;
-          result.entries[1].power += accum[1] * em.components.y;
-          result.entries[2].power += accum[2] * em.components.z;
+          result.power[0] += scale * em.components.x * atmosphere.transmittance(total_optical_path, 0);
+          result.power[1] += scale * em.components.y * atmosphere.transmittance(total_optical_path, 1);
+          result.power[2] += scale * em.components.z * atmosphere.transmittance(total_optical_path, 2);
         }
       }
     }
@@ -393,12 +229,13 @@ void CPUAtmosphere::stop(Stop st) {
 Options CPUAtmosphere::options() const {
   Options result = {};
   result.add(1u, _private->opt_max_iterations, 0xffffu, "spp", "Samples per Pixel");
-  result.add(-1.0f, _private->opt_phase_function_g, 1.0f, "g", "Asymmetry Factor");
+  result.add(-1.0f, _private->parameters.anisotropy, 1.0f, "g", "Asymmetry Factor");
   result.add(0.0f, _private->opt_step_scale, 100.0f, "step", "Step Scale");
   result.add(_private->opt_render_sun, "sun", "Render Sun");
-  result.add(0.0f, _private->opt_rayleigh, 100.0f, "r", "Rayleigh Scattering");
-  result.add(0.0f, _private->opt_mie, 100.0f, "m", "Mie Scattering");
-  result.add(0.0f, _private->opt_ozone, 100.0f, "o", "Ozone");
+  result.add(0.0f, _private->parameters.rayleigh, 100.0f, "r", "Rayleigh Scattering");
+  result.add(0.0f, _private->parameters.mie, 100.0f, "m", "Mie Scattering");
+  result.add(0.0f, _private->parameters.ozone, 100.0f, "o", "Ozone");
+  result.add(_private->parameters.multiple_scattering, "ms", "Multiple Scattering");
   return result;
 }
 
@@ -21,12 +21,6 @@ struct CPUBidirectionalImpl : public Task {
     uint32_t emitter_index = kInvalidIndex;
     uint32_t medium_index = kInvalidIndex;
     SpectralResponse throughput = {};
-    struct {
-      float forward = 0.0f;
-      float backward = 0.0f;
-    } pdf;
-
-    bool delta = false;
 
     PathVertex() = default;
 
@@ -73,40 +67,74 @@ struct CPUBidirectionalImpl : public Task {
     float pdf_solid_angle_to_area(float pdf_dir, const PathVertex& to_vertex) const;
   };
 
-  template <class T>
-  struct ReplaceInScope {
-    ReplaceInScope(const ReplaceInScope&) = delete;
-    ReplaceInScope& operator=(const ReplaceInScope&) = delete;
+  // Subpath vertices with MIS quantities kept in separate arrays. `mis_sum` holds the running
+  // sum of reverse-to-forward pdf ratio products along the subpath, which makes the MIS
+  // weight of any connection depend only on the connected vertices and their predecessors.
+  struct SubPath {
+    std::vector<PathVertex> vertices;
+    std::vector<float> pdf_forward;
+    std::vector<float> pdf_backward;
+    std::vector<float> mis_sum;
+    std::vector<uint8_t> delta;
+
+    uint64_t size() const {
+      return vertices.size();
+    }
+
+    const PathVertex& operator[](uint64_t i) const {
+      return vertices[i];
+    }
 
-    ReplaceInScope() {
+    PathVertex& operator[](uint64_t i) {
+      return vertices[i];
     }
 
-    ReplaceInScope(T* destination, const T& new_value)
-      : ptr(destination)
-      , old_value(*destination) {
-      *destination = new_value;
+    void reserve(uint64_t count) {
+      vertices.reserve(count);
+      pdf_forward.reserve(count);
+      pdf_backward.reserve(count);
+      mis_sum.reserve(count);
+      delta.reserve(count);
     }
 
-    ReplaceInScope& operator=(ReplaceInScope&& r) noexcept {
-      ptr = r.ptr;
-      old_value = r.old_value;
-      r.ptr = nullptr;
-      return *this;
+    void clear() {
+      vertices.clear();
+      pdf_forward.clear();
+      pdf_backward.clear();
+      mis_sum.clear();
+      delta.clear();
     }
 
-    ~ReplaceInScope() {
-      if (ptr != nullptr) {
-        *ptr = old_value;
+    PathVertex& add(const PathVertex& v, float forward, bool is_delta) {
+      pdf_forward.emplace_back(forward);
+      pdf_backward.emplace_back(0.0f);
+      mis_sum.emplace_back(0.0f);
+      delta.emplace_back(is_delta ? 1u : 0u);
+      return vertices.emplace_back(v);
+    }
+
+    bool connectible(uint64_t i) const {
+      return (delta[i] == 0u) && (delta[i - 1u] == 0u);
+    }
+
+    // `term_count(i)` is the sample count of the strategy which ends the subpath at vertex i - 1
+    template <class F>
+    void update_mis(uint64_t first_vertex, F term_count) {
+      for (uint64_t i = first_vertex, e = size(); i < e; ++i) {
+        float r = pdf_ratio(pdf_backward[i], pdf_forward[i]);
+        mis_sum[i] = r * ((connectible(i) ? term_count(i) : 0.0f) + mis_sum[i - 1u]);
+        ETX_VALIDATE(mis_sum[i]);
       }
     }
 
-    T* ptr = nullptr;
-    T old_value = {};
+    static float pdf_ratio(float backward, float forward) {
+      return ((backward == 0.0f) ? 1.0f : backward) / ((forward == 0.0f) ? 1.0f : forward);
+    }
   };
 
   struct PathData {
-    std::vector<PathVertex> camera_path;
-    std::vector<PathVertex> emitter_path;
+    SubPath camera_path;
+    SubPath emitter_path;
   };
 
   char status[2048] = {};
@@ -120,8 +148,16 @@ struct CPUBidirectionalImpl : public Task {
   TimeMeasure total_time = {};
   TimeMeasure iteration_time = {};
   Handle current_task = {};
+  Handle pool_task = {};
   uint32_t iteration = 0;
 
+  std::vector<SubPath> light_pool;
+  std::vector<SpectralQuery> light_pool_spect;
+  uint32_t light_pool_size = 0;
+  uint32_t light_pool_groups = 0;
+  uint32_t light_connections = 1;
+  float light_tracing_count = 1.0f;
+
   bool conn_direct_hit = true;
   bool conn_connect_to_light = true;
   bool conn_connect_to_camera = true;
@@ -150,48 +186,115 @@ struct CPUBidirectionalImpl : public Task {
     return state->load() != Integrator::State::Stopped;
   }
 
+  bool light_pool_enabled() const {
+    return light_pool_size > 0;
+  }
+
+  // Number of samples per camera path taken with the strategy using `eye_t` camera and `light_s`
+  // light vertices. Stored light subpaths are traced once per iteration and shared: each camera path
+  // connects to `light_connections` of them, and light tracing runs once per stored subpath.
+  // Without the pool each camera path traces and connects to its own single light subpath.
+  float strategy_count(uint64_t eye_t, uint64_t light_s) const {
+    if (light_s <= 1)
+      return 1.0f;
+
+    if (eye_t == 1)
+      return light_tracing_count;
+
+    return light_pool_enabled() ? float(light_connections) : 1.0f;
+  }
+
+  bool valid_strategy(const SubPath& camera_path, uint64_t eye_t, uint64_t light_s) const {
+    auto depth = eye_t + light_s;
+    if (((eye_t == 1) && (light_s == 1)) || (depth < 2) || (depth > 2llu + rt.scene().max_path_length)) {
+      return false;
+    }
+    if ((eye_t > 1) && (light_s != 0) && (camera_path[eye_t].cls == PathVertex::Class::Emitter)) {
+      return false;
+    }
+    return true;
+  }
+
   float3 trace_pixel(RNDSampler& smp, const float2& uv, uint32_t thread_id) {
     auto& path_data = per_thread_path_data[thread_id];
 
-    auto spect = spectrum::sample(smp.next());
+    const SubPath* emitter_paths = &path_data.emitter_path;
+    uint64_t emitter_path_count = 1;
+
+    SpectralQuery spect = {};
+    if (light_pool_enabled()) {
+      uint32_t group = min(static_cast<uint32_t>(smp.next() * float(light_pool_groups)), light_pool_groups - 1u);
+      spect = light_pool_spect[group];
+      emitter_paths = light_pool.data() + uint64_t(group) * light_connections;
+      emitter_path_count = light_connections;
+    } else {
+      spect = spectrum::sample(smp.next());
+    }
+
     auto ray = generate_ray(smp, rt.scene(), uv);
     build_camera_path(smp, spect, ray, path_data.camera_path);
-    build_emitter_path(smp, spect, path_data.emitter_path);
+
+    if (light_pool_enabled() == false) {
+      build_emitter_path(smp, spect, path_data.emitter_path);
+      splat_to_camera(smp, path_data.emitter_path, spect, 1.0f, thread_id);
+    }
+
+    const auto& camera_path = path_data.camera_path;
+    float connection_scale = 1.0f / float(emitter_path_count);
 
     SpectralResponse result = {spect.wavelength, 0.0f};
-    for (uint64_t eye_t = 1, eye_t_e = path_data.camera_path.size(); running() && (eye_t < eye_t_e); ++eye_t) {
-      for (uint64_t light_s = 0, light_s_e = path_data.emitter_path.size(); running() && (light_s < light_s_e); ++light_s) {
-        auto depth = eye_t + light_s;
-        if (((eye_t == 1) && (light_s == 1)) || (depth < 2) || (depth > 2llu + rt.scene().max_path_length)) {
-          continue;
-        }
-        if ((eye_t > 1) && (light_s != 0) && (path_data.camera_path[eye_t].cls == PathVertex::Class::Emitter)) {
-          continue;
-        }
+    for (uint64_t eye_t = 2, eye_t_e = camera_path.size(); running() && (eye_t < eye_t_e); ++eye_t) {
+      if (valid_strategy(camera_path, eye_t, 0)) {
+        result += direct_hit(smp, camera_path, spect, eye_t);
+      }
 
-        if (light_s == 0) {
-          result += direct_hit(path_data, spect, eye_t, light_s, smp);
-        } else if (eye_t == 1) {
-          if (conn_connect_to_camera) {
-            CameraSample camera_sample = {};
-            auto splat = connect_to_camera(smp, path_data, spect, eye_t, light_s, camera_sample);
-            auto xyz = splat.to_xyz();
-            iteration_light_image.atomic_add({xyz.x, xyz.y, xyz.z, 1.0f}, camera_sample.uv, thread_id);
-          }
-        } else if (light_s == 1) {
-          if (conn_connect_to_light) {
-            result += connect_to_light(smp, path_data, spect, eye_t, light_s);
+      if (conn_connect_to_light && valid_strategy(camera_path, eye_t, 1)) {
+        result += connect_to_light(smp, camera_path, spect, eye_t);
+      }
+
+      if (conn_connect_vertices) {
+        for (uint64_t i = 0; i < emitter_path_count; ++i) {
+          const auto& emitter_path = emitter_paths[i];
+          for (uint64_t light_s = 2, light_s_e = emitter_path.size(); running() && (light_s < light_s_e); ++light_s) {
+            if (valid_strategy(camera_path, eye_t, light_s)) {
+              result += connect_vertices(smp, camera_path, emitter_path, spect, eye_t, light_s) * connection_scale;
+            }
           }
-        } else if (conn_connect_vertices) {
-          result += connect_vertices(smp, path_data, spect, eye_t, light_s);
         }
-        ETX_VALIDATE(result);
       }
+      ETX_VALIDATE(result);
     }
     return (result / spectrum::sample_pdf()).to_xyz();
   }
 
-  void build_path(Sampler& smp, SpectralQuery spect, Ray ray, std::vector<PathVertex>& path, PathSource mode, SpectralResponse throughput, float pdf_dir, uint32_t medium_index) {
+  void splat_to_camera(Sampler& smp, const SubPath& emitter_path, SpectralQuery spect, float scale, uint32_t thread_id) {
+    if (conn_connect_to_camera == false) {
+      return;
+    }
+
+    for (uint64_t light_s = 2, light_s_e = emitter_path.size(); running() && (light_s < light_s_e); ++light_s) {
+      if (light_s > 1llu + rt.scene().max_path_length) {
+        break;
+      }
+
+      CameraSample camera_sample = {};
+      auto splat = connect_to_camera(smp, emitter_path, spect, light_s, camera_sample);
+      auto xyz = splat.to_xyz() * scale;
+      iteration_light_image.atomic_add({xyz.x, xyz.y, xyz.z, 1.0f}, camera_sample.uv, thread_id);
+    }
+  }
+
+  void build_light_pool(uint32_t begin, uint32_t end, uint32_t thread_id) {
+    auto& smp = samplers[thread_id];
+    float scale = 1.0f / light_tracing_count;
+    for (uint32_t i = begin; running() && (i < end); ++i) {
+      auto spect = light_pool_spect[i / light_connections];
+      build_emitter_path(smp, spect, light_pool[i]);
+      splat_to_camera(smp, light_pool[i], spect, scale, thread_id);
+    }
+  }
+
+  void build_path(Sampler& smp, SpectralQuery spect, Ray ray, SubPath& path, PathSource mode, SpectralResponse throughput, float pdf_dir, uint32_t medium_index) {
     ETX_VALIDATE(throughput);
 
     float eta = 1.0f;
@@ -212,15 +315,15 @@ struct CPUBidirectionalImpl : public Task {
         float3 w_i = ray.d;
         float3 w_o = medium.sample_phase_function(spect, smp, w_i);
 
-        auto& v = path.emplace_back(medium_sample, w_i);
-        auto& w = path[path.size() - 2];
+        PathVertex v = {medium_sample, w_i};
         v.medium_index = medium_index;
         v.throughput = throughput;
-        v.delta = false;
-        v.pdf.forward = w.pdf_solid_angle_to_area(pdf_dir, v);
+
+        uint64_t w = path.size() - 1u;
+        path.add(v, path[w].pdf_solid_angle_to_area(pdf_dir, v), false);
 
         float rev_pdf = medium.phase_function(spect, medium_sample.pos, w_o, w_i);
-        w.pdf.backward = v.pdf_solid_angle_to_area(rev_pdf, w);
+        path.pdf_backward[w] = v.pdf_solid_angle_to_area(rev_pdf, path[w]);
 
         pdf_dir = medium.phase_function(spect, medium_sample.pos, w_i, w_o);
         ray.o = medium_sample.pos;
@@ -240,20 +343,23 @@ struct CPUBidirectionalImpl : public Task {
           continue;
         }
 
-        auto& v = path.emplace_back(PathVertex::Class::Surface, intersection);
-        auto& w = path[path.size() - 2];
+        uint64_t w = path.size() - 1u;
+        uint64_t vi = path.size();
+
+        PathVertex v = {PathVertex::Class::Surface, intersection};
         v.medium_index = medium_index;
         v.emitter_index = intersection.emitter_index;
         v.throughput = throughput;
-        v.pdf.forward = w.pdf_solid_angle_to_area(pdf_dir, v);
-        ETX_VALIDATE(v.pdf.forward);
+        path.add(v, path[w].pdf_solid_angle_to_area(pdf_dir, v), false);
+        ETX_VALIDATE(path.pdf_forward[vi]);
 
         auto bsdf_data = BSDFData(spect, medium_index, mode, v, v.w_i);
 
         auto bsdf_sample = bsdf::sample(bsdf_data, mat, rt.scene(), smp);
         ETX_VALIDATE(bsdf_sample.weight);
 
-        v.delta = bsdf_sample.is_delta();
+        bool is_delta = bsdf_sample.is_delta();
+        path.delta[vi] = is_delta ? 1u : 0u;
 
         if (bsdf_sample.properties & BSDFSample::MediumChanged) {
           medium_index = bsdf_sample.medium_index;
@@ -266,14 +372,14 @@ struct CPUBidirectionalImpl : public Task {
         auto rev_bsdf_pdf = bsdf::reverse_pdf(bsdf_data, -v.w_i, mat, rt.scene(), smp);
         ETX_VALIDATE(rev_bsdf_pdf);
 
-        w.pdf.backward = v.pdf_solid_angle_to_area(rev_bsdf_pdf, w);
-        ETX_VALIDATE(w.pdf.backward);
+        path.pdf_backward[w] = v.pdf_solid_angle_to_area(rev_bsdf_pdf, path[w]);
+        ETX_VALIDATE(path.pdf_backward[w]);
 
         if (mode == PathSource::Camera) {
           eta *= bsdf_sample.eta;
         }
 
-        pdf_dir = v.delta ? 0.0f : bsdf_sample.pdf;
+        pdf_dir = is_delta ? 0.0f : bsdf_sample.pdf;
         ETX_VALIDATE(pdf_dir);
 
         throughput *= bsdf_sample.weight;
@@ -288,13 +394,13 @@ struct CPUBidirectionalImpl : public Task {
         ray.d = bsdf_sample.w_o;
 
       } else if (mode == PathSource::Camera) {
-        auto& v = path.emplace_back(PathVertex::Class::Emitter);
+        PathVertex v = {PathVertex::Class::Emitter};
         v.medium_index = medium_index;
         v.throughput = throughput;
-        v.pdf.forward = pdf_dir;
         v.w_i = ray.d;
         v.pos = ray.o + rt.scene().bounding_sphere_radius * v.w_i;
         v.nrm = -v.w_i;
+        path.add(v, pdf_dir, false);
         break;
       } else {
         break;
@@ -308,36 +414,40 @@ struct CPUBidirectionalImpl : public Task {
     }
   }
 
-  void build_camera_path(Sampler& smp, SpectralQuery spect, Ray ray, std::vector<PathVertex>& path) {
+  void build_camera_path(Sampler& smp, SpectralQuery spect, Ray ray, SubPath& path) {
     path.clear();
-    auto& z0 = path.emplace_back(PathVertex::Class::Camera);
+    PathVertex z0 = {PathVertex::Class::Camera};
     z0.throughput = {spect.wavelength, 1.0f};
+    path.add(z0, 0.0f, false);
 
     auto eval = film_evaluate_out(spect, rt.scene().camera, ray);
 
-    auto& z1 = path.emplace_back(PathVertex::Class::Camera);
+    PathVertex z1 = {PathVertex::Class::Camera};
     z1.medium_index = rt.scene().camera_medium_index;
     z1.throughput = {spect.wavelength, 1.0f};
     z1.pos = ray.o;
     z1.nrm = eval.normal;
     z1.w_i = ray.d;
-    z1.pdf.forward = 1.0f;
+    path.add(z1, 1.0f, false);
 
     build_path(smp, spect, ray, path, PathSource::Camera, z1.throughput, eval.pdf_dir, z1.medium_index);
+    path.update_mis(2u, [this](uint64_t i) {
+      return strategy_count(i - 1u, 3u);
+    });
   }
 
-  void build_emitter_path(Sampler& smp, SpectralQuery spect, std::vector<PathVertex>& path) {
+  void build_emitter_path(Sampler& smp, SpectralQuery spect, SubPath& path) {
     path.clear();
     const auto& emitter_sample = sample_emission(rt.scene(), spect, smp);
     if ((emitter_sample.pdf_area == 0.0f) || (emitter_sample.pdf_dir == 0.0f) || (emitter_sample.value.is_zero())) {
       return;
     }
 
-    auto& y0 = path.emplace_back(PathVertex::Class::Emitter);
+    PathVertex y0 = {PathVertex::Class::Emitter};
     y0.throughput = {spect.wavelength, 1.0f};
-    y0.delta = emitter_sample.is_delta;
+    path.add(y0, 0.0f, emitter_sample.is_delta);
 
-    auto& y1 = path.emplace_back(PathVertex::Class::Emitter);
+    PathVertex y1 = {PathVertex::Class::Emitter};
     y1.triangle_index = emitter_sample.triangle_index;
     y1.medium_index = emitter_sample.medium_index;
     y1.emitter_index = emitter_sample.emitter_index;
@@ -345,28 +455,34 @@ struct CPUBidirectionalImpl : public Task {
     y1.barycentric = emitter_sample.barycentric;
     y1.pos = emitter_sample.origin;
     y1.nrm = emitter_sample.normal;
-    y1.pdf.forward = emitter_sample.pdf_area * emitter_sample.pdf_sample;
     y1.w_i = emitter_sample.direction;
-    y1.delta = emitter_sample.is_delta;
+    path.add(y1, emitter_sample.pdf_area * emitter_sample.pdf_sample, emitter_sample.is_delta);
 
     float3 o = offset_ray(emitter_sample.origin, y1.nrm);
     SpectralResponse throughput = y1.throughput * dot(emitter_sample.direction, y1.nrm) / (emitter_sample.pdf_dir * emitter_sample.pdf_area * emitter_sample.pdf_sample);
     build_path(smp, spect, {o, emitter_sample.direction}, path, PathSource::Light, throughput, emitter_sample.pdf_dir, y1.medium_index);
 
     if ((path.size() > 2) && emitter_sample.is_distant) {
-      path[1].pdf.forward = emitter_pdf_in_dist(rt.scene().emitters[emitter_sample.emitter_index], emitter_sample.direction, rt.scene());
-      ETX_VALIDATE(path[1].pdf.forward);
+      path.pdf_forward[1] = emitter_pdf_in_dist(rt.scene().emitters[emitter_sample.emitter_index], emitter_sample.direction, rt.scene());
+      ETX_VALIDATE(path.pdf_forward[1]);
 
-      path[2].pdf.forward = emitter_sample.pdf_area;
+      path.pdf_forward[2] = emitter_sample.pdf_area;
       if (path[2].cls == PathVertex::Class::Surface) {
         const auto& tri = rt.scene().triangles[path[2].triangle_index];
-        path[2].pdf.forward *= fabsf(dot(emitter_sample.direction, tri.geo_n));
+        path.pdf_forward[2] *= fabsf(dot(emitter_sample.direction, tri.geo_n));
       }
-      ETX_VALIDATE(path[2].pdf.forward);
+      ETX_VALIDATE(path.pdf_forward[2]);
     }
+
+    path.update_mis(1u, [this](uint64_t i) {
+      return strategy_count(4u, i - 1u);
+    });
   }
 
-  float mis_weight(PathData& c, SpectralQuery spect, uint64_t eye_t, uint64_t light_s, const PathVertex& sampled, Sampler& smp) {
+  // `sampled` replaces the last light vertex when connecting to a sampled emitter (light_s == 1)
+  // or the camera vertex when connecting to the camera (eye_t == 1)
+  float mis_weight(const SubPath& camera_path, const SubPath& emitter_path, SpectralQuery spect, uint64_t eye_t, uint64_t light_s, const PathVertex* sampled,
+    float sampled_pdf_forward, bool sampled_delta, Sampler& smp) {
     if (conn_mis == false) {
       return 1.0f;
     }
@@ -375,53 +491,58 @@ struct CPUBidirectionalImpl : public Task {
       return 1.0f;
     }
 
-    PathVertex* z_curr = (eye_t > 0) ? c.camera_path.data() + eye_t : nullptr;
-    PathVertex* z_prev = (eye_t > 1) ? c.camera_path.data() + eye_t - 1 : nullptr;
-    PathVertex* y_curr = (light_s > 0) ? c.emitter_path.data() + light_s : nullptr;
-    PathVertex* y_prev = (light_s > 1) ? c.emitter_path.data() + light_s - 1 : nullptr;
+    const PathVertex* z_curr = nullptr;
+    const PathVertex* z_prev = nullptr;
+    if (eye_t == 1) {
+      z_curr = sampled;
+    } else if (eye_t > 1) {
+      z_curr = &camera_path[eye_t];
+      z_prev = &camera_path[eye_t - 1];
+    }
 
-    ReplaceInScope<PathVertex> sampled_vertex;
+    const PathVertex* y_curr = nullptr;
+    const PathVertex* y_prev = nullptr;
+    float y_curr_forward = 0.0f;
+    bool y_prev_delta = false;
     if (light_s == 1) {
-      sampled_vertex = {y_curr, sampled};
-    } else if (eye_t == 1) {
-      sampled_vertex = {z_curr, sampled};
+      y_curr = sampled;
+      y_curr_forward = sampled_pdf_forward;
+      y_prev_delta = sampled_delta;
+    } else if (light_s > 1) {
+      y_curr = &emitter_path[light_s];
+      y_prev = &emitter_path[light_s - 1];
+      y_curr_forward = emitter_path.pdf_forward[light_s];
+      y_prev_delta = emitter_path.delta[light_s - 1];
     }
 
-    ReplaceInScope<bool> z_delta_new;
-    ReplaceInScope<float> z_curr_new;
-    ReplaceInScope<float> z_prev_new;
-
-    ReplaceInScope<bool> y_delta_new;
-    ReplaceInScope<float> y_curr_new;
-    ReplaceInScope<float> y_prev_new;
-
-    if (z_curr) {
-      z_delta_new = {&z_curr->delta, false};
+    float camera_sum = 0.0f;
+    if (z_prev) {
       float z_curr_pdf = 0.0f;
+      float z_prev_pdf = 0.0f;
       if (light_s > 0) {
         z_curr_pdf = y_curr->pdf_area(spect, PathSource::Light, y_prev, z_curr, rt.scene(), smp);
+        z_prev_pdf = z_curr->pdf_area(spect, PathSource::Camera, y_curr, z_prev, rt.scene(), smp);
       } else {
         z_curr_pdf = z_curr->pdf_to_light_in(spect, z_prev, rt.scene());
+        z_prev_pdf = z_curr->pdf_to_light_out(spect, z_prev, rt.scene());
       }
       ETX_VALIDATE(z_curr_pdf);
-      z_curr_new = {&z_curr->pdf.backward, z_curr_pdf};
-      ETX_VALIDATE(z_curr->pdf.backward);
-    }
+      ETX_VALIDATE(z_prev_pdf);
 
-    if (z_prev) {
-      float z_prev_pdf = 0.0f;
-      if (light_s > 0) {
-        z_prev_pdf = z_curr->pdf_area(spect, PathSource::Camera, y_curr, z_prev, rt.scene(), smp);
-      } else {
-        z_prev_pdf = z_curr->pdf_to_light_out(spect, z_prev, rt.scene());
+      float r = SubPath::pdf_ratio(z_curr_pdf, camera_path.pdf_forward[eye_t]);
+      float prev_sum = 0.0f;
+      if (eye_t > 2) {
+        float r_prev = SubPath::pdf_ratio(z_prev_pdf, camera_path.pdf_forward[eye_t - 1]);
+        float count = camera_path.connectible(eye_t - 1) ? strategy_count(eye_t - 2, light_s + 2) : 0.0f;
+        prev_sum = r_prev * (count + camera_path.mis_sum[eye_t - 2]);
       }
-      ETX_VALIDATE(z_prev_pdf);
-      z_prev_new = {&z_prev->pdf.backward, z_prev_pdf};
-      ETX_VALIDATE(z_prev->pdf.backward);
+      float count = camera_path.delta[eye_t - 1] ? 0.0f : strategy_count(eye_t - 1, light_s + 1);
+      camera_sum = r * (count + prev_sum);
+      ETX_VALIDATE(camera_sum);
     }
 
+    float light_sum = 0.0f;
     if (y_curr) {
-      y_delta_new = {&y_curr->delta, false};
       float y_curr_pdf = 0.0f;
       if (eye_t > 1) {
         y_curr_pdf = z_curr->pdf_area(spect, PathSource::Camera, z_prev, y_curr, rt.scene(), smp);
@@ -433,54 +554,33 @@ struct CPUBidirectionalImpl : public Task {
         ETX_FAIL("Invalid case");
       }
       ETX_VALIDATE(y_curr_pdf);
-      y_curr_new = {&y_curr->pdf.backward, y_curr_pdf};
-      ETX_VALIDATE(y_curr->pdf.backward);
-    }
-
-    if (y_prev) {
-      ETX_ASSERT(z_curr != nullptr);
-      float y_prev_pdf = y_curr->pdf_area(spect, PathSource::Light, z_curr, y_prev, rt.scene(), smp);
-      ETX_VALIDATE(y_prev_pdf);
-      y_prev_new = {&y_prev->pdf.backward, y_prev_pdf};
-      ETX_VALIDATE(y_prev->pdf.backward);
-    }
-
-    float result = 0.0f;
-
-#define MAP(A) (((A) == 0.0f) ? 1.0f : (A))
-
-    float r = 1.0f;
-    for (uint64_t ti = eye_t; ti > 1; --ti) {
-      r *= MAP(c.camera_path[ti].pdf.backward) / MAP(c.camera_path[ti].pdf.forward);
-      ETX_VALIDATE(r);
-
-      if ((c.camera_path[ti].delta == false) && (c.camera_path[ti - 1].delta == false)) {
-        result += r;
-        ETX_VALIDATE(result);
-      }
-    }
 
-    r = 1.0f;
-    for (uint64_t si = light_s; si > 0; --si) {
-      r *= MAP(c.emitter_path[si].pdf.backward) / MAP(c.emitter_path[si].pdf.forward);
-      ETX_VALIDATE(r);
+      float r = SubPath::pdf_ratio(y_curr_pdf, y_curr_forward);
+      float prev_sum = 0.0f;
+      if (y_prev) {
+        ETX_ASSERT(z_curr != nullptr);
+        float y_prev_pdf = y_curr->pdf_area(spect, PathSource::Light, z_curr, y_prev, rt.scene(), smp);
+        ETX_VALIDATE(y_prev_pdf);
 
-      if ((c.emitter_path[si].delta == false) && (c.emitter_path[si - 1].delta == false)) {
-        result += r;
-        ETX_VALIDATE(result);
+        float r_prev = SubPath::pdf_ratio(y_prev_pdf, emitter_path.pdf_forward[light_s - 1]);
+        float count = emitter_path.connectible(light_s - 1) ? strategy_count(eye_t + 2, light_s - 2) : 0.0f;
+        prev_sum = r_prev * (count + emitter_path.mis_sum[light_s - 2]);
       }
+      float count = y_prev_delta ? 0.0f : strategy_count(eye_t + 1, light_s - 1);
+      light_sum = r * (count + prev_sum);
+      ETX_VALIDATE(light_sum);
     }
 
-    return 1.0f / (1.0f + result);
+    return 1.0f / (1.0f + (camera_sum + light_sum) / strategy_count(eye_t, light_s));
   }
 
-  SpectralResponse direct_hit(PathData& c, SpectralQuery spect, uint64_t eye_t, uint64_t light_s, Sampler& smp) {
-    const auto& z_i = c.camera_path[eye_t];
+  SpectralResponse direct_hit(Sampler& smp, const SubPath& camera_path, SpectralQuery spect, uint64_t eye_t) {
+    const auto& z_i = camera_path[eye_t];
     if ((conn_direct_hit == false) || (z_i.is_emitter() == false)) {
       return {spect.wavelength, 0.0f};
     }
 
-    const auto& z_prev = c.camera_path[eye_t - 1];
+    const auto& z_prev = camera_path[eye_t - 1];
 
     float pdf_area = 0.0f;
     float pdf_dir = 0.0f;
@@ -491,7 +591,7 @@ struct CPUBidirectionalImpl : public Task {
     if (z_i.is_specific_emitter()) {
       const auto& emitter = rt.scene().emitters[z_i.emitter_index];
       ETX_ASSERT(emitter.is_local());
-      emitter_value = emitter_get_radiance(emitter, spect, z_i.tex, z_prev.pos, z_i.pos, pdf_area, pdf_dir, pdf_dir_out, rt.scene(), (eye_t <= 2));
+      emitter_value = emitter_get_radiance(emitter, spect, z_i.tex, z_i.barycentric, z_prev.pos, z_i.pos, pdf_area, pdf_dir, pdf_dir_out, rt.scene(), (eye_t <= 2));
     } else if (rt.scene().environment_emitters.count > 0) {
       auto w_o = normalize(z_i.pos - z_prev.pos);
       for (uint32_t ie = 0; ie < rt.scene().environment_emitters.count; ++ie) {
@@ -509,14 +609,14 @@ struct CPUBidirectionalImpl : public Task {
     }
 
     ETX_VALIDATE(emitter_value);
-    float weight = mis_weight(c, spect, eye_t, light_s, {}, smp);
+    float weight = mis_weight(camera_path, {}, spect, eye_t, 0, nullptr, 0.0f, false, smp);
     return emitter_value * z_i.throughput * weight;
   }
 
-  SpectralResponse connect_to_light(Sampler& smp, PathData& c, SpectralQuery spect, uint64_t eye_t, uint64_t light_s) {
+  SpectralResponse connect_to_light(Sampler& smp, const SubPath& camera_path, SpectralQuery spect, uint64_t eye_t) {
     PathVertex sampled_vertex = {PathVertex::Class::Emitter};
 
-    const auto& z_i = c.camera_path[eye_t];
+    const auto& z_i = camera_path[eye_t];
 
     uint32_t emitter_index = sample_emitter_index(rt.scene(), smp);
     auto emitter_sample = sample_emitter(spect, emitter_index, smp, z_i.pos, rt.scene());
@@ -534,20 +634,19 @@ struct CPUBidirectionalImpl : public Task {
     sampled_vertex.emitter_index = emitter_sample.emitter_index;
     sampled_vertex.pos = emitter_sample.origin;
     sampled_vertex.nrm = emitter_sample.normal;
-    sampled_vertex.pdf.forward = sampled_vertex.pdf_to_light_in(spect, &z_i, rt.scene());
-    sampled_vertex.delta = emitter_sample.is_delta;
+    float sampled_pdf_forward = sampled_vertex.pdf_to_light_in(spect, &z_i, rt.scene());
 
     SpectralResponse emitter_throughput = emitter_sample.value / (emitter_sample.pdf_dir * emitter_sample.pdf_sample);
     ETX_VALIDATE(emitter_throughput);
 
     SpectralResponse bsdf = z_i.bsdf_in_direction(spect, PathSource::Camera, emitter_sample.direction, rt.scene(), smp);
     SpectralResponse tr = local_transmittance(spect, smp, z_i, sampled_vertex);
-    float weight = mis_weight(c, spect, eye_t, light_s, sampled_vertex, smp);
+    float weight = mis_weight(camera_path, {}, spect, eye_t, 1, &sampled_vertex, sampled_pdf_forward, emitter_sample.is_delta, smp);
     return z_i.throughput * bsdf * emitter_throughput * tr * weight;
   }
 
-  SpectralResponse connect_to_camera(Sampler& smp, PathData& c, SpectralQuery spect, uint64_t eye_t, uint64_t light_s, CameraSample& camera_sample) {
-    const auto& y_i = c.emitter_path[light_s];
+  SpectralResponse connect_to_camera(Sampler& smp, const SubPath& emitter_path, SpectralQuery spect, uint64_t light_s, CameraSample& camera_sample) {
+    const auto& y_i = emitter_path[light_s];
     camera_sample = sample_film(smp, rt.scene(), y_i.pos);
     if (camera_sample.valid() == false) {
       return {spect.wavelength, 0.0f};
@@ -561,7 +660,7 @@ struct CPUBidirectionalImpl : public Task {
     sampled_vertex.w_i = camera_sample.direction;
 
     SpectralResponse bsdf = y_i.bsdf_in_direction(spect, PathSource::Light, camera_sample.direction, rt.scene(), smp);
-    float weight = mis_weight(c, spect, eye_t, light_s, sampled_vertex, smp);
+    float weight = mis_weight({}, emitter_path, spect, 1, light_s, &sampled_vertex, 0.0f, false, smp);
 
     SpectralResponse splat = y_i.throughput * bsdf * camera_sample.weight * (weight / spectrum::sample_pdf());
     ETX_VALIDATE(splat);
@@ -573,9 +672,9 @@ struct CPUBidirectionalImpl : public Task {
     return splat;
   }
 
-  SpectralResponse connect_vertices(Sampler& smp, PathData& c, SpectralQuery spect, uint64_t eye_t, uint64_t light_s) {
-    const auto& y_i = c.emitter_path[light_s];
-    const auto& z_i = c.camera_path[eye_t];
+  SpectralResponse connect_vertices(Sampler& smp, const SubPath& camera_path, const SubPath& emitter_path, SpectralQuery spect, uint64_t eye_t, uint64_t light_s) {
+    const auto& y_i = emitter_path[light_s];
+    const auto& z_i = camera_path[eye_t];
 
     auto dw = z_i.pos - y_i.pos;
     float dwl = dot(dw, dw);
@@ -593,7 +692,7 @@ struct CPUBidirectionalImpl : public Task {
     SpectralResponse tr = local_transmittance(spect, smp, y_i, z_i);
     ETX_VALIDATE(result);
 
-    float weight = mis_weight(c, spect, eye_t, light_s, {}, smp);
+    float weight = mis_weight(camera_path, emitter_path, spect, eye_t, light_s, nullptr, 0.0f, false, smp);
     ETX_VALIDATE(weight);
 
     return result * tr * weight;
@@ -615,10 +714,11 @@ struct CPUBidirectionalImpl : public Task {
     conn_connect_to_light = opt.get("conn_connect_to_light", conn_connect_to_light).to_bool();
     conn_connect_vertices = opt.get("conn_connect_vertices", conn_connect_vertices).to_bool();
     conn_mis = opt.get("conn_mis", conn_mis).to_bool();
+    light_pool_size = opt.get("light_pool_size", light_pool_size).to_integer();
+    light_connections = max(1u, opt.get("light_connections", light_connections).to_integer());
 
     iteration_light_image.clear();
 
-    uint32_t dim = camera_image.dimensions().x * camera_image.dimensions().y;
     for (auto& path_data : per_thread_path_data) {
       path_data.camera_path.reserve(2llu + rt.scene().max_path_length);
       path_data.emitter_path.reserve(2llu + rt.scene().max_path_length);
@@ -629,7 +729,45 @@ struct CPUBidirectionalImpl : public Task {
 
     total_time = {};
     iteration_time = {};
-    current_task = rt.scheduler().schedule(dim, this);
+    start_iteration();
+  }
+
+  void start_iteration() {
+    if (light_pool_enabled() == false) {
+      light_tracing_count = 1.0f;
+      start_camera_pass();
+      return;
+    }
+
+    light_pool_groups = max(1u, light_pool_size / light_connections);
+    uint32_t pool_size = light_pool_groups * light_connections;
+    light_tracing_count = float(pool_size) / float(camera_image.count());
+
+    light_pool.resize(pool_size);
+    light_pool_spect.resize(light_pool_groups);
+    for (auto& spect : light_pool_spect) {
+      spect = spectrum::sample(samplers[0].next());
+    }
+
+    pool_task = rt.scheduler().schedule(pool_size, [this](uint32_t begin, uint32_t end, uint32_t thread_id) {
+      build_light_pool(begin, end, thread_id);
+    });
+  }
+
+  void start_camera_pass() {
+    uint32_t dim = camera_image.dimensions().x * camera_image.dimensions().y;
+    if (current_task.data == Task::InvalidHandle) {
+      current_task = rt.scheduler().schedule(dim, this);
+    } else {
+      rt.scheduler().restart(current_task, dim);
+    }
+  }
+
+  void wait_for_tasks() {
+    rt.scheduler().wait(pool_task);
+    rt.scheduler().wait(current_task);
+    pool_task = {};
+    current_task = {};
   }
 };
 
@@ -664,7 +802,20 @@ void CPUBidirectional::run(const Options& opt) {
 }
 
 void CPUBidirectional::update() {
-  if ((current_state == State::Stopped) || (rt.scheduler().completed(_private->current_task) == false)) {
+  if (current_state == State::Stopped) {
+    return;
+  }
+
+  if (_private->pool_task.data != Task::InvalidHandle) {
+    if (rt.scheduler().completed(_private->pool_task)) {
+      rt.scheduler().wait(_private->pool_task);
+      _private->pool_task = {};
+      _private->start_camera_pass();
+    }
+    return;
+  }
+
+  if (rt.scheduler().completed(_private->current_task) == false) {
     return;
   }
 
@@ -686,7 +837,7 @@ void CPUBidirectional::update() {
 
     _private->iteration_time = {};
     _private->iteration += 1;
-    rt.scheduler().restart(_private->current_task, _private->camera_image.dimensions().x * _private->camera_image.dimensions().y);
+    _private->start_iteration();
   } else {
     snprintf(_private->status, sizeof(_private->status), "[%u] Completed in %.2f seconds", _private->iteration, _private->total_time.measure());
     current_state = Integrator::State::Stopped;
@@ -700,8 +851,7 @@ void CPUBidirectional::stop(Stop st) {
 
   if (st == Stop::Immediate) {
     current_state = State::Stopped;
-    rt.scheduler().wait(_private->current_task);
-    _private->current_task = {};
+    _private->wait_for_tasks();
   } else {
     current_state = State::WaitingForCompletion;
     snprintf(_private->status, sizeof(_private->status), "[%u] Waiting for completion", _private->iteration);
@@ -715,6 +865,8 @@ Options CPUBidirectional::options() const {
   result.add(_private->conn_connect_to_light, "conn_connect_to_light", "Connect to Light");
   result.add(_private->conn_connect_vertices, "conn_connect_vertices", "Connect Vertices");
   result.add(_private->conn_mis, "conn_mis", "Multiple Importance Sampling");
+  result.add(0u, _private->light_pool_size, 1u << 24u, "light_pool_size", "Shared Light Subpaths (0 - one per pixel)");
+  result.add(1u, _private->light_connections, 16u, "light_connections", "Light Subpaths per Camera Path");
   return result;
 }
 
@@ -802,7 +954,7 @@ float CPUBidirectionalImpl::PathVertex::pdf_to_light_out(SpectralQuery spect, co
     const auto& emitter = scene.emitters[emitter_index];
     if (emitter.is_local()) {
       auto w_o = normalize(next->pos - pos);
-      emitter_evaluate_out_local(emitter, spect, tex, nrm, w_o, pdf_area, pdf_dir, pdf_dir_out, scene);
+      emitter_evaluate_out_local(emitter, spect, tex, barycentric, nrm, w_o, pdf_area, pdf_dir, pdf_dir_out, scene);
       pdf_area = pdf_solid_angle_to_area(pdf_dir, *next);
     } else if (emitter.is_distant()) {
       auto w_o = normalize(pos - next->pos);
@@ -833,7 +985,7 @@ float CPUBidirectionalImpl::PathVertex::pdf_to_light_in(SpectralQuery spect, con
   if (is_specific_emitter()) {
     const auto& emitter = scene.emitters[emitter_index];
     float pdf_discrete = emitter_discrete_pdf(emitter, scene.emitters_distribution);
-    result = pdf_discrete * (emitter.is_local() ? emitter_pdf_area_local(emitter, scene) : emitter_pdf_in_dist(emitter, normalize(pos - next->pos), scene));
+    result = pdf_discrete * (emitter.is_local() ? emitter_pdf_area_local(emitter, barycentric, scene) : emitter_pdf_in_dist(emitter, normalize(pos - next->pos), scene));
   } else if (scene.environment_emitters.count > 0) {
     for (uint32_t ie = 0; ie < scene.environment_emitters.count; ++ie) {
       const auto& emitter = scene.emitters[scene.environment_emitters.emitters[ie]];
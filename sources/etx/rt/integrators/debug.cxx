@@ -5,6 +5,7 @@
 #include <etx/render/shared/base.hxx>
 
 #include <etx/rt/integrators/debug.hxx>
+#include <etx/rt/shared/path_tracing_shared.hxx>
 
 namespace etx {
 
@@ -24,6 +25,9 @@ struct CPUDebugIntegratorImpl : public Task {
   uint32_t preview_frames = 3u;
   CPUDebugIntegrator::Mode mode = CPUDebugIntegrator::Mode::Geometry;
   float voxel_data[8] = {-0.1f, -0.1f, -0.1f, -0.1f, +0.1f, +0.1f, +0.1f, +0.1f};
+  float cost_scale = 32.0f;
+  bool cost_false_color = true;
+  PTOptions cost_path_options = {};
 
   CPUDebugIntegratorImpl(Raytracing& a_rt, std::atomic<Integrator::State>* st)
     : rt(a_rt)
@@ -41,6 +45,8 @@ struct CPUDebugIntegratorImpl : public Task {
     voxel_data[5] = opt.get("v011", voxel_data[5]).to_float();
     voxel_data[6] = opt.get("v110", voxel_data[6]).to_float();
     voxel_data[7] = opt.get("v111", voxel_data[7]).to_float();
+    cost_scale = opt.get("cost_scale", cost_scale).to_float();
+    cost_false_color = opt.get("cost_false_color", cost_false_color).to_bool();
 
     iteration = 0;
     snprintf(status, sizeof(status), "[%u] %s ...", iteration, (state->load() == Integrator::State::Running ? "Running" : "Preview"));
@@ -50,16 +56,23 @@ struct CPUDebugIntegratorImpl : public Task {
 
     total_time = {};
     iteration_time = {};
+    Raytracing::set_statistics_enabled(mode >= CPUDebugIntegrator::Mode::CostTime);
     current_task = rt.scheduler().schedule(current_dimensions.x * current_dimensions.y, this);
   }
 
+  void complete_task() {
+    rt.scheduler().wait(current_task);
+    current_task = {};
+    Raytracing::set_statistics_enabled(false);
+  }
+
   void execute_range(uint32_t begin, uint32_t end, uint32_t thread_id) override {
     auto& smp = samplers[thread_id];
     for (uint32_t i = begin; (state->load() != Integrator::State::Stopped) && (i < end); ++i) {
       uint32_t x = i % current_dimensions.x;
       uint32_t y = i / current_dimensions.x;
       float2 uv = get_jittered_uv(smp, {x, y}, current_dimensions);
-      float3 xyz = preview_pixel(smp, uv);
+      float3 xyz = (mode >= CPUDebugIntegrator::Mode::CostTime) ? cost_pixel({x, y}) : preview_pixel(smp, uv);
 
       if (state->load() == Integrator::State::Running) {
         camera_image.accumulate({xyz.x, xyz.y, xyz.z, 1.0f}, uv, float(iteration) / (float(iteration + 1)));
@@ -264,6 +277,90 @@ struct CPUDebugIntegratorImpl : public Task {
     return normalize(result);
   }
 
+  /*
+   * Maps [0..1] to blue - cyan - green - yellow - red
+   */
+  float3 false_color(float t) {
+    t = 4.0f * saturate(t);
+    if (t < 1.0f)
+      return {0.0f, t, 1.0f};
+    if (t < 2.0f)
+      return {0.0f, 1.0f, 2.0f - t};
+    if (t < 3.0f)
+      return {t - 2.0f, 1.0f, 0.0f};
+    return {1.0f, 4.0f - t, 0.0f};
+  }
+
+  /*
+   * Traces regular path tracing sample and reports its cost instead of radiance.
+   * Raw values are written to all channels when false color is disabled, so they could be saved as XYZ image.
+   */
+  float3 cost_pixel(const uint2& px) {
+    const auto& scene = rt.scene();
+    auto& statistics = Raytracing::thread_statistics();
+    statistics = {};
+
+    TimeMeasure sample_time = {};
+    PTRayPayload payload = make_ray_payload(scene, px, current_dimensions, iteration);
+    bool continue_path = run_path_iteration(scene, cost_path_options, {}, rt, payload);
+    // the first iteration traces the camera ray, all following intersection rays continue the path
+    uint32_t primary_rays = statistics.counters[RayStatistics::IntersectionRays];
+    while (continue_path && (state->load() != Integrator::State::Stopped)) {
+      continue_path = run_path_iteration(scene, cost_path_options, {}, rt, payload);
+    }
+    float time_us = float(sample_time.measure_ms()) * 1000.0f;
+
+    const auto& counters = statistics.counters;
+    float value = 0.0f;
+    switch (mode) {
+      case CPUDebugIntegrator::Mode::CostTime: {
+        value = time_us;
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostPrimaryRays: {
+        value = float(primary_rays);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostContinuationRays: {
+        value = float(counters[RayStatistics::IntersectionRays] - primary_rays);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostShadowRays: {
+        value = float(counters[RayStatistics::ShadowRays]);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostTransmittanceRays: {
+        value = float(counters[RayStatistics::TransmittanceRays]);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostSubsurfaceRays: {
+        value = float(counters[RayStatistics::SubsurfaceRays]);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostTotalRays: {
+        value = float(counters[RayStatistics::IntersectionRays] + counters[RayStatistics::ShadowRays] + counters[RayStatistics::TransmittanceRays] +
+                      counters[RayStatistics::SubsurfaceRays]);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostPathLength: {
+        value = float(payload.path_length);
+        break;
+      }
+      case CPUDebugIntegrator::Mode::CostFilterInvocations: {
+        value = float(counters[RayStatistics::FilterInvocations]);
+        break;
+      }
+      default:
+        break;
+    }
+
+    if (cost_false_color == false) {
+      return {value, value, value};
+    }
+
+    return spectrum::rgb_to_xyz(false_color(value / fmaxf(cost_scale, kEpsilon)));
+  }
+
   float3 preview_pixel(RNDSampler& smp, const float2& uv) {
     const auto& scene = rt.scene();
     auto ray = generate_ray(smp, scene, uv);
@@ -391,8 +488,7 @@ void CPUDebugIntegrator::update() {
 
   if (should_stop && rt.scheduler().completed(_private->current_task)) {
     if ((current_state == State::WaitingForCompletion) || (_private->iteration >= _private->max_iterations)) {
-      rt.scheduler().wait(_private->current_task);
-      _private->current_task = {};
+      _private->complete_task();
       if (current_state == State::Preview) {
         snprintf(_private->status, sizeof(_private->status), "[%u] Preview completed", _private->iteration);
         current_state = Integrator::State::Preview;
@@ -424,8 +520,7 @@ void CPUDebugIntegrator::stop(Stop st) {
     snprintf(_private->status, sizeof(_private->status), "[%u] Waiting for completion", _private->iteration);
   } else {
     current_state = State::Stopped;
-    rt.scheduler().wait(_private->current_task);
-    _private->current_task = {};
+    _private->complete_task();
     snprintf(_private->status, sizeof(_private->status), "[%u] Stopped", _private->iteration);
   }
 }
@@ -433,6 +528,8 @@ void CPUDebugIntegrator::stop(Stop st) {
 Options CPUDebugIntegrator::options() const {
   Options result = {};
   result.add(_private->mode, Mode::Count, &CPUDebugIntegrator::mode_to_string, "mode", "Visualize");
+  result.add(0.0f, _private->cost_scale, 65536.0f, "cost_scale", "Cost Scale (us / count)");
+  result.add(_private->cost_false_color, "cost_false_color", "Cost False Color");
   return result;
 }
 
@@ -456,6 +553,24 @@ std::string CPUDebugIntegrator::mode_to_string(uint32_t i) {
       return "Diffuse Colors";
     case Mode::Fresnel:
       return "Fresnel Coefficients";
+    case Mode::CostTime:
+      return "Cost: Time per Sample";
+    case Mode::CostPrimaryRays:
+      return "Cost: Primary Rays";
+    case Mode::CostContinuationRays:
+      return "Cost: Continuation Rays";
+    case Mode::CostShadowRays:
+      return "Cost: Shadow Rays";
+    case Mode::CostTransmittanceRays:
+      return "Cost: Transmittance Rays";
+    case Mode::CostSubsurfaceRays:
+      return "Cost: Subsurface Rays";
+    case Mode::CostTotalRays:
+      return "Cost: Total Rays";
+    case Mode::CostPathLength:
+      return "Cost: Path Length";
+    case Mode::CostFilterInvocations:
+      return "Cost: Filter Invocations";
     default:
       return "???";
   }
@@ -16,6 +16,15 @@ struct CPUDebugIntegrator : public Integrator {
     FaceOrientation,
     DiffuseColors,
     Fresnel,
+    CostTime,
+    CostPrimaryRays,
+    CostContinuationRays,
+    CostShadowRays,
+    CostTransmittanceRays,
+    CostSubsurfaceRays,
+    CostTotalRays,
+    CostPathLength,
+    CostFilterInvocations,
     Count,
   };
   static std::string mode_to_string(uint32_t);
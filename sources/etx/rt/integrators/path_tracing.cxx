@@ -10,6 +10,25 @@
 
 namespace etx {
 
+namespace {
+
+using PathIteration = bool (*)(const Scene&, const PTOptions&, const PTLightReservoirs&, const Raytracing&, PTRayPayload&);
+
+PathIteration select_path_iteration(uint32_t features) {
+  switch (features) {
+    case 0u:
+      return run_path_iteration<0u>;
+    case PTOptions::NEE:
+      return run_path_iteration<PTOptions::NEE>;
+    case PTOptions::MIS:
+      return run_path_iteration<PTOptions::MIS>;
+    default:
+      return run_path_iteration<PTOptions::AllFeatures>;
+  }
+}
+
+}  // namespace
+
 struct CPUPathTracingImpl : public Task {
   Raytracing& rt;
   Film camera_image;
@@ -25,6 +44,8 @@ struct CPUPathTracingImpl : public Task {
   uint32_t max_samples = 1u;
 
   PTOptions options = {};
+  PathIteration path_iteration = run_path_iteration<PTOptions::AllFeatures>;
+  std::vector<PTLightReservoir> reservoirs[2] = {};
 
   std::atomic<Integrator::State>* state = nullptr;
 
@@ -38,6 +59,15 @@ struct CPUPathTracingImpl : public Task {
 
     options.nee = opt.get("nee", options.nee).to_bool();
     options.mis = opt.get("mis", options.mis).to_bool();
+    options.nee_candidates = opt.get("nee_candidates", options.nee_candidates).to_integer();
+    options.temporal_reuse = opt.get("temporal_reuse", options.temporal_reuse).to_bool();
+    options.spatial_reuse = opt.get("spatial_reuse", options.spatial_reuse).to_bool();
+    path_iteration = select_path_iteration(options.features());
+
+    for (auto& r : reservoirs) {
+      r.resize(camera_image.count());
+      std::fill(r.begin(), r.end(), PTLightReservoir{});
+    }
 
     iteration = 0;
     snprintf(status, sizeof(status), "[%u] %s ...", iteration, (state->load() == Integrator::State::Running ? "Running" : "Preview"));
@@ -54,14 +84,34 @@ struct CPUPathTracingImpl : public Task {
     current_task = rt.scheduler().schedule(current_dimensions.x * current_dimensions.y, this);
   }
 
+  PTLightReservoirs light_reservoirs() {
+    if ((current_scale != 1u) || ((options.temporal_reuse == false) && (options.spatial_reuse == false))) {
+      return {};
+    }
+
+    auto& previous = reservoirs[(iteration + 1u) % 2u];
+    auto& current = reservoirs[iteration % 2u];
+
+    PTLightReservoirs result = {};
+    result.previous = make_array_view<PTLightReservoir>(previous.data(), previous.size());
+    result.current = make_array_view<PTLightReservoir>(current.data(), current.size());
+    result.dimensions = current_dimensions;
+    return result;
+  }
+
   void execute_range(uint32_t begin, uint32_t end, uint32_t thread_id) override {
     ETX_FUNCTION_SCOPE();
+    auto reservoir_views = light_reservoirs();
     for (uint32_t i = begin; (state->load() != Integrator::State::Stopped) && (i < end); ++i) {
       uint32_t x = i % current_dimensions.x;
       uint32_t y = i / current_dimensions.x;
 
+      if (i < reservoir_views.current.count) {
+        reservoir_views.current[i] = {};
+      }
+
       PTRayPayload payload = make_ray_payload(rt.scene(), {x, y}, current_dimensions, iteration);
-      while ((state->load() != Integrator::State::Stopped) && run_path_iteration(rt.scene(), options, rt, payload)) {
+      while ((state->load() != Integrator::State::Stopped) && path_iteration(rt.scene(), options, reservoir_views, rt, payload)) {
         ETX_VALIDATE(payload.accumulated);
       }
 
@@ -190,6 +240,9 @@ Options CPUPathTracing::options() const {
   Options result = {};
   result.add(_private->options.nee, "nee", "Next Event Estimation");
   result.add(_private->options.mis, "mis", "Multiple Importance Sampling");
+  result.add(1u, _private->options.nee_candidates, 64u, "nee_candidates", "Light Candidates (RIS)");
+  result.add(_private->options.temporal_reuse, "temporal_reuse", "Temporal Reuse (biased)");
+  result.add(_private->options.spatial_reuse, "spatial_reuse", "Spatial Reuse (biased)");
   return result;
 }
 
@@ -8,28 +8,71 @@
 
 #include <etx/rt/shared/vcm_shared.hxx>
 
-#include <mutex>
-
 namespace etx {
 
+namespace {
+
+using VCMCameraStep = bool (*)(const Scene&, const VCMIteration&, const VCMOptions&, const ArrayView<VCMLightPath>&, const ArrayView<VCMLightVertex>&, VCMPathState&,
+  const Raytracing&, const VCMSpatialGridData&);
+using VCMLightStep = LightStepResult (*)(const Scene&, const VCMIteration&, const VCMOptions&, const uint32_t, VCMPathState&, const Raytracing&);
+
+constexpr uint32_t vcm_kernel_features(uint32_t options) {
+  if ((options & VCMOptions::PathTracingOptions) == options)
+    return VCMOptions::PathTracingOptions;
+  if ((options & VCMOptions::NoMergingOptions) == options)
+    return VCMOptions::NoMergingOptions;
+  return VCMOptions::DefaultOptions;
+}
+
+template <uint32_t kFeatures>
+constexpr std::pair<VCMCameraStep, VCMLightStep> vcm_kernel() {
+  return {vcm_camera_step<kFeatures>, vcm_light_step<kFeatures>};
+}
+
+std::pair<VCMCameraStep, VCMLightStep> select_vcm_kernel(uint32_t options) {
+  switch (vcm_kernel_features(options)) {
+    case VCMOptions::PathTracingOptions:
+      return vcm_kernel<VCMOptions::PathTracingOptions>();
+    case VCMOptions::NoMergingOptions:
+      return vcm_kernel<VCMOptions::NoMergingOptions>();
+    default:
+      return vcm_kernel<VCMOptions::DefaultOptions>();
+  }
+}
+
+}  // namespace
+
 struct CPUVCMImpl {
+  // light vertices, paths and spatial grid of one pass; two passes are kept so the
+  // light pass of the next iteration can run while the camera pass reads the previous one
+  struct LightPass {
+    VCMIteration iteration = {};
+    VCMSpatialGrid grid = {};
+    std::vector<VCMLightPath> paths;
+    std::vector<VCMLightVertex> vertices;
+    std::atomic<uint64_t> vertex_reserved = {};
+    std::atomic<uint64_t> vertex_count = {};
+  };
+
   struct GatherLightVerticesTask : public Task {
     CPUVCMImpl* impl = nullptr;
+    LightPass* pass = nullptr;
     GatherLightVerticesTask(CPUVCMImpl* i)
       : impl(i) {
     }
     void execute_range(uint32_t begin, uint32_t end, uint32_t thread_id) override {
-      impl->gather_light_vertices(begin, end, thread_id);
+      impl->gather_light_vertices(*pass, begin, end, thread_id);
     }
   } gather_light_job = {this};
 
   struct GatherCameraVerticesTask : public Task {
     CPUVCMImpl* impl = nullptr;
+    LightPass* pass = nullptr;
     GatherCameraVerticesTask(CPUVCMImpl* i)
       : impl(i) {
     }
     void execute_range(uint32_t begin, uint32_t end, uint32_t thread_id) override {
-      impl->gather_camera_vertices(begin, end, thread_id);
+      impl->gather_camera_vertices(*pass, begin, end, thread_id);
     }
   } gather_camera_job = {this};
 
@@ -39,7 +82,8 @@ struct CPUVCMImpl {
   Film camera_image;
   Film light_image;
   Film iteration_light_image;
-  Task::Handle current_task = {};
+  Task::Handle light_task = {};
+  Task::Handle camera_task = {};
 
   bool light_image_updated = false;
   bool camera_image_updated = false;
@@ -58,26 +102,58 @@ struct CPUVCMImpl {
     double last_iteration_time = {};
   } stats;
 
-  VCMState vcm_state = VCMState::Stopped;
   VCMOptions vcm_options = {};
-  VCMIteration vcm_iteration = {};
+  VCMCameraStep camera_step = vcm_camera_step<VCMOptions::DefaultOptions>;
+  VCMLightStep light_step = vcm_light_step<VCMOptions::DefaultOptions>;
+
+  struct ThreadLightVertices {
+    std::vector<VCMLightVertex> local;
+    std::vector<VCMLightVertex> overflow;
+    std::vector<uint32_t> overflow_paths;
+  };
 
-  VCMSpatialGrid _current_grid = {};
+  std::vector<ThreadLightVertices> _thread_light_vertices;
 
-  std::mutex _light_vertices_lock;
-  std::vector<VCMLightPath> _light_paths;
-  std::vector<VCMLightVertex> _light_vertices;
+  LightPass _light_passes[2] = {};
+  LightPass* _light_pass = nullptr;
+  LightPass* _ready_pass = nullptr;
+  LightPass* _camera_pass = nullptr;
+  uint32_t _scheduled_passes = 0;
+  uint32_t _completed_passes = 0;
 
   CPUVCMImpl(Raytracing& r, std::atomic<Integrator::State>* st)
     : rt(r)
     , state(st)
     , vcm_options(VCMOptions::default_values()) {
+    _thread_light_vertices.resize(rt.scheduler().max_thread_count());
   }
 
   bool running() const {
     return state->load() != Integrator::State::Stopped;
   }
 
+  uint64_t light_path_count() const {
+    return (vcm_options.light_paths > 0) ? vcm_options.light_paths : camera_image.count();
+  }
+
+  uint32_t total_passes() const {
+    return rt.scene().samples;
+  }
+
+  bool has_more_passes() const {
+    return _scheduled_passes < total_passes();
+  }
+
+  VCMState vcm_state() const {
+    if (_camera_pass != nullptr)
+      return VCMState::GatheringCameraVertices;
+
+    if (_light_pass != nullptr)
+      return VCMState::GatheringLightVertices;
+
+    return VCMState::Stopped;
+  }
+
   void build_stats() {
     static const char* str_state[] = {
       "Stopped",
@@ -91,97 +167,162 @@ struct CPUVCMImpl {
       "Gathering Camera Vertices",
     };
 
-    double l_c = 100.0 * double(stats.l.load()) / double(camera_image.count());
+    double l_c = 100.0 * double(stats.l.load()) / double(light_path_count());
     double c_c = 100.0 * double(stats.c.load()) / double(camera_image.count());
+    uint32_t vcm_state_index = uint32_t(vcm_state());
 
-    if (vcm_iteration.iteration == 0) {
-      snprintf(status, sizeof(status), "0 | %s / %s : L: %.2f, C: %.2f", str_state[uint32_t(state->load())], str_vcm_state[uint32_t(vcm_state)], l_c, c_c);
+    if (_completed_passes == 0) {
+      snprintf(status, sizeof(status), "0 | %s / %s : L: %.2f, C: %.2f", str_state[uint32_t(state->load())], str_vcm_state[vcm_state_index], l_c, c_c);
     } else {
-      snprintf(status, sizeof(status), "%u | %s / %s : L: %.2f, C: %.2f, last iteration time: %.2fs (L: %.2fs, C: %.2fs, G: %.2fs, M: %.2f)", vcm_iteration.iteration,  //
-        str_state[uint32_t(state->load())], str_vcm_state[uint32_t(vcm_state)], l_c, c_c, stats.last_iteration_time, stats.l_time, stats.c_time, stats.g_time, stats.m_time);
+      snprintf(status, sizeof(status), "%u | %s / %s : L: %.2f, C: %.2f, last iteration time: %.2fs (L: %.2fs, C: %.2fs, G: %.2fs, M: %.2f)", _completed_passes,  //
+        str_state[uint32_t(state->load())], str_vcm_state[vcm_state_index], l_c, c_c, stats.last_iteration_time, stats.l_time, stats.c_time, stats.g_time, stats.m_time);
     }
   }
 
   void start(const Options& opt) {
+    ETX_ASSERT((_light_pass == nullptr) && (_camera_pass == nullptr));
     camera_image.clear();
     light_image.clear();
     iteration_light_image.clear();
     light_image_updated = true;
     camera_image_updated = true;
     vcm_options.load(opt);
+    std::tie(camera_step, light_step) = select_vcm_kernel(vcm_options.options);
     stats.total_time = {};
-    vcm_iteration.iteration = 0;
-    vcm_state = VCMState::Stopped;
-    start_next_iteration();
+    stats.iteration_time = {};
+    _ready_pass = nullptr;
+    _scheduled_passes = 0;
+    _completed_passes = 0;
+    schedule_light_pass();
+  }
+
+  void wait_for_tasks() {
+    rt.scheduler().wait(light_task);
+    rt.scheduler().wait(camera_task);
+    light_task = {};
+    camera_task = {};
+    _light_pass = nullptr;
+    _ready_pass = nullptr;
+    _camera_pass = nullptr;
   }
 
-  void start_next_iteration() {
-    ETX_ASSERT((vcm_state == VCMState::Stopped) || (vcm_state == VCMState::GatheringCameraVertices));
-    rt.scheduler().wait(current_task);
+  void schedule_light_pass() {
+    ETX_ASSERT(_light_pass == nullptr);
+
+    auto& pass = _light_passes[_scheduled_passes % 2u];
+    ETX_ASSERT(&pass != _camera_pass);
 
-    stats.c_time = stats.camera_gather_time.measure();
-    stats.last_iteration_time = stats.iteration_time.measure();
-    stats.iteration_time = {};
     stats.light_gather_time = {};
     stats.l = 0;
-    stats.c = 0;
 
     float used_radius = vcm_options.initial_radius;
     if (used_radius == 0.0f) {
       used_radius = 5.0f * rt.scene().bounding_sphere_radius * min(1.0f / float(camera_image.dimensions().x), 1.0f / float(camera_image.dimensions().y));
     }
 
-    vcm_state = VCMState::GatheringLightVertices;
+    auto& iteration = pass.iteration;
+    iteration.iteration = _scheduled_passes;
+
+    float radius_scale = 1.0f / (1.0f + float(iteration.iteration) / float(vcm_options.radius_decay));
+    iteration.current_radius = used_radius * radius_scale;
 
-    float radius_scale = 1.0f / (1.0f + float(vcm_iteration.iteration) / float(vcm_options.radius_decay));
-    vcm_iteration.current_radius = used_radius * radius_scale;
+    uint64_t path_count = light_path_count();
+    float eta_vcm = kPi * sqr(iteration.current_radius) * float(path_count);
+    iteration.vm_weight = vcm_options.enable_merging() ? eta_vcm : 0.0f;
+    iteration.vc_weight = 1.0f / eta_vcm;
+    iteration.vm_normalization = 1.0f / eta_vcm;
+    iteration.light_path_ratio = float(path_count) / float(camera_image.count());
+    iteration.light_path_offset = static_cast<uint32_t>((uint64_t(iteration.iteration) * camera_image.count()) % path_count);
 
-    float eta_vcm = kPi * sqr(vcm_iteration.current_radius) * float(camera_image.count());
-    vcm_iteration.vm_weight = vcm_options.enable_merging() ? eta_vcm : 0.0f;
-    vcm_iteration.vc_weight = 1.0f / eta_vcm;
-    vcm_iteration.vm_normalization = 1.0f / eta_vcm;
+    pass.paths.assign(path_count, {});
+    if (pass.vertices.size() < 2llu * path_count) {
+      pass.vertices.resize(2llu * path_count);
+    }
+    pass.vertex_reserved = 0;
+    pass.vertex_count = 0;
 
-    _light_paths.clear();
-    _light_vertices.clear();
-    current_task = rt.scheduler().schedule(camera_image.count(), &gather_light_job);
+    _light_pass = &pass;
+    _scheduled_passes += 1;
+
+    gather_light_job.pass = &pass;
+    light_task = rt.scheduler().schedule(uint32_t(path_count), &gather_light_job);
   }
 
-  void continue_iteration() {
-    ETX_ASSERT(vcm_state == VCMState::GatheringLightVertices);
-    rt.scheduler().wait(current_task);
+  void complete_light_pass() {
+    ETX_ASSERT(_light_pass != nullptr);
+    rt.scheduler().wait(light_task);
+    light_task = {};
 
+    auto& pass = *_light_pass;
     stats.l_time = stats.light_gather_time.measure();
 
+    commit_light_vertices(pass);
+
     if (vcm_options.enable_merging() && vcm_options.merge_vertices()) {
       TimeMeasure grid_time = {};
-      _current_grid.construct(rt.scene(), _light_vertices.data(), _light_vertices.size(), vcm_iteration.current_radius, rt.scheduler());
+      pass.grid.construct(rt.scene(), pass.vertices.data(), pass.vertex_count.load(), pass.iteration.current_radius, rt.scheduler());
       stats.g_time = grid_time.measure();
     } else {
+      pass.grid.data = {};
       stats.g_time = 0.0f;
     }
+
+    _ready_pass = _light_pass;
+    _light_pass = nullptr;
+  }
+
+  void schedule_camera_pass() {
+    ETX_ASSERT((_camera_pass == nullptr) && (_ready_pass != nullptr));
+
     stats.camera_gather_time = {};
+    stats.c = 0;
 
-    vcm_state = VCMState::GatheringCameraVertices;
-    current_task = rt.scheduler().schedule(camera_image.count(), &gather_camera_job);
+    _camera_pass = _ready_pass;
+    _ready_pass = nullptr;
+
+    /*
+     * light image receives the pass only together with its camera pass, so a light pass completed
+     * after stop was requested is discarded and both images keep the same number of iterations;
+     * no light pass is running here, the next one is scheduled after this call
+     */
+    TimeMeasure tm = {};
+    float t = float(_camera_pass->iteration.iteration) / float(_camera_pass->iteration.iteration + 1);
+    iteration_light_image.flush_to(light_image, t);
+    light_image_updated = true;
+    stats.m_time = tm.measure();
+
+    gather_camera_job.pass = _camera_pass;
+    camera_task = rt.scheduler().schedule(camera_image.count(), &gather_camera_job);
   }
 
-  void gather_light_vertices(uint32_t range_begin, uint32_t range_end, uint32_t thread_id) {
-    const Scene& scene = rt.scene();
+  void complete_camera_pass() {
+    ETX_ASSERT(_camera_pass != nullptr);
+    rt.scheduler().wait(camera_task);
+    camera_task = {};
+
+    stats.c_time = stats.camera_gather_time.measure();
+    stats.last_iteration_time = stats.iteration_time.measure();
+    stats.iteration_time = {};
+
+    _camera_pass = nullptr;
+    _completed_passes += 1;
+  }
 
-    std::vector<VCMLightVertex> local_vertices;
-    local_vertices.reserve(4llu * (range_end - range_begin));
+  void gather_light_vertices(LightPass& pass, uint32_t range_begin, uint32_t range_end, uint32_t thread_id) {
+    const Scene& scene = rt.scene();
 
-    std::vector<VCMLightPath> local_paths;
-    local_paths.reserve(range_end - range_begin);
+    auto& thread_vertices = _thread_light_vertices[thread_id];
+    auto& local_vertices = thread_vertices.local;
+    local_vertices.clear();
 
     for (uint64_t i = range_begin; running() && (i < range_end); ++i) {
       stats.l++;
 
-      VCMPathState state = vcm_generate_emitter_state(static_cast<uint32_t>(i), scene, vcm_iteration);
+      VCMPathState state = vcm_generate_emitter_state(static_cast<uint32_t>(i), scene, pass.iteration);
 
       uint32_t path_begin = static_cast<uint32_t>(local_vertices.size());
       while (running()) {
-        auto step_result = vcm_light_step(scene, vcm_iteration, vcm_options, static_cast<uint32_t>(i), state, rt);
+        auto step_result = light_step(scene, pass.iteration, vcm_options, static_cast<uint32_t>(i), state, rt);
 
         if (step_result.add_vertex) {
           local_vertices.emplace_back(step_result.vertex_to_add);
@@ -197,42 +338,87 @@ struct CPUVCMImpl {
         }
       }
 
-      auto& lp = local_paths.emplace_back();
+      auto& lp = pass.paths[i];
       lp.index = path_begin;
       lp.count = static_cast<uint32_t>(local_vertices.size() - path_begin);
       lp.spect = state.spect;
     }
 
-    {
-      std::scoped_lock lock(_light_vertices_lock);
-      for (auto& path : local_paths) {
-        path.index += static_cast<uint32_t>(_light_vertices.size());
+    uint64_t vertex_count = local_vertices.size();
+    if (vertex_count == 0) {
+      return;
+    }
+
+    // reserve a range in the shared storage; ranges that do not fit are kept per thread
+    // and appended by commit_light_vertices once gathering is complete
+    uint64_t base = pass.vertex_reserved.fetch_add(vertex_count);
+    if (base + vertex_count <= pass.vertices.size()) {
+      memcpy(pass.vertices.data() + base, local_vertices.data(), vertex_count * sizeof(VCMLightVertex));
+      for (uint64_t i = range_begin; i < range_end; ++i) {
+        pass.paths[i].index += static_cast<uint32_t>(base);
+      }
+      pass.vertex_count += vertex_count;
+    } else {
+      uint32_t overflow_base = static_cast<uint32_t>(thread_vertices.overflow.size());
+      thread_vertices.overflow.insert(thread_vertices.overflow.end(), local_vertices.begin(), local_vertices.end());
+      for (uint32_t i = range_begin; i < range_end; ++i) {
+        pass.paths[i].index += overflow_base;
+        thread_vertices.overflow_paths.emplace_back(i);
       }
-      _light_paths.insert(_light_paths.end(), local_paths.begin(), local_paths.end());
-      _light_vertices.insert(_light_vertices.end(), local_vertices.begin(), local_vertices.end());
     }
   }
 
-  void gather_camera_vertices(uint32_t range_begin, uint32_t range_end, uint32_t thread_id) {
-    auto light_vertices = make_array_view<VCMLightVertex>(_light_vertices.data(), _light_vertices.size());
-    auto light_paths = make_array_view<VCMLightPath>(_light_paths.data(), _light_paths.size());
+  void commit_light_vertices(LightPass& pass) {
+    uint64_t overflow_count = 0;
+    for (const auto& thread_vertices : _thread_light_vertices) {
+      overflow_count += thread_vertices.overflow.size();
+    }
+
+    if (overflow_count == 0) {
+      return;
+    }
+
+    uint64_t base = pass.vertex_count.load();
+    uint64_t required_size = base + overflow_count;
+    pass.vertices.resize(required_size + required_size / 4llu);
+
+    for (auto& thread_vertices : _thread_light_vertices) {
+      if (thread_vertices.overflow.empty())
+        continue;
+
+      memcpy(pass.vertices.data() + base, thread_vertices.overflow.data(), thread_vertices.overflow.size() * sizeof(VCMLightVertex));
+      for (uint32_t path_index : thread_vertices.overflow_paths) {
+        pass.paths[path_index].index += static_cast<uint32_t>(base);
+      }
+      base += thread_vertices.overflow.size();
+      thread_vertices.overflow.clear();
+      thread_vertices.overflow_paths.clear();
+    }
+
+    pass.vertex_count = base;
+  }
+
+  void gather_camera_vertices(LightPass& pass, uint32_t range_begin, uint32_t range_end, uint32_t thread_id) {
+    auto light_vertices = make_array_view<VCMLightVertex>(pass.vertices.data(), pass.vertex_count.load());
+    auto light_paths = make_array_view<VCMLightPath>(pass.paths.data(), pass.paths.size());
+    const auto& iteration = pass.iteration;
     const auto& scene = rt.scene();
 
     for (uint32_t pi = range_begin; running() && (pi < range_end); ++pi) {
       uint32_t x = pi % camera_image.dimensions().x;
       uint32_t y = pi / camera_image.dimensions().x;
 
-      const auto& light_path = _light_paths[pi];
+      const auto& light_path = pass.paths[vcm_light_path_index(iteration, pi, pass.paths.size())];
 
       stats.c++;
-      VCMPathState state = vcm_generate_camera_state({x, y}, scene, vcm_iteration, light_path.spect);
-      while (running() && vcm_camera_step(scene, vcm_iteration, vcm_options, light_paths, light_vertices, state, rt, _current_grid.data)) {
+      VCMPathState state = vcm_generate_camera_state({x, y}, scene, iteration, light_path.spect);
+      while (running() && camera_step(scene, iteration, vcm_options, light_paths, light_vertices, state, rt, pass.grid.data)) {
       }
 
-      state.merged *= vcm_iteration.vm_normalization;
+      state.merged *= iteration.vm_normalization;
       state.merged += (state.gathered / spectrum::sample_pdf()).to_xyz();
 
-      float t = float(vcm_iteration.iteration) / float(vcm_iteration.iteration + 1);
+      float t = float(iteration.iteration) / float(iteration.iteration + 1);
       camera_image.accumulate({state.merged.x, state.merged.y, state.merged.z, 1.0f}, state.uv, t);
     }
   }
@@ -283,29 +469,33 @@ void CPUVCM::run(const Options& opt) {
 
 void CPUVCM::update() {
   _private->build_stats();
-  _private->camera_image_updated = _private->vcm_state == VCMState::GatheringCameraVertices;
+  _private->camera_image_updated = _private->_camera_pass != nullptr;
 
-  if ((current_state == State::Stopped) || (rt.scheduler().completed(_private->current_task) == false)) {
+  if (current_state == State::Stopped) {
     return;
   }
 
-  if (_private->vcm_state == VCMState::GatheringLightVertices) {
-    TimeMeasure tm = {};
-    _private->light_image_updated = true;
-    _private->iteration_light_image.flush_to(_private->light_image, float(_private->vcm_iteration.iteration) / float(_private->vcm_iteration.iteration + 1));
-    _private->stats.m_time = tm.measure();
-    _private->continue_iteration();
-  } else if (current_state == State::WaitingForCompletion) {
-    current_state = Integrator::State::Stopped;
-    rt.scheduler().wait(_private->current_task);
-    _private->current_task = {};
-  } else if (_private->vcm_iteration.iteration + 1 < rt.scene().samples) {
-    _private->vcm_iteration.iteration += 1;
-    _private->start_next_iteration();
-  } else {
+  if ((_private->_light_pass != nullptr) && rt.scheduler().completed(_private->light_task)) {
+    _private->complete_light_pass();
+  }
+
+  if ((_private->_camera_pass != nullptr) && rt.scheduler().completed(_private->camera_task)) {
+    _private->complete_camera_pass();
+  }
+
+  bool finishing = (current_state == State::WaitingForCompletion) && (_private->_completed_passes > 0);
+
+  if ((_private->_camera_pass == nullptr) && (_private->_ready_pass != nullptr) && (finishing == false)) {
+    _private->schedule_camera_pass();
+    if ((current_state != State::WaitingForCompletion) && _private->has_more_passes()) {
+      _private->schedule_light_pass();
+    }
+  }
+
+  bool pending_passes = (_private->_light_pass != nullptr) || (_private->_ready_pass != nullptr);
+  if ((_private->_camera_pass == nullptr) && (finishing || (pending_passes == false))) {
     current_state = Integrator::State::Stopped;
-    rt.scheduler().wait(_private->current_task);
-    _private->current_task = {};
+    _private->wait_for_tasks();
   }
 }
 
@@ -316,11 +506,10 @@ void CPUVCM::stop(Stop st) {
 
   if (st == Stop::Immediate) {
     current_state = State::Stopped;
-    rt.scheduler().wait(_private->current_task);
-    _private->current_task = {};
+    _private->wait_for_tasks();
   } else {
     current_state = State::WaitingForCompletion;
-    snprintf(_private->status, sizeof(_private->status), "[%u] Waiting for completion", _private->vcm_iteration.iteration);
+    snprintf(_private->status, sizeof(_private->status), "[%u] Waiting for completion", _private->_completed_passes);
   }
 }
 
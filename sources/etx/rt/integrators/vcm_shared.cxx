@@ -7,12 +7,14 @@ VCMOptions VCMOptions::default_values() {
   options.options = DefaultOptions;
   options.radius_decay = 256u;
   options.initial_radius = 0.0f;
+  options.light_paths = 0u;
   return options;
 }
 
 void VCMOptions::load(const Options& opt) {
   initial_radius = opt.get("initial_radius", initial_radius).to_float();
   radius_decay = opt.get("radius_decay", radius_decay).to_integer();
+  light_paths = opt.get("light_paths", light_paths).to_integer();
 
   options = opt.get("direct_hit", direct_hit()).to_bool() ? (options | DirectHit) : (options & ~DirectHit);
   options = opt.get("connect_to_light", connect_to_light()).to_bool() ? (options | ConnectToLight) : (options & ~ConnectToLight);
@@ -26,6 +28,7 @@ void VCMOptions::load(const Options& opt) {
 void VCMOptions::store(Options& opt) {
   opt.add(0.0f, initial_radius, 10.0f, "initial_radius", "Initial Radius");
   opt.add(1u, uint32_t(radius_decay), 65536u, "radius_decay", "Radius Decay");
+  opt.add(0u, uint32_t(light_paths), 1u << 26u, "light_paths", "Light Paths (0 - one per pixel)");
   opt.add("debug", "Compute:");
   opt.add(direct_hit(), "direct_hit", "Direct Hits");
   opt.add(connect_to_light(), "connect_to_light", "Connect to Lights");
@@ -65,7 +68,7 @@ void VCMSpatialGrid::construct(const Scene& scene, const VCMLightVertex* samples
   data.hash_table_mask = hash_table_size - 1u;
 
   _position_to_index.resize(sample_count);
-  _indices.resize(sample_count);
+  _vertices.resize(sample_count);
 
   _cell_ends.resize(hash_table_size);
   memset(_cell_ends.data(), 0, sizeof(uint32_t) * hash_table_size);
@@ -81,23 +84,51 @@ void VCMSpatialGrid::construct(const Scene& scene, const VCMLightVertex* samples
     }
   });
 
+  // exclusive scan of the cell sizes: per-block sums, scan of the block sums, then per-block scan with offsets
+  constexpr uint32_t kScanBlockSize = 16384u;
+  uint32_t block_count = (hash_table_size + kScanBlockSize - 1u) / kScanBlockSize;
+  _block_sums.resize(block_count);
+
+  scheduler.execute(block_count, [this, hash_table_size](uint32_t begin, uint32_t end, uint32_t thread_id) {
+    for (uint32_t b = begin; b < end; ++b) {
+      uint32_t sum = 0;
+      for (uint32_t i = b * kScanBlockSize, e = min(i + kScanBlockSize, hash_table_size); i < e; ++i) {
+        sum += _cell_ends[i];
+      }
+      _block_sums[b] = sum;
+    }
+  });
+
   uint32_t sum = 0;
-  for (auto& cell_end : _cell_ends) {
-    uint32_t t = cell_end;
-    cell_end = sum;
+  for (auto& block_sum : _block_sums) {
+    uint32_t t = block_sum;
+    block_sum = sum;
     sum += t;
   }
 
+  scheduler.execute(block_count, [this, hash_table_size](uint32_t begin, uint32_t end, uint32_t thread_id) {
+    for (uint32_t b = begin; b < end; ++b) {
+      uint32_t sum = _block_sums[b];
+      for (uint32_t i = b * kScanBlockSize, e = min(i + kScanBlockSize, hash_table_size); i < e; ++i) {
+        uint32_t t = _cell_ends[i];
+        _cell_ends[i] = sum;
+        sum += t;
+      }
+    }
+  });
+
+  // counting sort: vertices are copied into cell order so gathering reads them sequentially;
+  // after the scatter each entry of _cell_ends points to the end of its cell
   ptr = reinterpret_cast<int32_t*>(_cell_ends.data());
-  scheduler.execute(uint32_t(sample_count), [this, ptr](uint32_t begin, uint32_t end, uint32_t thread_id) {
+  scheduler.execute(uint32_t(sample_count), [this, &samples, ptr](uint32_t begin, uint32_t end, uint32_t thread_id) {
     for (uint32_t i = begin; i < end; ++i) {
       uint32_t index = _position_to_index[i];
       uint32_t target_cell = atomic_inc(ptr + index);
-      _indices[target_cell] = i;
+      _vertices[target_cell] = samples[i];
     }
   });
 
-  data.indices = make_array_view<uint32_t>(_indices.data(), _indices.size());
+  data.vertices = make_array_view<VCMLightVertex>(_vertices.data(), _vertices.size());
   data.cell_ends = make_array_view<uint32_t>(_cell_ends.data(), _cell_ends.size());
 }
 
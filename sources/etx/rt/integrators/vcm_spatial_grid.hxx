@@ -11,9 +11,10 @@ struct VCMSpatialGrid {
   void construct(const Scene& scene, const VCMLightVertex* samples, uint64_t sample_count, float radius, TaskScheduler& scheduler);
 
  private:
-  std::vector<uint32_t> _indices;
+  std::vector<VCMLightVertex> _vertices;
   std::vector<uint32_t> _cell_ends;
   std::vector<uint32_t> _position_to_index;
+  std::vector<uint32_t> _block_sums;
 };
 
 }  // namespace etx
@@ -1,10 +1,24 @@
 #include <etx/core/core.hxx>
 #include <etx/rt/rt.hxx>
+#include <etx/render/host/texture_cache.hxx>
 
 #include <embree4/rtcore.h>
 
 namespace etx {
 
+namespace {
+
+thread_local RayStatistics ray_statistics = {};
+std::atomic<bool> ray_statistics_enabled = {false};
+
+void count_ray_statistics(uint32_t counter, uint32_t value = 1u) {
+  if (ray_statistics_enabled.load(std::memory_order_relaxed)) {
+    ray_statistics.counters[counter] += value;
+  }
+}
+
+}  // namespace
+
 struct RaytracingImpl {
   TaskScheduler scheduler;
 
@@ -141,6 +155,8 @@ struct RaytracingImpl {
       auto& image = gpu.scene.images[i];
       if (image.format == Image::Format::RGBA32F) {
         scene_buffer_size = align_up(scene_buffer_size + array_size(image.pixels.f32), 16llu);
+      } else if (image.block_compressed()) {
+        scene_buffer_size = align_up(scene_buffer_size + array_size(image.pixels.blocks), 16llu);
       } else {
         scene_buffer_size = align_up(scene_buffer_size + array_size(image.pixels.u8), 16llu);
       }
@@ -153,6 +169,8 @@ struct RaytracingImpl {
     scene_buffer_size = align_up(scene_buffer_size + array_size(gpu.scene.images), 16llu);
     for (uint32_t i = 0; i < gpu.scene.mediums.count; ++i) {
       scene_buffer_size = align_up(scene_buffer_size + array_size(gpu.scene.mediums[i].density), 16llu);
+      scene_buffer_size = align_up(scene_buffer_size + array_size(gpu.scene.mediums[i].bricks), 16llu);
+      scene_buffer_size = align_up(scene_buffer_size + array_size(gpu.scene.mediums[i].majorants), 16llu);
     }
     scene_buffer_size = align_up(scene_buffer_size + array_size(gpu.scene.mediums), 16llu);
 
@@ -167,8 +185,24 @@ struct RaytracingImpl {
 
       for (uint32_t i = 0; (images_ptr != nullptr) && (i < gpu.scene.images.count); ++i) {
         Image image = gpu.scene.images[i];
+
+        // device keeps streamed images resident, their pages are gathered through the texture cache
+        void* resident_pixels = nullptr;
+        if (image.options & Image::Streamed) {
+          uint64_t storage_size = image.storage_size();
+          resident_pixels = malloc(storage_size);
+          for (uint64_t offset = 0; (resident_pixels != nullptr) && (offset < storage_size); offset += TextureCache::kPageSize) {
+            auto size = static_cast<uint32_t>(std::min(TextureCache::kPageSize, storage_size - offset));
+            texture_cache_read(image.cache, image.cache_source, offset, size, reinterpret_cast<uint8_t*>(resident_pixels) + offset);
+          }
+          image.pixels.f32.a = reinterpret_cast<float4*>(resident_pixels);
+          image.options &= ~Image::Streamed;
+        }
+
         if (image.format == Image::Format::RGBA32F) {
           push_to_generic_buffer(scene_buffer, image.pixels.f32, copy_offset);
+        } else if (image.block_compressed()) {
+          push_to_generic_buffer(scene_buffer, image.pixels.blocks, copy_offset);
         } else {
           push_to_generic_buffer(scene_buffer, image.pixels.u8, copy_offset);
         }
@@ -191,6 +225,7 @@ struct RaytracingImpl {
         images_ptr[i] = image;
 
         free(x_dist_ptr);
+        free(resident_pixels);
       }
       gpu.scene.images = make_array_view<Image>(images_ptr, gpu.scene.images.count);
       push_to_generic_buffer(scene_buffer, gpu.scene.images, copy_offset);
@@ -202,6 +237,8 @@ struct RaytracingImpl {
       for (uint32_t i = 0; (medium_ptr != nullptr) && (i < gpu.scene.mediums.count); ++i) {
         auto medium = gpu.scene.mediums[i];
         push_to_generic_buffer(scene_buffer, medium.density, copy_offset);
+        push_to_generic_buffer(scene_buffer, medium.bricks, copy_offset);
+        push_to_generic_buffer(scene_buffer, medium.majorants, copy_offset);
         medium_ptr[i] = medium;
       }
       gpu.scene.mediums = make_array_view<Medium>(medium_ptr, gpu.scene.mediums.count);
@@ -259,6 +296,44 @@ struct RaytracingImpl {
     ray_hit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
     rtcIntersect1(rt_scene, &ray_hit, &args);
   }
+
+  void trace_packet_with_function(const Ray rays[], uint32_t ray_count, RTCRayQueryContext* context, RTCFilterFunctionN filter_funtion) {
+    ETX_ASSERT(ray_count <= 4u);
+
+    rtcInitRayQueryContext(context);
+
+    RTCIntersectArguments args = {};
+    rtcInitIntersectArguments(&args);
+
+    args.context = context;
+    args.feature_mask = static_cast<RTCFeatureFlags>(RTC_FEATURE_FLAG_TRIANGLE | RTC_FEATURE_FLAG_FILTER_FUNCTION_IN_ARGUMENTS);
+    args.flags = RTC_RAY_QUERY_FLAG_INVOKE_ARGUMENT_FILTER;
+    args.filter = filter_funtion;
+
+    alignas(16) int32_t valid[4] = {};
+    alignas(16) RTCRayHit4 ray_hit = {};
+    for (uint32_t i = 0; i < ray_count; ++i) {
+      const Ray& r = rays[i];
+      ETX_CHECK_FINITE(r.o);
+      ETX_CHECK_FINITE(r.d);
+
+      ray_hit.ray.dir_x[i] = r.d.x;
+      ray_hit.ray.dir_y[i] = r.d.y;
+      ray_hit.ray.dir_z[i] = r.d.z;
+      ray_hit.ray.org_x[i] = r.o.x;
+      ray_hit.ray.org_y[i] = r.o.y;
+      ray_hit.ray.org_z[i] = r.o.z;
+      ray_hit.ray.tnear[i] = r.min_t;
+      ray_hit.ray.tfar[i] = r.max_t;
+      ray_hit.ray.mask[i] = kInvalidIndex;
+      ray_hit.ray.id[i] = i;
+      ray_hit.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+      ray_hit.hit.primID[i] = RTC_INVALID_GEOMETRY_ID;
+      ray_hit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+      valid[i] = -1;
+    }
+    rtcIntersect4(valid, rt_scene, &ray_hit, &args);
+  }
 };
 
 ETX_PIMPL_IMPLEMENT(Raytracing, Impl);
@@ -292,6 +367,14 @@ const Scene& Raytracing::scene() const {
   return *(_private->source_scene);
 }
 
+RayStatistics& Raytracing::thread_statistics() {
+  return ray_statistics;
+}
+
+void Raytracing::set_statistics_enabled(bool enabled) {
+  ray_statistics_enabled = enabled;
+}
+
 const Scene& Raytracing::gpu_scene() const {
   ETX_ASSERT(has_scene());
   _private->gpu.scene.camera = _private->source_scene->camera;
@@ -309,8 +392,11 @@ bool Raytracing::trace_material(const Scene& scene, const Ray& r, const uint32_t
     uint32_t m_id;
   } context = {{}, {{}, kInvalidIndex, 0.0f}, &scene, &smp, material_id};
 
+  count_ray_statistics(RayStatistics::SubsurfaceRays);
+
   auto filter_funtion = [](const struct RTCFilterFunctionNArguments* args) {
     auto ctx = reinterpret_cast<IntersectionContextExt*>(args->context);
+    count_ray_statistics(RayStatistics::FilterInvocations);
 
     uint32_t triangle_index = RTCHitN_primID(args->hit, args->N, 0);
     const auto material_index = ctx->scene->triangle_to_material[triangle_index];
@@ -347,8 +433,11 @@ uint32_t Raytracing::continuous_trace(const Scene& scene, const Ray& r, const Co
     uint32_t max_count;
   } context = {{}, &scene, &smp, options.intersection_buffer, options.material_id, 0u, options.max_intersections};
 
+  count_ray_statistics(RayStatistics::SubsurfaceRays);
+
   auto filter_funtion = [](const struct RTCFilterFunctionNArguments* args) {
     auto ctx = reinterpret_cast<IntersectionContextExt*>(args->context);
+    count_ray_statistics(RayStatistics::FilterInvocations);
     uint32_t triangle_index = RTCHitN_primID(args->hit, args->N, 0);
 
     auto material_index = ctx->scene->triangle_to_material[triangle_index];
@@ -387,7 +476,78 @@ uint32_t Raytracing::continuous_trace(const Scene& scene, const Ray& r, const Co
   return context.count;
 }
 
+void Raytracing::continuous_trace(const Scene& scene, const Ray rays[], uint32_t ray_count, const ContinousTraceOptions& options, uint32_t intersection_counts[],
+  Sampler& smp) const {
+  ETX_FUNCTION_SCOPE();
+
+  struct IntersectionContextExt {
+    RTCRayQueryContext context;
+    const Scene* scene;
+    Sampler* smp;
+    IntersectionBase* buffer;
+    uint32_t* counts;
+    uint32_t mat_id;
+    uint32_t max_count;
+  } context = {{}, &scene, &smp, options.intersection_buffer, intersection_counts, options.material_id, options.max_intersections};
+
+  for (uint32_t i = 0; i < ray_count; ++i) {
+    intersection_counts[i] = 0u;
+  }
+
+  count_ray_statistics(RayStatistics::SubsurfaceRays, ray_count);
+
+  auto filter_funtion = [](const struct RTCFilterFunctionNArguments* args) {
+    auto ctx = reinterpret_cast<IntersectionContextExt*>(args->context);
+    const auto& scene = *ctx->scene;
+
+    for (uint32_t lane = 0; lane < args->N; ++lane) {
+      if (args->valid[lane] == 0)
+        continue;
+
+      count_ray_statistics(RayStatistics::FilterInvocations);
+      uint32_t triangle_index = RTCHitN_primID(args->hit, args->N, lane);
+
+      auto material_index = scene.triangle_to_material[triangle_index];
+      if ((material_index != kInvalidIndex) && (ctx->mat_id != material_index)) {
+        args->valid[lane] = 0;
+        continue;
+      }
+
+      float u = RTCHitN_u(args->hit, args->N, lane);
+      float v = RTCHitN_v(args->hit, args->N, lane);
+      float3 bc = barycentrics({u, v});
+      const auto& tri = scene.triangles[triangle_index];
+      const auto& mat = scene.materials[material_index];
+
+      if (alpha_test_pass(mat, tri, bc, scene, *ctx->smp)) {
+        args->valid[lane] = 0;
+        continue;
+      }
+
+      uint32_t ray_index = RTCRayN_id(args->ray, args->N, lane);
+      uint32_t& count = ctx->counts[ray_index];
+      if (count < ctx->max_count) {
+        ctx->buffer[ray_index * ctx->max_count + count] = {
+          .barycentric = {u, v},
+          .triangle_index = triangle_index,
+          .t = RTCRayN_tfar(args->ray, args->N, lane),
+        };
+        count += 1u;
+      }
+
+      args->valid[lane] = (count < ctx->max_count) ? 0 : -1;
+    }
+  };
+
+  ETX_ASSERT(_private != nullptr);
+  _private->trace_packet_with_function(rays, ray_count, &context.context, filter_funtion);
+}
+
 bool Raytracing::trace(const Scene& scene, const Ray& r, Intersection& result_intersection, Sampler& smp) const {
+  return trace(scene, r, RayCone{}, result_intersection, smp);
+}
+
+bool Raytracing::trace(const Scene& scene, const Ray& r, const RayCone& cone, Intersection& result_intersection, Sampler& smp) const {
   ETX_FUNCTION_SCOPE();
 
   struct IntersectionContextExt {
@@ -395,10 +555,15 @@ bool Raytracing::trace(const Scene& scene, const Ray& r, Intersection& result_in
     IntersectionBase i;
     const Scene* scene;
     Sampler* smp;
-  } context = {{}, {{}, kInvalidIndex, 0.0f}, &scene, &smp};
+    RayCone cone;
+    float3 w_i;
+  } context = {{}, {{}, kInvalidIndex, 0.0f}, &scene, &smp, cone, r.d};
+
+  count_ray_statistics(RayStatistics::IntersectionRays);
 
   auto filter_funtion = [](const struct RTCFilterFunctionNArguments* args) {
     auto ctx = reinterpret_cast<IntersectionContextExt*>(args->context);
+    count_ray_statistics(RayStatistics::FilterInvocations);
 
     const uint32_t triangle_index = RTCHitN_primID(args->hit, args->N, 0);
     const uint32_t material_index = ctx->scene->triangle_to_material[triangle_index];
@@ -408,12 +573,14 @@ bool Raytracing::trace(const Scene& scene, const Ray& r, Intersection& result_in
 
     float u = RTCHitN_u(args->hit, args->N, 0);
     float v = RTCHitN_v(args->hit, args->N, 0);
-    if (alpha_test_pass(mat, tri, barycentrics({u, v}), scene, *ctx->smp)) {
+    float t = RTCRayN_tfar(args->ray, args->N, 0);
+    float footprint = texture_footprint(tri, ctx->w_i, ctx->cone.width_at(t));
+    if (alpha_test_pass(mat, tri, barycentrics({u, v}), scene, *ctx->smp, footprint)) {
       *args->valid = 0;
       return;
     }
 
-    ctx->i = {{u, v}, triangle_index, RTCRayN_tfar(args->ray, args->N, 0)};
+    ctx->i = {{u, v}, triangle_index, t};
   };
 
   ETX_ASSERT(_private != nullptr);
@@ -422,7 +589,7 @@ bool Raytracing::trace(const Scene& scene, const Ray& r, Intersection& result_in
   if (context.i.triangle_index == kInvalidIndex)
     return false;
 
-  result_intersection = make_intersection(scene, r.d, context.i);
+  result_intersection = make_intersection(scene, r.d, context.i, cone.width_at(context.i.t));
   return true;
 }
 
@@ -440,10 +607,13 @@ SpectralResponse Raytracing::trace_transmittance(const SpectralQuery spect, cons
     float3 origin;
     float3 direction;
     float t;
+    bool crossed_medium;
   } context = {{}, &scene, &smp, spect, {spect.wavelength, 1.0f}, medium, p0};
 
+
   auto filter_function = [](const struct RTCFilterFunctionNArguments* args) {
     auto ctx = reinterpret_cast<IntersectionContextExt*>(args->context);
+    count_ray_statistics(RayStatistics::FilterInvocations);
     uint32_t triangle_index = RTCHitN_primID(args->hit, args->N, 0);
     float u = RTCHitN_u(args->hit, args->N, 0);
     float v = RTCHitN_v(args->hit, args->N, 0);
@@ -481,6 +651,7 @@ SpectralResponse Raytracing::trace_transmittance(const SpectralQuery spect, cons
     if (ctx->medium != kInvalidIndex) {
       float dt = fmaxf(0.0f, t - ctx->t);
       ctx->value *= scene.mediums[ctx->medium].transmittance(ctx->spect, *ctx->smp, ctx->origin, ctx->direction, dt);
+      ctx->crossed_medium = true;
       ETX_VALIDATE(ctx->value);
     }
 
@@ -508,9 +679,11 @@ SpectralResponse Raytracing::trace_transmittance(const SpectralQuery spect, cons
 
   if (context.medium != kInvalidIndex) {
     context.value *= scene.mediums[context.medium].transmittance(spect, smp, context.origin, context.direction, t_max - context.t);
+    context.crossed_medium = true;
     ETX_VALIDATE(context.value);
   }
 
+  count_ray_statistics(context.crossed_medium ? RayStatistics::TransmittanceRays : RayStatistics::ShadowRays);
   return context.value;
 }
 
@@ -8,6 +8,25 @@
 
 namespace etx {
 
+/*
+ * Per-thread counters of the ray queries, used to visualize per-pixel cost,
+ * collected only while enabled with Raytracing::set_statistics_enabled.
+ * Connection rays are counted as shadow rays when they cross only vacuum,
+ * and as transmittance rays when some part of them goes through a medium.
+ */
+struct RayStatistics {
+  enum : uint32_t {
+    IntersectionRays,
+    ShadowRays,
+    TransmittanceRays,
+    SubsurfaceRays,
+    FilterInvocations,
+    Count,
+  };
+
+  uint32_t counters[Count] = {};
+};
+
 struct Raytracing {
   Raytracing();
   ~Raytracing();
@@ -23,10 +42,24 @@ struct Raytracing {
   void set_scene(const Scene&);
 
   bool trace(const Scene& scene, const Ray&, Intersection&, Sampler& smp) const;
+
+  /*
+   * same as above, `cone` is used to select texture level for alpha testing and shading
+   */
+  bool trace(const Scene& scene, const Ray&, const RayCone& cone, Intersection&, Sampler& smp) const;
   bool trace_material(const Scene& scene, const Ray&, const uint32_t material_id, Intersection&, Sampler& smp) const;
   uint32_t continuous_trace(const Scene& scene, const Ray&, const ContinousTraceOptions& options, Sampler& smp) const;
+
+  /*
+   * traces up to four rays as a single packet, intersections of the i-th ray are written to
+   * `options.intersection_buffer + i * options.max_intersections` and their number to `intersection_counts[i]`
+   */
+  void continuous_trace(const Scene& scene, const Ray rays[], uint32_t ray_count, const ContinousTraceOptions& options, uint32_t intersection_counts[], Sampler& smp) const;
   SpectralResponse trace_transmittance(const SpectralQuery spect, const Scene& scene, const float3& p0, const float3& p1, const uint32_t medium, Sampler& smp) const;
 
+  static RayStatistics& thread_statistics();
+  static void set_statistics_enabled(bool);
+
  private:
   ETX_DECLARE_PIMPL(Raytracing, 1024);
 };
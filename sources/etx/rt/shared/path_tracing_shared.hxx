@@ -7,12 +7,73 @@ namespace etx {
 
 struct ETX_ALIGNED PTOptions {
   uint32_t path_per_iteration ETX_INIT_WITH(1u);
+  uint32_t nee_candidates ETX_INIT_WITH(1u);
   bool nee ETX_INIT_WITH(true);
   bool mis ETX_INIT_WITH(true);
+  bool temporal_reuse ETX_INIT_WITH(false);
+  bool spatial_reuse ETX_INIT_WITH(false);
+
+  /*
+   * compile-time feature mask of the specialised path tracing kernel,
+   * features missing from the mask are compiled out, present ones are still controlled by the flags above
+   */
+  enum : uint32_t {
+    NEE = 1u << 0u,
+    MIS = 1u << 1u,
+
+    AllFeatures = NEE | MIS,
+  };
+
+  ETX_GPU_CODE uint32_t features() const {
+    return (nee ? NEE : 0u) | (mis ? MIS : 0u);
+  }
+};
+
+/*
+ * Reservoir for resampled importance sampling of direct lighting.
+ * Holds single selected light sample (see emitter_sample_data) with the running sum of the resampling weights,
+ * normal and depth are stored to reject reuse from dissimilar neighbours.
+ */
+struct ETX_ALIGNED PTLightReservoir {
+  float3 sample_data = {};
+  uint32_t emitter_index = kInvalidIndex;
+  float3 nrm = {};
+  float depth = 0.0f;
+  float weight_sum = 0.0f;
+  float target_pdf = 0.0f;
+  float weight = 0.0f;
+  uint32_t sample_count = 0u;
+
+  ETX_GPU_CODE bool valid() const {
+    return (emitter_index != kInvalidIndex) && (weight > 0.0f);
+  }
+
+  ETX_GPU_CODE bool add(const float3& data, uint32_t emitter, float w, float p_hat, uint32_t count, float rnd) {
+    weight_sum += w;
+    sample_count += count;
+    if ((w > 0.0f) && (rnd * weight_sum < w)) {
+      sample_data = data;
+      emitter_index = emitter;
+      target_pdf = p_hat;
+      return true;
+    }
+    return false;
+  }
+
+  ETX_GPU_CODE void finalize() {
+    weight = (target_pdf > 0.0f) && (sample_count > 0) ? weight_sum / (float(sample_count) * target_pdf) : 0.0f;
+  }
+};
+
+struct ETX_ALIGNED PTLightReservoirs {
+  ArrayView<PTLightReservoir> previous ETX_EMPTY_INIT;
+  ArrayView<PTLightReservoir> current ETX_EMPTY_INIT;
+  uint2 dimensions ETX_EMPTY_INIT;
 };
 
 struct ETX_ALIGNED PTRayPayload {
   Ray ray = {};
+  RayCone cone = {};
   SpectralResponse throughput = {spectrum::kUndefinedWavelength, 1.0f};
   SpectralResponse accumulated = {spectrum::kUndefinedWavelength, 0.0f};
   uint32_t index = kInvalidIndex;
@@ -121,40 +182,52 @@ ETX_GPU_CODE bool gather_rw(SpectralQuery spect, const Scene& scene, const Inter
 
 ETX_GPU_CODE bool gather_cb(SpectralQuery spect, const Scene& scene, const Intersection& in_intersection, const Raytracing& rt, Sampler& smp, Gather& result) {
   const auto& mtl = scene.materials[in_intersection.material_index].subsurface;
+  const Image* profile_table = (scene.subsurface_profile_image_index == kInvalidIndex) ? nullptr : &scene.images[scene.subsurface_profile_image_index];
 
   Sample ss_samples[kIntersectionDirections] = {
-    sample(spect, in_intersection, mtl, 0u, smp),
-    sample(spect, in_intersection, mtl, 1u, smp),
-    sample(spect, in_intersection, mtl, 2u, smp),
+    sample(spect, in_intersection, mtl, 0u, profile_table, smp),
+    sample(spect, in_intersection, mtl, 1u, profile_table, smp),
+    sample(spect, in_intersection, mtl, 2u, profile_table, smp),
   };
 
-  IntersectionBase intersections[kTotalIntersections] = {};
-  ContinousTraceOptions ct = {intersections, kIntersectionsPerDirection, in_intersection.material_index};
-  uint32_t intersections_0 = rt.continuous_trace(scene, ss_samples[0].ray, ct, smp);
-  ct.intersection_buffer += intersections_0;
-  uint32_t intersections_1 = rt.continuous_trace(scene, ss_samples[1].ray, ct, smp);
-  ct.intersection_buffer += intersections_1;
-  uint32_t intersections_2 = rt.continuous_trace(scene, ss_samples[2].ray, ct, smp);
-
-  uint32_t intersection_count = intersections_0 + intersections_1 + intersections_2;
-  ETX_CRITICAL(intersection_count <= kTotalIntersections);
-  if (intersection_count == 0) {
+  // probe rays of all directions are traced together
+  Ray rays[kIntersectionDirections] = {};
+  uint32_t ray_samples[kIntersectionDirections] = {};
+  uint32_t ray_count = 0;
+  for (uint32_t i = 0; i < kIntersectionDirections; ++i) {
+    if (ss_samples[i]()) {
+      rays[ray_count] = ss_samples[i].ray;
+      ray_samples[ray_count] = i;
+      ray_count += 1u;
+    }
+  }
+
+  if (ray_count == 0) {
     return false;
   }
 
+  IntersectionBase intersections[kTotalIntersections] = {};
+  uint32_t intersection_counts[kIntersectionDirections] = {};
+  ContinousTraceOptions ct = {intersections, kIntersectionsPerDirection, in_intersection.material_index};
+  rt.continuous_trace(scene, rays, ray_count, ct, intersection_counts, smp);
+
   result = {};
-  for (uint32_t i = 0; i < intersection_count; ++i) {
-    const Sample& ss_sample = (i < intersections_0) ? ss_samples[0] : (i < intersections_0 + intersections_1 ? ss_samples[1] : ss_samples[2]);
+  for (uint32_t i = 0; i < ray_count * kIntersectionsPerDirection; ++i) {
+    uint32_t ray_index = i / kIntersectionsPerDirection;
+    if (i % kIntersectionsPerDirection >= intersection_counts[ray_index])
+      continue;
+
+    const Sample& ss_sample = ss_samples[ray_samples[ray_index]];
 
     auto out_intersection = make_intersection(scene, in_intersection.w_i, intersections[i]);
 
     float gw = geometric_weigth(out_intersection.nrm, ss_sample);
-    float pdf = evaluate(spect, mtl, ss_sample.sampled_radius).average();
+    float pdf = evaluate(spect, mtl, ss_sample.sampled_radius, profile_table).average();
     ETX_VALIDATE(pdf);
     if (pdf <= 0.0f)
       continue;
 
-    auto eval = evaluate(spect, mtl, length(out_intersection.pos - in_intersection.pos));
+    auto eval = evaluate(spect, mtl, length(out_intersection.pos - in_intersection.pos), profile_table);
     ETX_VALIDATE(eval);
 
     auto weight = eval / pdf * gw;
@@ -214,6 +287,7 @@ ETX_GPU_CODE PTRayPayload make_ray_payload(const Scene& scene, uint2 px, uint2 d
   payload.spect = spectrum::sample(payload.smp.next());
   payload.uv = get_jittered_uv(payload.smp, px, dim);
   payload.ray = generate_ray(payload.smp, scene, payload.uv);
+  payload.cone = {0.0f, pixel_spread_angle(scene.camera)};
   payload.throughput = {payload.spect.wavelength, 1.0f};
   payload.accumulated = {payload.spect.wavelength, 0.0f};
   payload.medium = scene.camera_medium_index;
@@ -261,6 +335,7 @@ ETX_GPU_CODE void handle_sampled_medium(const Scene& scene, const Medium::Sample
   payload.mis_weight = true;
   payload.ray.o = medium_sample.pos;
   payload.ray.d = w_o;
+  payload.cone = {};
   payload.path_length += 1;
   ETX_CHECK_FINITE(payload.ray.d);
 }
@@ -292,6 +367,154 @@ ETX_GPU_CODE SpectralResponse evaluate_light(const Scene& scene, const Intersect
   return bsdf_eval.bsdf * emitter_sample.value * tr * (weight / (emitter_sample.pdf_dir * emitter_sample.pdf_sample));
 }
 
+ETX_GPU_CODE SpectralResponse evaluate_light_unshadowed(const Scene& scene, const Intersection& intersection, const Material& mat, const uint32_t medium,
+  const SpectralQuery spect, const EmitterSample& emitter_sample, Sampler& smp, bool mis) {
+  if ((emitter_sample.pdf_dir == 0.0f) || emitter_sample.value.is_zero()) {
+    return {spect.wavelength, 0.0f};
+  }
+
+  BSDFEval bsdf_eval = bsdf::evaluate({spect, medium, PathSource::Camera, intersection, intersection.w_i}, emitter_sample.direction, mat, scene, smp);
+  if (bsdf_eval.valid() == false) {
+    return {spect.wavelength, 0.0f};
+  }
+
+  bool no_weight = (mis == false) || emitter_sample.is_delta;
+  auto weight = no_weight ? 1.0f : power_heuristic(emitter_sample.pdf_dir * emitter_sample.pdf_sample, bsdf_eval.pdf);
+  ETX_VALIDATE(weight);
+
+  return bsdf_eval.bsdf * emitter_sample.value * weight;
+}
+
+ETX_GPU_CODE SpectralResponse shade_light_reservoir(const Scene& scene, const Intersection& intersection, const Raytracing& rt, const uint32_t medium, const SpectralQuery spect,
+  const EmitterSample& emitter_sample, const SpectralResponse& value, Sampler& smp, PTLightReservoir& reservoir) {
+  reservoir.finalize();
+  if ((reservoir.weight <= 0.0f) || value.is_zero()) {
+    return {spect.wavelength, 0.0f};
+  }
+
+  const auto& tri = scene.triangles[intersection.triangle_index];
+  auto pos = shading_pos(scene.vertices, tri, intersection.barycentric, emitter_sample.direction);
+  auto tr = rt.trace_transmittance(spect, scene, pos, emitter_sample.origin, medium, smp);
+  ETX_VALIDATE(tr);
+
+  if (tr.is_zero()) {
+    reservoir.weight = 0.0f;
+    return {spect.wavelength, 0.0f};
+  }
+
+  return value * tr * reservoir.weight;
+}
+
+/*
+ * Resampled importance sampling: draws nee_candidates light samples, weights them by unshadowed contribution
+ * and traces single transmittance ray to the selected one.
+ */
+ETX_GPU_CODE void generate_light_candidates(const Scene& scene, const Intersection& intersection, const Material& mat, const uint32_t medium, const SpectralQuery spect,
+  const PTOptions& options, Sampler& smp, PTLightReservoir& reservoir, EmitterSample& selected_sample, SpectralResponse& selected_value) {
+  uint32_t candidate_count = max(1u, options.nee_candidates);
+  for (uint32_t i = 0; i < candidate_count; ++i) {
+    uint32_t emitter_index = sample_emitter_index(scene, smp);
+    auto emitter_sample = sample_emitter(spect, emitter_index, smp, intersection.pos, scene);
+    float source_pdf = emitter_sample.pdf_dir * emitter_sample.pdf_sample;
+
+    SpectralResponse value = evaluate_light_unshadowed(scene, intersection, mat, medium, spect, emitter_sample, smp, options.mis);
+    float target_pdf = max(0.0f, value.monochromatic());
+    float weight = (source_pdf > 0.0f) ? target_pdf / source_pdf : 0.0f;
+    ETX_VALIDATE(weight);
+
+    if (reservoir.add(emitter_sample_data(emitter_sample), emitter_index, weight, target_pdf, 1u, smp.next())) {
+      selected_sample = emitter_sample;
+      selected_value = value;
+    }
+  }
+}
+
+ETX_GPU_CODE SpectralResponse evaluate_light_ris(const Scene& scene, const Intersection& intersection, const Raytracing& rt, const Material& mat, const uint32_t medium,
+  const SpectralQuery spect, const PTOptions& options, Sampler& smp, PTLightReservoir& reservoir) {
+  ETX_FUNCTION_SCOPE();
+
+  EmitterSample selected_sample = {};
+  SpectralResponse selected_value = {spect.wavelength, 0.0f};
+  generate_light_candidates(scene, intersection, mat, medium, spect, options, smp, reservoir, selected_sample, selected_value);
+  return shade_light_reservoir(scene, intersection, rt, medium, spect, selected_sample, selected_value, smp, reservoir);
+}
+
+ETX_GPU_CODE bool merge_light_reservoir(const Scene& scene, const Intersection& intersection, const Material& mat, const uint32_t medium, const SpectralQuery spect,
+  const PTOptions& options, const PTLightReservoir& other, uint32_t max_sample_count, Sampler& smp, PTLightReservoir& reservoir, EmitterSample& selected_sample,
+  SpectralResponse& selected_value) {
+  if ((other.valid() == false) || (other.emitter_index >= scene.emitters.count)) {
+    return false;
+  }
+
+  if ((dot(other.nrm, intersection.nrm) < 0.9f) || (fabsf(other.depth - intersection.t) > 0.1f * intersection.t)) {
+    return false;
+  }
+
+  auto emitter_sample = evaluate_emitter_sample(spect, other.emitter_index, other.sample_data, intersection.pos, scene);
+  SpectralResponse value = evaluate_light_unshadowed(scene, intersection, mat, medium, spect, emitter_sample, smp, options.mis);
+  float target_pdf = max(0.0f, value.monochromatic());
+
+  uint32_t sample_count = min(other.sample_count, max_sample_count);
+  float weight = target_pdf * other.weight * float(sample_count);
+  ETX_VALIDATE(weight);
+
+  if (reservoir.add(other.sample_data, other.emitter_index, weight, target_pdf, sample_count, smp.next())) {
+    selected_sample = emitter_sample;
+    selected_value = value;
+  }
+  return true;
+}
+
+/*
+ * Resampled direct lighting with reuse of the reservoirs from the previous iteration:
+ * from the same pixel (temporal reuse) and from randomly selected neighbouring pixels (spatial reuse).
+ * Reuse does not account for visibility and geometric differences of the neighbours, so it is biased.
+ */
+ETX_GPU_CODE SpectralResponse evaluate_light_reuse(const Scene& scene, const Intersection& intersection, const Raytracing& rt, const Material& mat, const uint32_t medium,
+  const SpectralQuery spect, const PTOptions& options, const PTLightReservoirs& reservoirs, uint32_t pixel_index, Sampler& smp) {
+  ETX_FUNCTION_SCOPE();
+
+  constexpr uint32_t kSpatialNeighbours = 3u;
+  constexpr float kSpatialRadius = 16.0f;
+  constexpr uint32_t kMaxHistoryScale = 20u;
+
+  PTLightReservoir reservoir = {};
+  EmitterSample selected_sample = {};
+  SpectralResponse selected_value = {spect.wavelength, 0.0f};
+  generate_light_candidates(scene, intersection, mat, medium, spect, options, smp, reservoir, selected_sample, selected_value);
+
+  uint32_t max_sample_count = kMaxHistoryScale * max(1u, options.nee_candidates);
+  if (options.temporal_reuse && (pixel_index < reservoirs.previous.count)) {
+    merge_light_reservoir(scene, intersection, mat, medium, spect, options, reservoirs.previous[pixel_index], max_sample_count, smp, reservoir, selected_sample, selected_value);
+  }
+
+  if (options.spatial_reuse && (reservoirs.previous.count > 0)) {
+    int32_t px = int32_t(pixel_index % reservoirs.dimensions.x);
+    int32_t py = int32_t(pixel_index / reservoirs.dimensions.x);
+    for (uint32_t i = 0; i < kSpatialNeighbours; ++i) {
+      float2 offset = sample_disk(smp.next_2d()) * kSpatialRadius;
+      int32_t nx = clamp(px + int32_t(offset.x), 0, int32_t(reservoirs.dimensions.x) - 1);
+      int32_t ny = clamp(py + int32_t(offset.y), 0, int32_t(reservoirs.dimensions.y) - 1);
+      uint32_t neighbour_index = uint32_t(nx) + uint32_t(ny) * reservoirs.dimensions.x;
+      if ((neighbour_index != pixel_index) && (neighbour_index < reservoirs.previous.count)) {
+        merge_light_reservoir(scene, intersection, mat, medium, spect, options, reservoirs.previous[neighbour_index], max_sample_count, smp, reservoir, selected_sample,
+          selected_value);
+      }
+    }
+  }
+
+  auto result = shade_light_reservoir(scene, intersection, rt, medium, spect, selected_sample, selected_value, smp, reservoir);
+
+  reservoir.nrm = intersection.nrm;
+  reservoir.depth = intersection.t;
+  if (pixel_index < reservoirs.current.count) {
+    auto current = reservoirs.current;
+    current[pixel_index] = reservoir;
+  }
+
+  return result;
+}
+
 ETX_GPU_CODE void handle_direct_emitter(const Scene& scene, const Triangle& tri, const Intersection& intersection, const Raytracing& rt, const bool mis, PTRayPayload& payload) {
   ETX_FUNCTION_SCOPE();
 
@@ -302,8 +525,8 @@ ETX_GPU_CODE void handle_direct_emitter(const Scene& scene, const Triangle& tri,
   float pdf_emitter_area = 0.0f;
   float pdf_emitter_dir = 0.0f;
   float pdf_emitter_dir_out = 0.0f;
-  auto e = emitter_get_radiance(emitter, payload.spect, intersection.tex, payload.ray.o, intersection.pos, pdf_emitter_area, pdf_emitter_dir, pdf_emitter_dir_out, scene,
-    (payload.path_length == 0));
+  auto e = emitter_get_radiance(emitter, payload.spect, intersection.tex, intersection.barycentric, payload.ray.o, intersection.pos, pdf_emitter_area, pdf_emitter_dir,
+    pdf_emitter_dir_out, scene, (payload.path_length == 0));
 
   if (pdf_emitter_dir > 0.0f) {
     auto tr = rt.trace_transmittance(payload.spect, scene, payload.ray.o, intersection.pos, payload.medium, payload.smp);
@@ -315,8 +538,12 @@ ETX_GPU_CODE void handle_direct_emitter(const Scene& scene, const Triangle& tri,
   }
 }
 
-ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& intersection, const PTOptions& options, const Raytracing& rt, PTRayPayload& payload) {
+template <uint32_t kFeatures = PTOptions::AllFeatures>
+ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& intersection, const PTOptions& options, const PTLightReservoirs& reservoirs, const Raytracing& rt,
+  PTRayPayload& payload) {
   ETX_FUNCTION_SCOPE();
+  const bool use_nee = ((kFeatures & PTOptions::NEE) != 0u) && options.nee;
+  const bool use_mis = ((kFeatures & PTOptions::MIS) != 0u) && options.mis;
 
   const auto& tri = scene.triangles[intersection.triangle_index];
   const auto& mat = scene.materials[intersection.material_index];
@@ -324,10 +551,11 @@ ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& interse
   if (mat.cls == Material::Class::Boundary) {
     payload.medium = (dot(intersection.nrm, payload.ray.d) < 0.0f) ? mat.int_medium : mat.ext_medium;
     payload.ray.o = shading_pos(scene.vertices, tri, intersection.barycentric, payload.ray.d);
+    payload.cone.width = payload.cone.width_at(intersection.t);
     return true;
   }
 
-  handle_direct_emitter(scene, tri, intersection, rt, options.mis, payload);
+  handle_direct_emitter(scene, tri, intersection, rt, use_mis, payload);
 
   auto bsdf_sample = bsdf::sample({payload.spect, payload.medium, PathSource::Camera, intersection, intersection.w_i}, mat, scene, payload.smp);
   bool subsurface_path = (bsdf_sample.properties & BSDFSample::Diffuse) && (mat.subsurface.cls != SubsurfaceMaterial::Class::Disabled);
@@ -338,19 +566,34 @@ ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& interse
   // * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
   // direct light sampling
   // * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
-  if (options.nee && (payload.path_length + 1 <= rt.scene().max_path_length)) {
-    uint32_t emitter_index = sample_emitter_index(scene, payload.smp);
+  if (use_nee && (payload.path_length + 1 <= rt.scene().max_path_length)) {
+    bool use_reservoirs = (payload.path_length == 1) && (reservoirs.current.count > 0);
+    bool resampled = use_reservoirs || (options.nee_candidates > 1);
+    uint32_t emitter_index = resampled ? kInvalidIndex : sample_emitter_index(scene, payload.smp);
     SpectralResponse direct_light = {payload.spect.wavelength, 0.0f};
     if (subsurface_sampled) {
       for (uint32_t i = 0; i < ss_gather.intersection_count; ++i) {
-        auto local_sample = sample_emitter(payload.spect, emitter_index, payload.smp, ss_gather.intersections[i].pos, scene);
-        SpectralResponse light_value = evaluate_light(scene, ss_gather.intersections[i], rt, mat, payload.medium, payload.spect, local_sample, payload.smp, options.mis);
+        SpectralResponse light_value = {payload.spect.wavelength, 0.0f};
+        if (resampled) {
+          PTLightReservoir reservoir = {};
+          light_value = evaluate_light_ris(scene, ss_gather.intersections[i], rt, mat, payload.medium, payload.spect, options, payload.smp, reservoir);
+        } else {
+          auto local_sample = sample_emitter(payload.spect, emitter_index, payload.smp, ss_gather.intersections[i].pos, scene);
+          light_value = evaluate_light(scene, ss_gather.intersections[i], rt, mat, payload.medium, payload.spect, local_sample, payload.smp, use_mis);
+        }
         direct_light += ss_gather.weights[i] * light_value;
         ETX_VALIDATE(direct_light);
       }
+    } else if (use_reservoirs) {
+      direct_light += evaluate_light_reuse(scene, intersection, rt, mat, payload.medium, payload.spect, options, reservoirs, payload.index, payload.smp);
+      ETX_VALIDATE(direct_light);
+    } else if (resampled) {
+      PTLightReservoir reservoir = {};
+      direct_light += evaluate_light_ris(scene, intersection, rt, mat, payload.medium, payload.spect, options, payload.smp, reservoir);
+      ETX_VALIDATE(direct_light);
     } else {
       auto emitter_sample = sample_emitter(payload.spect, emitter_index, payload.smp, intersection.pos, scene);
-      direct_light += evaluate_light(scene, intersection, rt, mat, payload.medium, payload.spect, emitter_sample, payload.smp, options.mis);
+      direct_light += evaluate_light(scene, intersection, rt, mat, payload.medium, payload.spect, emitter_sample, payload.smp, use_mis);
       ETX_VALIDATE(payload.accumulated);
     }
     payload.accumulated += payload.throughput * direct_light;
@@ -371,6 +614,7 @@ ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& interse
     payload.sampled_bsdf_pdf = fabsf(dot(payload.ray.d, out_intersection.nrm)) / kPi;
     payload.mis_weight = true;
     payload.ray.o = shading_pos(scene.vertices, scene.triangles[out_intersection.triangle_index], out_intersection.barycentric, payload.ray.d);
+    payload.cone = {};
   } else {
     payload.medium = (bsdf_sample.properties & BSDFSample::MediumChanged) ? bsdf_sample.medium_index : payload.medium;
     payload.sampled_bsdf_pdf = bsdf_sample.pdf;
@@ -378,6 +622,8 @@ ETX_GPU_CODE bool handle_hit_ray(const Scene& scene, const Intersection& interse
     payload.eta *= bsdf_sample.eta;
     payload.ray.d = bsdf_sample.w_o;
     payload.ray.o = shading_pos(scene.vertices, scene.triangles[intersection.triangle_index], intersection.barycentric, payload.ray.d);
+    // texture filtering follows primary and specular chains only, surfaces are treated as flat
+    payload.cone = bsdf_sample.is_delta() ? RayCone{payload.cone.width_at(intersection.t), payload.cone.spread} : RayCone{};
   }
 
   payload.throughput *= bsdf_sample.weight;
@@ -408,7 +654,8 @@ ETX_GPU_CODE void handle_missed_ray(const Scene& scene, PTRayPayload& payload) {
   }
 }
 
-ETX_GPU_CODE bool run_path_iteration(const Scene& scene, const PTOptions& options, const Raytracing& rt, PTRayPayload& payload) {
+template <uint32_t kFeatures = PTOptions::AllFeatures>
+ETX_GPU_CODE bool run_path_iteration(const Scene& scene, const PTOptions& options, const PTLightReservoirs& reservoirs, const Raytracing& rt, PTRayPayload& payload) {
   if (payload.path_length > rt.scene().max_path_length)
     return false;
 
@@ -416,7 +663,7 @@ ETX_GPU_CODE bool run_path_iteration(const Scene& scene, const PTOptions& option
   ETX_CHECK_FINITE(payload.ray.d);
 
   Intersection intersection = {};
-  bool found_intersection = rt.trace(scene, payload.ray, intersection, payload.smp);
+  bool found_intersection = rt.trace(scene, payload.ray, payload.cone, intersection, payload.smp);
 
   Medium::Sample medium_sample = try_sampling_medium(scene, payload, intersection.t);
 
@@ -426,7 +673,7 @@ ETX_GPU_CODE bool run_path_iteration(const Scene& scene, const PTOptions& option
   }
 
   if (found_intersection) {
-    return handle_hit_ray(scene, intersection, options, rt, payload);
+    return handle_hit_ray<kFeatures>(scene, intersection, options, reservoirs, rt, payload);
   }
 
   handle_missed_ray(scene, payload);
@@ -11,6 +11,7 @@ struct ETX_ALIGNED VCMOptions {
   uint32_t options ETX_EMPTY_INIT;
   uint32_t radius_decay ETX_EMPTY_INIT;
   float initial_radius ETX_EMPTY_INIT;
+  uint32_t light_paths ETX_EMPTY_INIT;
 
   enum : uint32_t {
     ConnectToCamera = 1u << 0u,
@@ -22,6 +23,10 @@ struct ETX_ALIGNED VCMOptions {
     EnableMerging = 1u << 6u,
 
     DefaultOptions = DirectHit | ConnectToLight | ConnectToCamera | ConnectVertices | MergeVertices | EnableMis | EnableMerging,
+
+    // feature masks of the specialised camera and light step kernels
+    NoMergingOptions = DirectHit | ConnectToLight | ConnectToCamera | ConnectVertices | EnableMis,
+    PathTracingOptions = DirectHit | ConnectToLight | EnableMis,
   };
 
   void set_option(uint32_t option, bool enabled) {
@@ -66,13 +71,22 @@ struct ETX_ALIGNED VCMIteration {
   uint32_t iteration ETX_EMPTY_INIT;
   uint32_t active_paths ETX_EMPTY_INIT;
   uint32_t light_vertices ETX_EMPTY_INIT;
-  uint32_t pad ETX_EMPTY_INIT;
+  uint32_t light_path_offset ETX_EMPTY_INIT;
   float current_radius ETX_EMPTY_INIT;
   float vm_weight ETX_EMPTY_INIT;
   float vc_weight ETX_EMPTY_INIT;
   float vm_normalization ETX_EMPTY_INIT;
+  float light_path_ratio ETX_EMPTY_INIT;
 };
 
+/*
+ * each camera path connects to a single light path, with more light paths than pixels
+ * the offset moves between iterations so every light path takes part in connections over time
+ */
+ETX_GPU_CODE uint64_t vcm_light_path_index(const VCMIteration& it, uint32_t global_index, uint64_t light_path_count) {
+  return (uint64_t(global_index) + it.light_path_offset) % light_path_count;
+}
+
 struct ETX_ALIGNED VCMPathState {
   enum : uint32_t {
     DeltaEmitter = 1u << 0u,
@@ -83,6 +97,7 @@ struct ETX_ALIGNED VCMPathState {
   SpectralResponse throughput = {};
   SpectralResponse gathered = {};
   Ray ray = {};
+  RayCone cone = {};
 
   float3 merged = {};
   Sampler sampler = {};
@@ -129,55 +144,70 @@ struct ETX_ALIGNED VCMPathState {
 
 constexpr uint64_t kVCMPathStateSize = sizeof(VCMPathState);
 
+// Packed into 64 bytes: directions are octahedral-encoded, barycentrics are stored
+// as two 16-bit values and the material is fetched from the triangle on demand.
 struct ETX_ALIGNED VCMLightVertex {
   VCMLightVertex() = default;
 
   ETX_GPU_CODE VCMLightVertex(const VCMPathState& s, const Intersection& i, uint32_t index)
     : throughput(s.throughput)
-    , w_i(s.ray.d)
+    , pos(i.pos)
     , d_vcm(s.d_vcm)
-    , bc(i.barycentric)
     , d_vc(s.d_vc)
-    , pos(i.pos)
     , d_vm(s.d_vm)
-    , nrm(i.nrm)
+    , packed_w_i(pack_unit_vector(s.ray.d))
+    , packed_nrm(pack_unit_vector(i.nrm))
+    , packed_bc(pack_unorm2x16({i.barycentric.x, i.barycentric.y}))
     , triangle_index(i.triangle_index)
-    , material_index(i.material_index)
     , path_length(s.total_path_depth)
     , path_index(index) {
   }
 
   SpectralResponse throughput = {};
 
-  float3 w_i = {};
+  float3 pos = {};
   float d_vcm = 0.0f;
 
-  float3 bc = {};
   float d_vc = 0.0f;
-
-  float3 pos = {};
   float d_vm = 0.0f;
+  uint32_t packed_w_i = 0u;
+  uint32_t packed_nrm = 0u;
 
-  float3 nrm = {};
+  uint32_t packed_bc = 0u;
   uint32_t triangle_index = kInvalidIndex;
-  uint32_t material_index = kInvalidIndex;
-
   uint32_t path_length = 0;
   uint32_t path_index = 0;
 
+  ETX_GPU_CODE float3 barycentric() const {
+    float2 bc = unpack_unorm2x16(packed_bc);
+    return {bc.x, bc.y, max(0.0f, 1.0f - bc.x - bc.y)};
+  }
+
   ETX_GPU_CODE Vertex vertex(const Scene& s) const {
-    return lerp_vertex(s.vertices, s.triangles[triangle_index], bc);
+    auto result = lerp_vertex(s.vertices, s.triangles[triangle_index], barycentric());
+    result.pos = pos;
+    return result;
   }
 
   ETX_GPU_CODE const float3& position(const Scene& s) const {
     return pos;
   }
 
-  ETX_GPU_CODE const float3& normal(const Scene& s) const {
-    return nrm;
+  ETX_GPU_CODE float3 normal(const Scene& s) const {
+    return unpack_unit_vector(packed_nrm);
+  }
+
+  ETX_GPU_CODE float3 w_i() const {
+    return unpack_unit_vector(packed_w_i);
+  }
+
+  ETX_GPU_CODE uint32_t material_index(const Scene& s) const {
+    return s.triangle_to_material[triangle_index];
   }
 };
 
+static_assert(sizeof(VCMLightVertex) == 64);
+
 struct ETX_ALIGNED VCMLightPath {
   uint32_t index ETX_EMPTY_INIT;
   uint32_t count ETX_EMPTY_INIT;
@@ -244,6 +274,7 @@ ETX_GPU_CODE bool vcm_next_ray(const Scene& scene, const PathSource path_source,
 
   state.ray.d = bsdf_sample.w_o;
   state.ray.o = shading_pos(scene.vertices, tri, intersection.barycentric, bsdf_sample.w_o);
+  state.cone = (bsdf_sample.is_delta() && (subsurface_sample == false)) ? RayCone{state.cone.width_at(intersection.t), state.cone.spread} : RayCone{};
   state.eta *= bsdf_sample.eta;
   state.total_path_depth += 1;
 
@@ -258,8 +289,8 @@ ETX_GPU_CODE SpectralResponse vcm_get_radiance(const Scene& scene, const Emitter
   SpectralResponse radiance = {};
 
   if (emitter.is_local()) {
-    radiance = emitter_get_radiance(emitter, state.spect, intersection.tex, state.ray.o, intersection.pos,  //
-      pdf_emitter_area, pdf_emitter_dir, pdf_emitter_dir_out, scene, (state.total_path_depth == 1));        //
+    radiance = emitter_get_radiance(emitter, state.spect, intersection.tex, intersection.barycentric, state.ray.o, intersection.pos,  //
+      pdf_emitter_area, pdf_emitter_dir, pdf_emitter_dir_out, scene, (state.total_path_depth == 1));                                 //
   } else {
     radiance = emitter_get_radiance(emitter, state.spect, state.ray.d,  //
       pdf_emitter_area, pdf_emitter_dir, pdf_emitter_dir_out, scene);   //
@@ -318,12 +349,13 @@ ETX_GPU_CODE VCMPathState vcm_generate_camera_state(const uint2& coord, const Sc
 
   state.uv = get_jittered_uv(state.sampler, coord, scene.camera.image_size);
   state.ray = generate_ray(state.sampler, scene, state.uv);
+  state.cone = {0.0f, pixel_spread_angle(scene.camera)};
   state.throughput = {state.spect.wavelength, 1.0f};
   state.gathered = {state.spect.wavelength, 0.0f};
   state.merged = {};
 
   auto film_eval = film_evaluate_out(state.spect, scene.camera, state.ray);
-  state.d_vcm = 1.0f / film_eval.pdf_dir;
+  state.d_vcm = it.light_path_ratio / film_eval.pdf_dir;
   state.d_vc = 0.0f;
   state.d_vm = 0.0f;
   state.medium_index = scene.camera_medium_index;
@@ -351,6 +383,7 @@ ETX_GPU_CODE bool vcm_handle_sampled_medium(const Scene& scene, const Medium::Sa
   const auto& medium = scene.mediums[state.medium_index];
   state.ray.o = medium_sample.pos;
   state.ray.d = medium.sample_phase_function(state.spect, state.sampler, state.ray.d);
+  state.cone = {};
 
   if (state.total_path_depth + 1 > scene.max_path_length)
     return false;
@@ -371,6 +404,7 @@ ETX_GPU_CODE bool vcm_handle_boundary_bsdf(const Scene& scene, const PathSource
   state.path_distance += intersection.t;
   state.ray.o = intersection.pos;
   state.ray.d = bsdf_sample.w_o;
+  state.cone.width = state.cone.width_at(intersection.t);
   return true;
 }
 
@@ -415,13 +449,14 @@ ETX_GPU_CODE float3 vcm_connect_to_camera(const Raytracing& rt, const Scene& sce
   float camera_pdf = camera_sample.pdf_dir_out * fabsf(dot(intersection.nrm, w_o)) / dot(direction, direction);
   ETX_VALIDATE(camera_pdf);
 
-  float w_light = camera_pdf * (vcm_iteration.vm_weight + state.d_vcm + state.d_vc * reverse_pdf);
+  // camera importance is normalized for one light path per pixel
+  float w_light = (camera_pdf / vcm_iteration.light_path_ratio) * (vcm_iteration.vm_weight + state.d_vcm + state.d_vc * reverse_pdf);
   ETX_VALIDATE(w_light);
 
   float weight = options.enable_mis() ? (1.0f / (1.0f + w_light)) : 1.0f;
   ETX_VALIDATE(weight);
 
-  weight *= fix_shading_normal(tri.geo_n, in_intersection.nrm, in_intersection.w_i, w_o);
+  weight *= fix_shading_normal(tri.geo_n, in_intersection.nrm, in_intersection.w_i, w_o) / vcm_iteration.light_path_ratio;
   auto result = (tr * eval.bsdf * state.throughput * camera_sample.weight) * weight;
 
   uv = camera_sample.uv;
@@ -531,8 +566,8 @@ ETX_GPU_CODE bool vcm_connect_to_light_vertex(const Scene& scene, const Spectral
   }
 
   const auto& light_tri = scene.triangles[light_vertex.triangle_index];
-  const auto& light_mat = scene.materials[light_vertex.material_index];
-  auto light_data = BSDFData{spect, state_medium, PathSource::Light, light_v, light_vertex.w_i};
+  const auto& light_mat = scene.materials[light_vertex.material_index(scene)];
+  auto light_data = BSDFData{spect, state_medium, PathSource::Light, light_v, light_vertex.w_i()};
   auto light_bsdf = bsdf::evaluate(light_data, -w_o, light_mat, scene, state.sampler);
   if (light_bsdf.valid() == false) {
     return false;
@@ -567,7 +602,7 @@ ETX_GPU_CODE SpectralResponse vcm_connect_to_light_path(const Scene& scene, cons
     return {state.spect.wavelength, 0.0f};
 
   const auto& tri = scene.triangles[intersection.triangle_index];
-  const auto& light_path = light_paths[state.global_index];
+  const auto& light_path = light_paths[vcm_light_path_index(iteration, state.global_index, light_paths.count)];
 
   SpectralResponse result = {state.spect.wavelength, 0.0f};
   for (uint64_t i = 0; (i < light_path.count) && (state.total_path_depth + i + 2 <= scene.max_path_length); ++i) {
@@ -589,7 +624,7 @@ ETX_GPU_CODE SpectralResponse vcm_connect_to_light_path(const Scene& scene, cons
 }
 
 struct ETX_ALIGNED VCMSpatialGridData {
-  ArrayView<uint32_t> indices ETX_EMPTY_INIT;
+  ArrayView<VCMLightVertex> vertices ETX_EMPTY_INIT;
   ArrayView<uint32_t> cell_ends ETX_EMPTY_INIT;
   BoundingBox bounding_box ETX_EMPTY_INIT;
   uint32_t hash_table_mask ETX_EMPTY_INIT;
@@ -606,13 +641,12 @@ struct ETX_ALIGNED VCMSpatialGridData {
     return cell_index(static_cast<int32_t>(m.x), static_cast<int32_t>(m.y), static_cast<int32_t>(m.z));
   }
 
-  ETX_GPU_CODE float3 gather_index(const Scene& scene, const Intersection& intersection, const ArrayView<VCMLightVertex>& samples, const VCMOptions& options, float vc_weight,
-    uint32_t index, VCMPathState& state) const {
+  ETX_GPU_CODE float3 gather_index(const Scene& scene, const Intersection& intersection, const VCMOptions& options, float vc_weight, uint32_t index, VCMPathState& state) const {
     uint32_t range_begin = (index == 0) ? 0 : cell_ends[index - 1llu];
 
     float3 merged = {};
     for (uint32_t j = range_begin, range_end = cell_ends[index]; j < range_end; ++j) {
-      const auto& light_vertex = samples[indices[j]];
+      const auto& light_vertex = vertices[j];
 
       auto d = light_vertex.position(scene) - intersection.pos;
       float distance_squared = dot(d, d);
@@ -626,12 +660,12 @@ struct ETX_ALIGNED VCMSpatialGridData {
 
       const auto& mat = scene.materials[intersection.material_index];
       auto camera_data = BSDFData{state.spect, state.medium_index, PathSource::Camera, intersection, intersection.w_i};
-      auto camera_bsdf = bsdf::evaluate(camera_data, -light_vertex.w_i, mat, scene, state.sampler);
+      auto camera_bsdf = bsdf::evaluate(camera_data, -light_vertex.w_i(), mat, scene, state.sampler);
       if (camera_bsdf.valid() == false) {
         continue;
       }
 
-      auto camera_rev_pdf = bsdf::reverse_pdf(camera_data, -light_vertex.w_i, mat, scene, state.sampler);
+      auto camera_rev_pdf = bsdf::reverse_pdf(camera_data, -light_vertex.w_i(), mat, scene, state.sampler);
 
       float w_light = light_vertex.d_vcm * vc_weight + light_vertex.d_vm * camera_bsdf.pdf;
       float w_camera = state.d_vcm * vc_weight + state.d_vm * camera_rev_pdf;
@@ -657,9 +691,8 @@ struct ETX_ALIGNED VCMSpatialGridData {
     return merged;
   }
 
-  ETX_GPU_CODE float3 gather(const Scene& scene, VCMPathState& state, const ArrayView<VCMLightVertex>& samples, const VCMOptions& options, const Intersection& intersection,
-    float vc_weight) const {
-    if (indices.count == 0) {
+  ETX_GPU_CODE float3 gather(const Scene& scene, VCMPathState& state, const VCMOptions& options, const Intersection& intersection, float vc_weight) const {
+    if (vertices.count == 0) {
       return {};
     }
 
@@ -692,17 +725,28 @@ struct ETX_ALIGNED VCMSpatialGridData {
 
     float3 merged = {};
     for (uint32_t i = 0; i < 8; ++i) {
-      merged += gather_index(scene, intersection, samples, options, vc_weight, cell_indices[i], state);
+      // neighbouring cells could be hashed into the same bucket, gather each bucket only once
+      bool duplicate = false;
+      for (uint32_t j = 0; (duplicate == false) && (j < i); ++j) {
+        duplicate = cell_indices[j] == cell_indices[i];
+      }
+      if (duplicate == false) {
+        merged += gather_index(scene, intersection, options, vc_weight, cell_indices[i], state);
+      }
     }
 
     return merged;
   }
 };
 
+/*
+ * options missing from kFeatures are compiled out, options present there are still checked at run time
+ */
+template <uint32_t kFeatures = VCMOptions::DefaultOptions>
 ETX_GPU_CODE bool vcm_camera_step(const Scene& scene, const VCMIteration& iteration, const VCMOptions& options, const ArrayView<VCMLightPath>& light_paths,
   const ArrayView<VCMLightVertex>& light_vertices, VCMPathState& state, const Raytracing& rt, const VCMSpatialGridData& spatial_grid) {
   Intersection intersection = {};
-  bool found_intersection = rt.trace(scene, state.ray, intersection, state.sampler);
+  bool found_intersection = rt.trace(scene, state.ray, state.cone, intersection, state.sampler);
 
   Medium::Sample medium_sample = vcm_try_sampling_medium(scene, state, intersection.t);
   if (medium_sample.sampled_medium()) {
@@ -710,7 +754,9 @@ ETX_GPU_CODE bool vcm_camera_step(const Scene& scene, const VCMIteration& iterat
   }
 
   if (found_intersection == false) {
-    vcm_cam_handle_miss(scene, options, intersection, state);
+    if constexpr ((kFeatures & VCMOptions::DirectHit) != 0u) {
+      vcm_cam_handle_miss(scene, options, intersection, state);
+    }
     return false;
   }
 
@@ -723,21 +769,25 @@ ETX_GPU_CODE bool vcm_camera_step(const Scene& scene, const VCMIteration& iterat
   auto bsdf_sample = bsdf::sample(bsdf_data, mat, scene, state.sampler);
 
   vcm_update_camera_vcm(intersection, state);
-  vcm_handle_direct_hit(scene, options, intersection, state);
+  if constexpr ((kFeatures & VCMOptions::DirectHit) != 0u) {
+    vcm_handle_direct_hit(scene, options, intersection, state);
+  }
 
   subsurface::Gather ss_gather = {};
   bool subsurface_path = (bsdf_sample.properties & BSDFSample::Diffuse) && (mat.subsurface.cls != SubsurfaceMaterial::Class::Disabled);
   bool subsurface_sampled = subsurface_path && subsurface::gather(state.spect, scene, intersection, rt, state.sampler, ss_gather);
 
   if (bsdf::is_delta(mat, intersection.tex, scene, state.sampler) == false) {
-    if (subsurface_sampled) {
-      for (uint32_t i = 0; i < ss_gather.intersection_count; ++i) {
-        state.gathered += ss_gather.weights[i] * vcm_connect_to_light_path(scene, iteration, light_paths, light_vertices, options, ss_gather.intersections[i], rt, state);
-        state.gathered += ss_gather.weights[i] * vcm_connect_to_light(scene, iteration, options, ss_gather.intersections[i], rt, state);
+    for (uint32_t i = 0, e = subsurface_sampled ? ss_gather.intersection_count : 1u; i < e; ++i) {
+      const Intersection& connection_point = subsurface_sampled ? ss_gather.intersections[i] : intersection;
+      SpectralResponse connected = {state.spect.wavelength, 0.0f};
+      if constexpr ((kFeatures & VCMOptions::ConnectVertices) != 0u) {
+        connected += vcm_connect_to_light_path(scene, iteration, light_paths, light_vertices, options, connection_point, rt, state);
+      }
+      if constexpr ((kFeatures & VCMOptions::ConnectToLight) != 0u) {
+        connected += vcm_connect_to_light(scene, iteration, options, connection_point, rt, state);
       }
-    } else {
-      state.gathered += vcm_connect_to_light_path(scene, iteration, light_paths, light_vertices, options, intersection, rt, state);
-      state.gathered += vcm_connect_to_light(scene, iteration, options, intersection, rt, state);
+      state.gathered += subsurface_sampled ? ss_gather.weights[i] * connected : connected;
     }
   }
 
@@ -749,8 +799,10 @@ ETX_GPU_CODE bool vcm_camera_step(const Scene& scene, const VCMIteration& iterat
     bsdf_sample.eta = 1.0f;
   }
 
-  if (options.enable_merging() && options.merge_vertices() && (state.total_path_depth + 1 <= scene.max_path_length)) {
-    state.merged += spatial_grid.gather(scene, state, light_vertices, options, intersection, iteration.vc_weight);
+  if constexpr ((kFeatures & (VCMOptions::MergeVertices | VCMOptions::EnableMerging)) == (VCMOptions::MergeVertices | VCMOptions::EnableMerging)) {
+    if (options.enable_merging() && options.merge_vertices() && (state.total_path_depth + 1 <= scene.max_path_length)) {
+      state.merged += spatial_grid.gather(scene, state, options, intersection, iteration.vc_weight);
+    }
   }
 
   if (subsurface_path && (subsurface_sampled == false)) {
@@ -769,6 +821,7 @@ struct ETX_ALIGNED LightStepResult {
   bool continue_tracing = false;
 };
 
+template <uint32_t kFeatures = VCMOptions::DefaultOptions>
 ETX_GPU_CODE LightStepResult vcm_light_step(const Scene& scene, const VCMIteration& iteration, const VCMOptions& options, const uint32_t path_index, VCMPathState& state,
   const Raytracing& rt) {
   Intersection intersection = {};
@@ -807,7 +860,7 @@ ETX_GPU_CODE LightStepResult vcm_light_step(const Scene& scene, const VCMIterati
     result.vertex_to_add = {state, intersection, path_index};
     result.splat_count = 0;
 
-    if (options.connect_to_camera() && (state.total_path_depth + 1 <= scene.max_path_length)) {
+    if (((kFeatures & VCMOptions::ConnectToCamera) != 0u) && options.connect_to_camera() && (state.total_path_depth + 1 <= scene.max_path_length)) {
       if (subsurface_sampled) {
         for (uint32_t i = 0; i < ss_gather.intersection_count; ++i) {
           auto value = vcm_connect_to_camera(rt, scene, mat, tri, iteration, options,  //
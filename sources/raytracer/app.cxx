@@ -57,6 +57,9 @@ void RTApplication::init() {
   if (_options.has("ref") == false) {
     _options.add("ref", "none");
   }
+  if (_options.has("texture-cache-mb") == false) {
+    _options.add(0u, "texture-cache-mb", "Texture cache budget (MB), zero keeps textures resident");
+  }
 
 #if defined(ETX_PLATFORM_WINDOWS)
   if (GetAsyncKeyState(VK_ESCAPE)) {
@@ -77,6 +80,8 @@ void RTApplication::init() {
 
   ui.set_current_integrator(_current_integrator);
 
+  scene.set_texture_cache_budget(1024llu * 1024llu * _options.get("texture-cache-mb", 0u).to_integer());
+
   _current_scene_file = _options.get("scene", std::string{}).name;
   if (_current_scene_file.empty() == false) {
     on_scene_file_selected(_current_scene_file);
@@ -105,6 +110,10 @@ void RTApplication::frame() {
   bool c_image_updated = false;
   bool l_image_updated = false;
 
+  if (scene.has_loaded_images()) {
+    on_images_loaded();
+  }
+
   if (_current_integrator != nullptr) {
     _current_integrator->update();
     status = _current_integrator->status();
@@ -346,9 +355,33 @@ void RTApplication::on_options_changed() {
 
 void RTApplication::on_material_changed(uint32_t index) {
   // TODO : re-upload to GPU
+  _current_integrator->stop(Integrator::Stop::Immediate);
+  scene.update_material(index);
   _current_integrator->preview(ui.integrator_options());
 }
 
+void RTApplication::on_images_loaded() {
+  // TODO : re-upload to GPU
+  if (_current_integrator == nullptr) {
+    scene.publish_loaded_images();
+    return;
+  }
+
+  auto state = _current_integrator->state();
+  if (state == Integrator::State::Stopped) {
+    scene.publish_loaded_images();
+    return;
+  }
+
+  _current_integrator->stop(Integrator::Stop::Immediate);
+  scene.publish_loaded_images();
+  if (state == Integrator::State::Preview) {
+    _current_integrator->preview(ui.integrator_options());
+  } else {
+    _current_integrator->run(ui.integrator_options());
+  }
+}
+
 void RTApplication::on_medium_changed(uint32_t index) {
   // TODO : re-upload to GPU
   _current_integrator->preview(ui.integrator_options());
@@ -357,6 +390,7 @@ void RTApplication::on_medium_changed(uint32_t index) {
 void RTApplication::on_emitter_changed(uint32_t index) {
   // TODO : re-upload to GPU
   _current_integrator->stop(Integrator::Stop::Immediate);
+  scene.bake_atmosphere();
   build_emitters_distribution(scene.mutable_scene());
   _current_integrator->preview(ui.integrator_options());
 }
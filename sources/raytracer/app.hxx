@@ -45,6 +45,7 @@ struct RTApplication {
   void on_use_image_as_reference();
   void on_material_changed(uint32_t index);
   void on_medium_changed(uint32_t index);
+  void on_images_loaded();
   void on_emitter_changed(uint32_t index);
   void on_camera_changed();
   void on_scene_settings_changed();
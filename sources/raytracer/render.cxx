@@ -212,7 +212,7 @@ void RenderContext::set_reference_image(const char* file_name) {
 
 void RenderContext::set_reference_image(const float4 data[], const uint2 dimensions) {
   _private->image_pool.remove(_private->ref_image_handle);
-  _private->ref_image_handle = _private->image_pool.add_from_data(data, dimensions);
+  _private->ref_image_handle = _private->image_pool.add_from_data(data, dimensions, Image::Regular);
   apply_reference_image(_private->ref_image_handle);
 }
 
@@ -833,6 +833,9 @@ bool UI::build_material(Material& material) {
 
   changed |= ImGui::SliderFloat("##r_u", &material.roughness.x, 0.0f, 1.0f, "Roughness U %.2f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoRoundToFormat);
   changed |= ImGui::SliderFloat("##r_v", &material.roughness.y, 0.0f, 1.0f, "Roughness V %.2f", ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_NoRoundToFormat);
+  if ((material.cls == Material::Class::Conductor) || (material.cls == Material::Class::Dielectric)) {
+    changed |= ImGui::Combo("##multiple_scattering", reinterpret_cast<int*>(&material.multiple_scattering), "Random Walk\0Energy Compensation\0");
+  }
   changed |= ior_picker("Index Of Refraction", material.int_ior, _current_scene->spectrums);
   changed |= spectrum_picker("Diffuse", material.diffuse.spectrum, _current_scene->spectrums, false);
   changed |= spectrum_picker("Specular", material.specular.spectrum, _current_scene->spectrums, false);
@@ -888,6 +891,9 @@ bool UI::build_medium(Medium& m) {
   changed |= spectrum_picker("Absorption", m.s_absorption, _current_scene->spectrums, true);
   changed |= spectrum_picker("Scattering", m.s_scattering, _current_scene->spectrums, true);
   changed |= ImGui::SliderFloat("##g", &m.phase_function_g, -0.999f, 0.999f, "Asymmetry %.2f", ImGuiSliderFlags_AlwaysClamp);
+  if (m.cls == Medium::Class::Heterogeneous) {
+    changed |= ImGui::Combo("##transmittance", reinterpret_cast<int*>(&m.transmittance_estimator), "Ratio Tracking\0Residual Ratio Tracking\0");
+  }
   return changed;
 }
 